@@ -0,0 +1,724 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "art.h"
+
+/** bytes of a compressed path kept in the node, a longer path is checked
+ *  against a leaf below the node.
+ */
+#define ART_PREFIX 10
+
+/** leaves are tagged in the low bit of the child pointer. */
+#define ART_ISLEAF(p) ((uintptr_t)(p) &1)
+#define ART_LEAF(p) ((art_leaf *) ((uintptr_t)(p) & ~(uintptr_t) 1))
+#define ART_TAG(l) ((void *) ((uintptr_t)(l) | 1))
+
+/** child index of byte 'c'. Flipping the top bit makes the unsigned order
+ *  of the index the signed char order of tst.c, so negative bytes sort
+ *  before the nul-character ending each word.
+ */
+#define ART_BYTE(c) ((unsigned char) (c) ^ 0x80)
+
+enum { ART4, ART16, ART48, ART256 };
+
+typedef struct art_leaf {
+    char *word; /* also the key, nul-character included */
+    unsigned refcnt;
+} art_leaf;
+
+typedef struct art_node {
+    uint8_t type;
+    uint16_t n;    /* children */
+    uint32_t plen; /* bytes of the compressed path */
+    unsigned char prefix[ART_PREFIX]; /* first bytes of the path */
+} art_node;
+
+/** children of node4 and node16 are sorted by index. */
+typedef struct art_node4 {
+    art_node h;
+    unsigned char keys[4];
+    void *child[4];
+} art_node4;
+
+typedef struct art_node16 {
+    art_node h;
+    unsigned char keys[16];
+    void *child[16];
+} art_node16;
+
+/** index[c] is the slot of child 'c' plus one, 0 if there is none. */
+typedef struct art_node48 {
+    art_node h;
+    unsigned char index[256];
+    void *child[48];
+} art_node48;
+
+typedef struct art_node256 {
+    art_node h;
+    void *child[256];
+} art_node256;
+
+struct art_tree {
+    void *root;
+    size_t nodes; /* inner nodes and leaves */
+    size_t bytes; /* bytes of nodes, leaves and copied strings */
+    int cpy;
+};
+
+static const size_t art_size[] = {
+    [ART4] = sizeof(art_node4),
+    [ART16] = sizeof(art_node16),
+    [ART48] = sizeof(art_node48),
+    [ART256] = sizeof(art_node256),
+};
+
+static art_node *art_node_alloc(art_tree *t, int type)
+{
+    art_node *n = calloc(1, art_size[type]);
+
+    if (n) {
+        n->type = type;
+        t->nodes++;
+        t->bytes += art_size[type];
+    }
+    return n;
+}
+
+static void art_node_release(art_tree *t, art_node *n)
+{
+    t->nodes--;
+    t->bytes -= art_size[n->type];
+    free(n);
+}
+
+/** copy the header of 'from' into 'to', keeping the type of 'to'. */
+static void art_copy_header(art_node *to, const art_node *from)
+{
+    to->n = from->n;
+    to->plen = from->plen;
+    memcpy(to->prefix, from->prefix, ART_PREFIX);
+}
+
+static art_leaf *art_leaf_alloc(art_tree *t, const char *s)
+{
+    art_leaf *l = malloc(sizeof *l);
+    size_t len = strlen(s) + 1;
+
+    if (!l)
+        return NULL;
+    l->refcnt = 1;
+    l->word = (char *) s;
+    if (t->cpy) {
+        if (!(l->word = malloc(len))) {
+            free(l);
+            return NULL;
+        }
+        memcpy(l->word, s, len);
+        t->bytes += len;
+    }
+    t->nodes++;
+    t->bytes += sizeof *l;
+    return l;
+}
+
+static void art_leaf_release(art_tree *t, art_leaf *l)
+{
+    if (t->cpy) {
+        t->bytes -= strlen(l->word) + 1;
+        free(l->word);
+    }
+    t->nodes--;
+    t->bytes -= sizeof *l;
+    free(l);
+}
+
+/** returns the slot of child 'c' of 'n', NULL if there is none. */
+static void **art_find(art_node *n, unsigned char c)
+{
+    switch (n->type) {
+    case ART4: {
+        art_node4 *p = (art_node4 *) n;
+        for (int i = 0; i < n->n; i++)
+            if (p->keys[i] == c)
+                return &p->child[i];
+        return NULL;
+    }
+    case ART16: {
+        art_node16 *p = (art_node16 *) n;
+#ifdef __SSE2__
+        __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
+                                     _mm_loadu_si128((__m128i *) p->keys));
+        unsigned bits = _mm_movemask_epi8(cmp) & ((1U << n->n) - 1);
+        return bits ? &p->child[__builtin_ctz(bits)] : NULL;
+#else
+        for (int i = 0; i < n->n; i++)
+            if (p->keys[i] == c)
+                return &p->child[i];
+        return NULL;
+#endif
+    }
+    case ART48: {
+        art_node48 *p = (art_node48 *) n;
+        return p->index[c] ? &p->child[p->index[c] - 1] : NULL;
+    }
+    default: {
+        art_node256 *p = (art_node256 *) n;
+        return p->child[c] ? &p->child[c] : NULL;
+    }
+    }
+}
+
+/** returns the leftmost leaf below 'p', all of them share the path. */
+static art_leaf *art_minimum(const void *p)
+{
+    while (!ART_ISLEAF(p)) {
+        const art_node *n = p;
+        int i = 0;
+        switch (n->type) {
+        case ART4:
+            p = ((const art_node4 *) n)->child[0];
+            break;
+        case ART16:
+            p = ((const art_node16 *) n)->child[0];
+            break;
+        case ART48:
+            while (!((const art_node48 *) n)->index[i])
+                i++;
+            p = ((const art_node48 *) n)
+                    ->child[((const art_node48 *) n)->index[i] - 1];
+            break;
+        default:
+            while (!((const art_node256 *) n)->child[i])
+                i++;
+            p = ((const art_node256 *) n)->child[i];
+        }
+    }
+    return ART_LEAF(p);
+}
+
+/** art_prefix_match() returns how many bytes of the path of 'n' match 'key'
+ *  from 'depth' on, comparing at most up to 'len', the length of 'key'.
+ */
+static uint32_t art_prefix_match(const art_node *n,
+                                 const char *key,
+                                 size_t len,
+                                 size_t depth)
+{
+    size_t max = n->plen < len - depth ? n->plen : len - depth;
+    uint32_t i = 0;
+
+    for (; i < max && i < ART_PREFIX; i++)
+        if (n->prefix[i] != (unsigned char) key[depth + i])
+            return i;
+    if (i < max) { /* the rest of the path is only in the leaves */
+        const char *w = art_minimum(n)->word + depth;
+        for (; i < max; i++)
+            if (w[i] != key[depth + i])
+                return i;
+    }
+    return i;
+}
+
+/** art_add() add 'child' under index 'c' of the node at '*ref', growing it
+ *  into the next size if it is full. returns 0 on success, -1 on
+ *  allocation failure with the node unchanged.
+ */
+static int art_add(art_tree *t, void **ref, unsigned char c, void *child)
+{
+    art_node *n = *ref;
+
+    switch (n->type) {
+    case ART4:
+    case ART16: {
+        int cap = n->type == ART4 ? 4 : 16, i = 0;
+        unsigned char *keys = n->type == ART4 ? ((art_node4 *) n)->keys
+                                              : ((art_node16 *) n)->keys;
+        void **kids = n->type == ART4 ? ((art_node4 *) n)->child
+                                      : ((art_node16 *) n)->child;
+        if (n->n < cap) {
+            while (i < n->n && keys[i] < c)
+                i++;
+            memmove(keys + i + 1, keys + i, n->n - i);
+            memmove(kids + i + 1, kids + i, (n->n - i) * sizeof *kids);
+            keys[i] = c;
+            kids[i] = child;
+            n->n++;
+            return 0;
+        }
+        if (n->type == ART4) {
+            art_node16 *g = (art_node16 *) art_node_alloc(t, ART16);
+            if (!g)
+                return -1;
+            art_copy_header(&g->h, n);
+            memcpy(g->keys, keys, 4);
+            memcpy(g->child, kids, 4 * sizeof *kids);
+            *ref = g;
+        } else {
+            art_node48 *g = (art_node48 *) art_node_alloc(t, ART48);
+            if (!g)
+                return -1;
+            art_copy_header(&g->h, n);
+            for (i = 0; i < 16; i++) {
+                g->index[keys[i]] = i + 1;
+                g->child[i] = kids[i];
+            }
+            *ref = g;
+        }
+        break;
+    }
+    case ART48: {
+        art_node48 *p = (art_node48 *) n;
+        if (n->n < 48) {
+            int slot = 0;
+            while (p->child[slot])
+                slot++;
+            p->child[slot] = child;
+            p->index[c] = slot + 1;
+            n->n++;
+            return 0;
+        }
+        art_node256 *g = (art_node256 *) art_node_alloc(t, ART256);
+        if (!g)
+            return -1;
+        art_copy_header(&g->h, n);
+        for (int i = 0; i < 256; i++)
+            if (p->index[i])
+                g->child[i] = p->child[p->index[i] - 1];
+        *ref = g;
+        break;
+    }
+    default:
+        ((art_node256 *) n)->child[c] = child;
+        n->n++;
+        return 0;
+    }
+    art_node_release(t, n);
+    return art_add(t, ref, c, child);
+}
+
+/** art_remove() remove the child in 'slot' under index 'c' of the node at
+ *  '*ref', shrinking it into the previous size when it gets sparse. A
+ *  node4 left with one child is replaced by it, its path prepended.
+ */
+static void art_remove(art_tree *t, void **ref, unsigned char c, void **slot)
+{
+    art_node *n = *ref, *g = NULL;
+
+    switch (n->type) {
+    case ART4:
+    case ART16: {
+        unsigned char *keys = n->type == ART4 ? ((art_node4 *) n)->keys
+                                              : ((art_node16 *) n)->keys;
+        void **kids = n->type == ART4 ? ((art_node4 *) n)->child
+                                      : ((art_node16 *) n)->child;
+        int i = slot - kids;
+        memmove(keys + i, keys + i + 1, n->n - i - 1);
+        memmove(kids + i, kids + i + 1, (n->n - i - 1) * sizeof *kids);
+        n->n--;
+        if (n->type == ART16 && n->n == 3 && (g = art_node_alloc(t, ART4))) {
+            art_copy_header(g, n);
+            memcpy(((art_node4 *) g)->keys, keys, 3);
+            memcpy(((art_node4 *) g)->child, kids, 3 * sizeof *kids);
+        }
+        if (n->type == ART4 && n->n == 1) {
+            void *only = kids[0];
+            if (!ART_ISLEAF(only)) { /* prepend path and index to it */
+                art_node *o = only;
+                unsigned char prefix[ART_PREFIX];
+                uint32_t len = n->plen < ART_PREFIX ? n->plen : ART_PREFIX;
+                memcpy(prefix, n->prefix, len);
+                if (len < ART_PREFIX)
+                    prefix[len++] = keys[0] ^ 0x80;
+                for (uint32_t i = 0; len < ART_PREFIX && i < o->plen;)
+                    prefix[len++] = o->prefix[i++];
+                memcpy(o->prefix, prefix, len);
+                o->plen += n->plen + 1;
+            }
+            *ref = only;
+            art_node_release(t, n);
+            return;
+        }
+        break;
+    }
+    case ART48: {
+        art_node48 *p = (art_node48 *) n;
+        *slot = NULL;
+        p->index[c] = 0;
+        n->n--;
+        if (n->n == 12 && (g = art_node_alloc(t, ART16))) {
+            art_node16 *q = (art_node16 *) g;
+            art_copy_header(g, n);
+            for (int i = 0, j = 0; i < 256; i++)
+                if (p->index[i]) {
+                    q->keys[j] = i;
+                    q->child[j++] = p->child[p->index[i] - 1];
+                }
+        }
+        break;
+    }
+    default: {
+        art_node256 *p = (art_node256 *) n;
+        *slot = NULL;
+        n->n--;
+        if (n->n == 37 && (g = art_node_alloc(t, ART48))) {
+            art_node48 *q = (art_node48 *) g;
+            art_copy_header(g, n);
+            for (int i = 0, j = 0; i < 256; i++)
+                if (p->child[i]) {
+                    q->child[j] = p->child[i];
+                    q->index[i] = ++j;
+                }
+        }
+    }
+    }
+    if (g) { /* a failed shrink leaves the larger node in place */
+        *ref = g;
+        art_node_release(t, n);
+    }
+}
+
+art_tree *art_create(const int cpy)
+{
+    art_tree *t = calloc(1, sizeof *t);
+    if (t)
+        t->cpy = cpy;
+    return t;
+}
+
+void *art_ins(art_tree *t, const char *s)
+{
+    size_t len, depth = 0;
+    void **ref;
+    art_leaf *l;
+
+    if (!t || !s)
+        return NULL;
+    len = strlen(s) + 1; /* the nul-character ends every key */
+
+    ref = &t->root;
+    while (*ref) {
+        if (ART_ISLEAF(*ref)) {
+            art_leaf *old = ART_LEAF(*ref);
+            art_node *n;
+            size_t common = 0;
+
+            if (!strcmp(old->word, s)) {
+                old->refcnt++;
+                return old->word;
+            }
+            /* both keys end with a nul-character, they differ before */
+            while (old->word[depth + common] == s[depth + common])
+                common++;
+            if (!(l = art_leaf_alloc(t, s)))
+                return NULL;
+            if (!(n = art_node_alloc(t, ART4))) {
+                art_leaf_release(t, l);
+                return NULL;
+            }
+            n->plen = common;
+            memcpy(n->prefix, s + depth,
+                   common < ART_PREFIX ? common : ART_PREFIX);
+            art_node4 *p = (art_node4 *) n;
+            unsigned char a = ART_BYTE(old->word[depth + common]);
+            unsigned char b = ART_BYTE(s[depth + common]);
+            p->keys[a > b] = a;
+            p->child[a > b] = *ref;
+            p->keys[a < b] = b;
+            p->child[a < b] = ART_TAG(l);
+            n->n = 2;
+            *ref = n;
+            return l->word;
+        }
+
+        art_node *n = *ref;
+        if (n->plen) {
+            uint32_t m = art_prefix_match(n, s, len, depth);
+            if (m < n->plen) { /* split the path where 's' leaves it */
+                art_node *p = art_node_alloc(t, ART4);
+                unsigned char c;
+                if (!p || !(l = art_leaf_alloc(t, s))) {
+                    if (p)
+                        art_node_release(t, p);
+                    return NULL;
+                }
+                p->plen = m;
+                memcpy(p->prefix, n->prefix, m < ART_PREFIX ? m : ART_PREFIX);
+                if (n->plen <= ART_PREFIX) {
+                    c = n->prefix[m];
+                    n->plen -= m + 1;
+                    memmove(n->prefix, n->prefix + m + 1, n->plen);
+                } else {
+                    const char *w = art_minimum(n)->word + depth;
+                    c = w[m];
+                    n->plen -= m + 1;
+                    memcpy(n->prefix, w + m + 1,
+                           n->plen < ART_PREFIX ? n->plen : ART_PREFIX);
+                }
+                art_node4 *q = (art_node4 *) p;
+                unsigned char a = ART_BYTE(c), b = ART_BYTE(s[depth + m]);
+                q->keys[a > b] = a;
+                q->child[a > b] = n;
+                q->keys[a < b] = b;
+                q->child[a < b] = ART_TAG(l);
+                p->n = 2;
+                *ref = p;
+                return l->word;
+            }
+            depth += n->plen;
+        }
+
+        void **child = art_find(n, ART_BYTE(s[depth]));
+        if (!child) {
+            if (!(l = art_leaf_alloc(t, s)))
+                return NULL;
+            if (art_add(t, ref, ART_BYTE(s[depth]), ART_TAG(l))) {
+                art_leaf_release(t, l);
+                return NULL;
+            }
+            return l->word;
+        }
+        ref = child;
+        depth++;
+    }
+
+    if (!(l = art_leaf_alloc(t, s))) {
+        fprintf(stderr, "error: art_ins(), memory exhausted.\n");
+        return NULL;
+    }
+    *ref = ART_TAG(l);
+    return l->word;
+}
+
+void *art_del(art_tree *t, const char *s)
+{
+    void **ref, **pref = NULL;
+    size_t len, depth = 0;
+    unsigned char c = 0;
+
+    if (!t || !s)
+        return NULL;
+    len = strlen(s) + 1;
+
+    ref = &t->root;
+    while (*ref) {
+        if (ART_ISLEAF(*ref)) {
+            art_leaf *l = ART_LEAF(*ref);
+            if (strcmp(l->word, s))
+                break;
+            if (--l->refcnt) {
+                printf("  %s  (refcnt: %u) not removed.\n", l->word,
+                       l->refcnt);
+                return l->word;
+            }
+            art_leaf_release(t, l);
+            if (pref)
+                art_remove(t, pref, c, ref);
+            else
+                t->root = NULL;
+            return NULL;
+        }
+
+        art_node *n = *ref;
+        if (art_prefix_match(n, s, len, depth) != n->plen)
+            break;
+        depth += n->plen;
+        if (depth >= len)
+            break;
+        c = ART_BYTE(s[depth]);
+        pref = ref;
+        if (!(ref = art_find(n, c)))
+            break;
+        depth++;
+    }
+    return (void *) -1;
+}
+
+void *art_search(const art_tree *t, const char *s)
+{
+    const void *p = t->root;
+    size_t len = strlen(s) + 1, depth = 0;
+
+    while (p) {
+        if (ART_ISLEAF(p)) {
+            art_leaf *l = ART_LEAF(p);
+            return strcmp(l->word, s) ? NULL : l->word;
+        }
+        const art_node *n = p;
+        if (n->plen) { /* checked up to ART_PREFIX, the leaf does the rest */
+            uint32_t max = n->plen < ART_PREFIX ? n->plen : ART_PREFIX;
+            for (uint32_t i = 0; i < max; i++)
+                if (n->prefix[i] != (unsigned char) s[depth + i])
+                    return NULL;
+            depth += n->plen;
+            if (depth >= len)
+                return NULL;
+        }
+        void **child = art_find((art_node *) n, ART_BYTE(s[depth++]));
+        p = child ? *child : NULL;
+    }
+    return NULL;
+}
+
+/** fill 'a' with the words below 'p', in order. */
+static void art_suggest(const void *p, char **a, int *n, const int max)
+{
+    if (*n >= max)
+        return;
+    if (ART_ISLEAF(p)) {
+        a[(*n)++] = ART_LEAF(p)->word;
+        return;
+    }
+
+    const art_node *x = p;
+    switch (x->type) {
+    case ART4:
+        for (int i = 0; i < x->n; i++)
+            art_suggest(((const art_node4 *) x)->child[i], a, n, max);
+        break;
+    case ART16:
+        for (int i = 0; i < x->n; i++)
+            art_suggest(((const art_node16 *) x)->child[i], a, n, max);
+        break;
+    case ART48: {
+        const art_node48 *q = p;
+        for (int i = 0; i < 256; i++)
+            if (q->index[i])
+                art_suggest(q->child[q->index[i] - 1], a, n, max);
+        break;
+    }
+    default:
+        for (int i = 0; i < 256; i++)
+            if (((const art_node256 *) x)->child[i])
+                art_suggest(((const art_node256 *) x)->child[i], a, n, max);
+    }
+}
+
+void *art_search_prefix(const art_tree *t,
+                        const char *s,
+                        char **a,
+                        int *n,
+                        const int max)
+{
+    const void *p = t->root;
+    size_t len = strlen(s), depth = 0;
+
+    *n = 0;
+    if (!*s)
+        return NULL;
+
+    while (p) {
+        if (ART_ISLEAF(p)) {
+            if (strncmp(ART_LEAF(p)->word, s, len))
+                return NULL;
+            art_suggest(p, a, n, max);
+            return (void *) p;
+        }
+        const art_node *x = p;
+        uint32_t m = art_prefix_match(x, s, len, depth);
+        if (depth + m == len) { /* 's' ends on the path of 'x' */
+            art_suggest(p, a, n, max);
+            return (void *) p;
+        }
+        if (m < x->plen)
+            return NULL;
+        depth += x->plen;
+        void **child = art_find((art_node *) x, ART_BYTE(s[depth++]));
+        p = child ? *child : NULL;
+    }
+    return NULL;
+}
+
+static void art_traverse(const void *p,
+                         void(fn)(const void *, void *),
+                         void *data)
+{
+    if (ART_ISLEAF(p)) {
+        fn(ART_LEAF(p)->word, data);
+        return;
+    }
+
+    const art_node *x = p;
+    switch (x->type) {
+    case ART4:
+        for (int i = 0; i < x->n; i++)
+            art_traverse(((const art_node4 *) x)->child[i], fn, data);
+        break;
+    case ART16:
+        for (int i = 0; i < x->n; i++)
+            art_traverse(((const art_node16 *) x)->child[i], fn, data);
+        break;
+    case ART48: {
+        const art_node48 *q = p;
+        for (int i = 0; i < 256; i++)
+            if (q->index[i])
+                art_traverse(q->child[q->index[i] - 1], fn, data);
+        break;
+    }
+    default:
+        for (int i = 0; i < 256; i++)
+            if (((const art_node256 *) x)->child[i])
+                art_traverse(((const art_node256 *) x)->child[i], fn, data);
+    }
+}
+
+void art_traverse_fn(const art_tree *t,
+                     void(fn)(const void *, void *),
+                     void *data)
+{
+    if (t->root)
+        art_traverse(t->root, fn, data);
+}
+
+size_t art_memory_usage(const art_tree *t, size_t *nodes)
+{
+    if (nodes)
+        *nodes = t->nodes;
+    return sizeof *t + t->bytes;
+}
+
+static void art_free_all(art_tree *t, void *p)
+{
+    if (ART_ISLEAF(p)) {
+        art_leaf *l = ART_LEAF(p);
+        if (t->cpy)
+            free(l->word);
+        free(l);
+        return;
+    }
+
+    art_node *x = p;
+    switch (x->type) {
+    case ART4:
+        for (int i = 0; i < x->n; i++)
+            art_free_all(t, ((art_node4 *) x)->child[i]);
+        break;
+    case ART16:
+        for (int i = 0; i < x->n; i++)
+            art_free_all(t, ((art_node16 *) x)->child[i]);
+        break;
+    case ART48:
+        for (int i = 0; i < 48; i++)
+            if (((art_node48 *) x)->child[i])
+                art_free_all(t, ((art_node48 *) x)->child[i]);
+        break;
+    default:
+        for (int i = 0; i < 256; i++)
+            if (((art_node256 *) x)->child[i])
+                art_free_all(t, ((art_node256 *) x)->child[i]);
+    }
+    free(x);
+}
+
+void art_free(art_tree *t)
+{
+    if (!t)
+        return;
+    if (t->root)
+        art_free_all(t, t->root);
+    free(t);
+}
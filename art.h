@@ -0,0 +1,59 @@
+#ifndef ART_H
+#define ART_H
+
+#include <stddef.h>
+
+/* forward declaration of adaptive radix tree. Inner nodes hold 4, 16, 48
+ * or 256 children and grow or shrink between those sizes as children come
+ * and go, single child runs are compressed into the path of the node
+ * below them. Leaves hold the string and its refcnt. Words come back in
+ * the order of tst.c, comparing bytes as signed char.
+ */
+typedef struct art_tree art_tree;
+
+/** art_create() allocate an empty tree. If 'cpy' is non-zero the strings
+ *  are copied and owned by the tree, otherwise references are kept.
+ *  returns NULL on allocation failure.
+ */
+art_tree *art_create(const int cpy);
+
+/** art_ins() insert 's', see tst_ins(). returns address of 's' in tree on
+ *  successful insert, NULL on allocation failure.
+ */
+void *art_ins(art_tree *t, const char *s);
+
+/** art_del() delete 's', see tst_del(). returns the address of 's' in tree
+ *  if refcnt non-zero, -1 on 's' not found, otherwise NULL.
+ */
+void *art_del(art_tree *t, const char *s);
+
+/** art_search() returns pointer to 's' on success, NULL otherwise. */
+void *art_search(const art_tree *t, const char *s);
+
+/** art_search_prefix() fills 'a' with up to 'max' words prefixed with 's'
+ *  and their count in 'n', see tst_search_prefix(). returns non-NULL if
+ *  the prefix is in the tree, NULL otherwise.
+ */
+void *art_search_prefix(const art_tree *t,
+                        const char *s,
+                        char **a,
+                        int *n,
+                        const int max);
+
+/** art_traverse_fn() call 'fn' on each word in order, the first argument
+ *  of 'fn' is the word itself.
+ */
+void art_traverse_fn(const art_tree *t,
+                     void(fn)(const void *, void *),
+                     void *data);
+
+/** art_memory_usage() returns the bytes held by nodes, leaves and copied
+ *  strings of 't', storing the number of inner nodes and leaves in 'nodes'
+ *  if non-NULL.
+ */
+size_t art_memory_usage(const art_tree *t, size_t *nodes);
+
+/** free the tree and all storage it owns. */
+void art_free(art_tree *t);
+
+#endif
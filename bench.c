@@ -1,8 +1,19 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "bench.h"
+#include "bloom.h"
+#include "dict.h"
+#include "perfcnt.h"
+#include "server.h"
+#include "tst_idx.h"
+#include "tst_map.h"
+#include "tst_rdx.h"
 
 #define DICT_FILE "cities.txt"
 #define WORDMAX 256
@@ -13,7 +24,7 @@ double tvgetf()
     struct timespec ts;
     double sec;
 
-    clock_gettime(CLOCK_REALTIME, &ts);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
     sec = ts.tv_nsec;
     sec /= 1e9;
     sec += ts.tv_sec;
@@ -28,8 +39,8 @@ int bench_test(const tst_node *root, char *out_file, const int max)
     char **sgl;
     FILE *fp = fopen(out_file, "w");
     FILE *dict = fopen(DICT_FILE, "r");
-    int idx = 0, sidx = 0;
-    double t1, t2;
+    int idx = 0, sidx = 0, cap = 0;
+    double t1, t2, *lat = NULL;
 
     if (!fp || !dict) {
         if (fp) {
@@ -43,20 +54,1952 @@ int bench_test(const tst_node *root, char *out_file, const int max)
         return 1;
     }
 
+    /* keep the latencies in memory, writing a line per query between two
+     * queries would time the stdio buffer as much as the search
+     */
     sgl = (char **) malloc(sizeof(char *) * max);
-    while (fscanf(dict, "%s", word) != EOF) {
+    while (sgl && fscanf(dict, "%s", word) != EOF) {
         if (strlen(word) < sizeof(prefix) - 1)
             continue;
+        if (idx == cap) {
+            double *tmp = realloc(lat, (cap ? cap * 2 : 4096) * sizeof *lat);
+            if (!tmp)
+                break;
+            lat = tmp;
+            cap = cap ? cap * 2 : 4096;
+        }
         strncpy(prefix, word, sizeof(prefix) - 1);
         t1 = tvgetf();
         tst_search_prefix(root, prefix, sgl, &sidx, max);
         t2 = tvgetf();
-        fprintf(fp, "%d %f msec\n", idx, (t2 - t1) * 1000);
-        idx++;
+        lat[idx++] = (t2 - t1) * 1000;
     }
+    for (int i = 0; i < idx; i++)
+        fprintf(fp, "%d %f msec\n", i, lat[i]);
 
+    free(lat);
     free(sgl);
     fclose(fp);
     fclose(dict);
     return 0;
 }
+
+/** load DICT_FILE into a buffer and split it in place into the words the
+ *  loader in test_common.c inserts, "city, country" gives two words.
+ *  returns the buffer, storing the number of words in 'nwords' and the end
+ *  of the buffer in 'end'.
+ */
+static char *bench_load_words(size_t *nwords, char **end)
+{
+    FILE *dict = fopen(DICT_FILE, "r");
+    char *buf, *w;
+    long size;
+
+    if (!dict) {
+        fprintf(stderr, "error: file open failed in '%s'.\n", DICT_FILE);
+        return NULL;
+    }
+    fseek(dict, 0, SEEK_END);
+    size = ftell(dict);
+    rewind(dict);
+    if (size < 0 || !(buf = malloc(size + 1))) {
+        fclose(dict);
+        return NULL;
+    }
+    size = fread(buf, 1, size, dict);
+    buf[size] = 0;
+    *end = buf + size;
+    fclose(dict);
+
+    *nwords = 0;
+    for (w = buf; *w;) {
+        char *delim = w + strcspn(w, ",\n");
+        int comma = *delim == ',';
+        if (delim > w)
+            (*nwords)++;
+        if (!*delim)
+            break;
+        *delim = 0;
+        w = delim + 1 + (comma && delim[1] == ' ');
+    }
+    return buf;
+}
+
+/** step to the next word of a buffer split by bench_load_words(). */
+static char *bench_next_word(char *w, const char *end)
+{
+    w += strlen(w) + 1;
+    while (w < end && (*w == 0 || *w == ' '))
+        w++;
+    return w;
+}
+
+static int bench_cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static void bench_shuffle(char **a, size_t n)
+{
+    for (size_t i = n; i > 1; i--) {
+        size_t j = rand() % i;
+        char *tmp = a[i - 1];
+        a[i - 1] = a[j];
+        a[j] = tmp;
+    }
+}
+
+int bench_memory(const tst_tree *tree, const int cpy)
+{
+    size_t nwords, nodes, bytes;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    tst_idx *idx = tst_idx_create(cpy);
+    double t1, t2;
+
+    if (!buf || !idx) {
+        free(buf);
+        tst_idx_free(idx);
+        return 1;
+    }
+
+    bytes = tst_memory_usage(tree, &nodes);
+    printf("ternary_tree, %zu nodes, %zu bytes\n", nodes, bytes);
+
+    t1 = tvgetf();
+    for (w = buf; w < end; w = bench_next_word(w, end)) {
+        if (!tst_idx_ins(idx, w)) {
+            fprintf(stderr, "error: memory exhausted, tst_idx_ins.\n");
+            break;
+        }
+    }
+    t2 = tvgetf();
+    bytes = tst_idx_memory_usage(idx, &nodes);
+    printf("compact_tree, loaded %zu words in %.6f sec\n", nwords, t2 - t1);
+    printf("compact_tree, %zu nodes, %zu bytes\n", nodes, bytes);
+
+    tst_idx_free(idx);
+    free(buf);
+    return 0;
+}
+
+int bench_map(const tst_node *root, const char *map_file, const int max)
+{
+    char prefix[PREFIX_LEN + 1] = "";
+    char word[WORDMAX] = "";
+    char **sgl, **mgl;
+    FILE *dict;
+    int sidx = 0, midx = 0, diffs = 0;
+    size_t nwords, bytes, nodes, wide;
+    char *buf, *end, **words = NULL;
+    double t1, t2;
+    tst_map *m;
+
+    t1 = tvgetf();
+    m = tst_freeze(root);
+    t2 = tvgetf();
+    if (!m || tst_save(m, map_file)) {
+        fprintf(stderr, "error: failed to freeze tree to '%s'.\n", map_file);
+        tst_map_close(m);
+        return 1;
+    }
+    tst_map_size(m, &nwords, &bytes);
+    printf("frozen_tree, froze %zu words (%zu bytes) in %.6f sec\n", nwords,
+           bytes, t2 - t1);
+    tst_map_close(m);
+
+    t1 = tvgetf();
+    m = tst_open_mmap(map_file);
+    t2 = tvgetf();
+    if (!m) {
+        fprintf(stderr, "error: failed to map '%s'.\n", map_file);
+        return 1;
+    }
+    tst_map_nodes(m, &nodes, &wide);
+    printf("frozen_tree, mapped %s in %.6f sec, %zu nodes and %zu wide "
+           "nodes\n",
+           map_file, t2 - t1, nodes, wide);
+
+    /* exact lookups, where the wide nodes near the root matter most */
+    if ((buf = bench_load_words(&nwords, &end)) &&
+        (words = malloc(nwords * sizeof *words))) {
+        size_t n = 0;
+        for (char *w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+            words[n++] = w;
+        srand(1);
+        bench_shuffle(words, n);
+        t1 = tvgetf();
+        for (size_t i = 0; i < n; i++)
+            diffs += !tst_search(root, words[i]);
+        t2 = tvgetf();
+        printf("ternary_tree, searched %zu words in %.6f sec\n", n, t2 - t1);
+        t1 = tvgetf();
+        for (size_t i = 0; i < n; i++)
+            diffs += !tst_map_search(m, words[i]);
+        t2 = tvgetf();
+        printf("frozen_tree, searched %zu words in %.6f sec\n", n, t2 - t1);
+    }
+    free(words);
+    free(buf);
+
+    if (!(dict = fopen(DICT_FILE, "r"))) {
+        fprintf(stderr, "error: file open failed in '%s'.\n", DICT_FILE);
+        tst_map_close(m);
+        return 1;
+    }
+    sgl = malloc(sizeof(char *) * max);
+    mgl = malloc(sizeof(char *) * max);
+    double ttree = 0, tmap = 0;
+    while (sgl && mgl && fscanf(dict, "%s", word) != EOF) {
+        if (strlen(word) < sizeof(prefix) - 1)
+            continue;
+        strncpy(prefix, word, sizeof(prefix) - 1);
+        t1 = tvgetf();
+        tst_search_prefix(root, prefix, sgl, &sidx, max);
+        t2 = tvgetf();
+        ttree += t2 - t1;
+        t1 = tvgetf();
+        tst_map_search_prefix(m, prefix, mgl, &midx, max);
+        t2 = tvgetf();
+        tmap += t2 - t1;
+        diffs += sidx != midx;
+        for (int i = 0; i < sidx && i < midx; i++)
+            diffs += strcmp(sgl[i], mgl[i]) != 0;
+    }
+    printf("ternary_tree, searched prefixes in %.6f sec\n", ttree);
+    printf("frozen_tree, searched prefixes in %.6f sec (%d mismatches)\n",
+           tmap, diffs);
+
+    free(sgl);
+    free(mgl);
+    fclose(dict);
+    tst_map_close(m);
+    return diffs != 0;
+}
+
+/** time exact and prefix lookups of 'words' in 't', returning the seconds
+ *  spent on exact search in 'texact' and on prefix search in 'tprefix'.
+ */
+static void bench_lookups(const tst_tree *t,
+                          char *const *words,
+                          size_t n,
+                          char **sgl,
+                          const int max,
+                          double *texact,
+                          double *tprefix)
+{
+    char prefix[PREFIX_LEN + 1] = "";
+    int sidx = 0;
+    double t1;
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i++)
+        tst_search(tst_tree_root(t), words[i]);
+    *texact = tvgetf() - t1;
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i += 16) {
+        strncpy(prefix, words[i], sizeof(prefix) - 1);
+        tst_search_prefix(tst_tree_root(t), prefix, sgl, &sidx, max);
+    }
+    *tprefix = tvgetf() - t1;
+}
+
+int bench_build(const int cpy, const int max)
+{
+    size_t nwords, n = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char **sgl = malloc(max * sizeof *sgl);
+    tst_tree *ins = tst_tree_create(cpy), *built = tst_tree_create(cpy);
+    double t1, tins, tbuild, texact, tprefix;
+    int stat = 1;
+
+    if (!buf || !words || !sgl || !ins || !built)
+        goto out;
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+        words[n++] = w;
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i++)
+        if (!tst_tree_ins(ins, words[i]))
+            goto out;
+    tins = tvgetf() - t1;
+
+    t1 = tvgetf();
+    if (tst_build(built, (const char *const *) words, n))
+        goto out;
+    tbuild = tvgetf() - t1;
+
+    printf("ternary_tree, inserted %zu words in %.6f sec\n", n, tins);
+    bench_lookups(ins, words, n, sgl, max, &texact, &tprefix);
+    printf("ternary_tree, searched words in %.6f sec, prefixes in %.6f sec\n",
+           texact, tprefix);
+    printf("balanced_tree, built %zu words in %.6f sec\n", n, tbuild);
+    bench_lookups(built, words, n, sgl, max, &texact, &tprefix);
+    printf("balanced_tree, searched words in %.6f sec, prefixes in %.6f sec\n",
+           texact, tprefix);
+    stat = 0;
+
+out:
+    tst_tree_free(ins);
+    tst_tree_free(built);
+    free(sgl);
+    free(words);
+    free(buf);
+    return stat;
+}
+
+/** churn rounds of bench_rebalance(), and the parts its incremental
+ *  rebalance repairs.
+ */
+#define CHURN_ROUNDS 4
+#define CHURN_PARTS 8
+
+/** print the shape of 't' at 'stage' with the time of its lookups. */
+static void bench_shape(const char *stage,
+                        const tst_tree *t,
+                        char **words,
+                        size_t n,
+                        char **sgl,
+                        const int max)
+{
+    double texact, tprefix;
+    tst_stats st;
+
+    tst_tree_stats(t, &st);
+    bench_lookups(t, words, n, sgl, max, &texact, &tprefix);
+    printf("%-14s %zu words, %zu nodes (%zu dead), depth max %zu avg %.2f, "
+           "%zu bytes\n",
+           stage, st.words, st.nodes, st.dead, st.maxdepth, st.avgdepth,
+           st.bytes);
+    printf("%-14s searched words in %.6f sec, prefixes in %.6f sec\n", "",
+           texact, tprefix);
+}
+
+int bench_rebalance(const int cpy, const int max)
+{
+    size_t nwords, n = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char **churn = malloc(nwords * sizeof *churn), **left;
+    char **sgl = malloc(max * sizeof *sgl);
+    tst_tree *t = tst_tree_create(cpy);
+    double t1;
+    int stat = 1;
+
+    if (!buf || !words || !churn || !sgl || !t)
+        goto out;
+    /* distinct words only, so each delete removes its word */
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+        if (!tst_tree_search(t, w) && tst_tree_ins(t, w))
+            words[n++] = w;
+    memcpy(churn, words, n * sizeof *churn);
+    bench_shape("loaded", t, words, n, sgl, max);
+
+    /* delete half the words in random order and add them back sorted, so
+     * each round grows lo/hi chains to the right, then delete half for
+     * good, leaving the prefix nodes deletes could not rotate out
+     */
+    srand(1);
+    for (int r = 0; r <= CHURN_ROUNDS; r++) {
+        bench_shuffle(churn, n);
+        for (size_t i = 0; i < n / 2; i++)
+            tst_tree_del(t, churn[i]);
+        if (r == CHURN_ROUNDS)
+            break;
+        qsort(churn, n / 2, sizeof *churn, bench_cmp_str);
+        for (size_t i = 0; i < n / 2; i++)
+            if (!tst_tree_ins(t, churn[i]))
+                goto out;
+    }
+    left = churn + n / 2;
+    n -= n / 2;
+    bench_shape("churned", t, left, n, sgl, max);
+
+    t1 = tvgetf();
+    tst_rebalance(t, CHURN_PARTS);
+    printf("rebalanced the %d most churned parts in %.6f sec\n", CHURN_PARTS,
+           tvgetf() - t1);
+    bench_shape("partly", t, left, n, sgl, max);
+
+    t1 = tvgetf();
+    tst_rebalance(t, 0);
+    printf("rebalanced in %.6f sec\n", tvgetf() - t1);
+    bench_shape("rebalanced", t, left, n, sgl, max);
+
+    t1 = tvgetf();
+    tst_compact(t);
+    printf("compacted in %.6f sec\n", tvgetf() - t1);
+    bench_shape("compacted", t, left, n, sgl, max);
+    stat = 0;
+
+out:
+    tst_tree_free(t);
+    free(sgl);
+    free(churn);
+    free(words);
+    free(buf);
+    return stat;
+}
+
+int bench_pages(const tst_node *root, const char *prefix, const int page)
+{
+    char **sgl = NULL;
+    int sidx = 0, pages = 0, words = 0, max = page;
+    tst_prefix_iter *it;
+    double t1, titer, tsearch;
+
+    /* cursor, one page at a time until exhausted */
+    t1 = tvgetf();
+    if (!(it = tst_prefix_iter_begin(root, prefix)))
+        return 1;
+    for (int n = page; n == page; pages++) {
+        for (n = 0; n < page && tst_prefix_iter_next(it); n++)
+            ;
+        words += n;
+    }
+    tst_prefix_iter_end(it);
+    titer = tvgetf() - t1;
+
+    /* tst_search_prefix(), page k re-runs the search for (k + 1) pages */
+    t1 = tvgetf();
+    for (int k = 0; k < pages; k++, max += page) {
+        char **a = realloc(sgl, max * sizeof *sgl);
+        if (!a)
+            break;
+        sgl = a;
+        tst_search_prefix(root, prefix, sgl, &sidx, max);
+    }
+    tsearch = tvgetf() - t1;
+    free(sgl);
+
+    printf("%s - %d words in %d pages of %d\n", prefix, words, pages, page);
+    printf("  cursor paged in %.6f sec\n", titer);
+    printf("  tst_search_prefix paged in %.6f sec\n", tsearch);
+    return 0;
+}
+
+int bench_topk(const tst_node *root, const int k, const int max)
+{
+    char prefix[PREFIX_LEN] = "";
+    char word[WORDMAX] = "";
+    char **sgl = malloc(sizeof(char *) * max);
+    FILE *dict = fopen(DICT_FILE, "r");
+    int sidx = 0, queries = 0, nword = 0;
+    double t1, ttopk = 0, tprefix = 0;
+
+    if (!sgl || !dict) {
+        fprintf(stderr, "error: file open failed in '%s'.\n", DICT_FILE);
+        free(sgl);
+        if (dict)
+            fclose(dict);
+        return 1;
+    }
+
+    /* short prefixes of every 16th word, where the subtree is largest */
+    while (fscanf(dict, "%s", word) != EOF) {
+        if (strlen(word) < sizeof(prefix) - 1 || nword++ % 16)
+            continue;
+        strncpy(prefix, word, sizeof(prefix) - 1);
+        t1 = tvgetf();
+        tst_search_prefix_topk(root, prefix, sgl, &sidx, k);
+        ttopk += tvgetf() - t1;
+        t1 = tvgetf();
+        tst_search_prefix(root, prefix, sgl, &sidx, max);
+        tprefix += tvgetf() - t1;
+        queries++;
+    }
+    printf("%d prefixes of %zu chars\n", queries, sizeof(prefix) - 1);
+    printf("  top %d searched in %.6f sec\n", k, ttopk);
+    printf("  tst_search_prefix (max %d) searched in %.6f sec\n", max, tprefix);
+
+    free(sgl);
+    fclose(dict);
+    return 0;
+}
+
+int bench_fuzzy(const tst_node *root, const int max)
+{
+    size_t nwords, nword = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **sgl = malloc(sizeof(char *) * max);
+    int sidx = 0, queries = 0, hits[3] = {0};
+    double t1, t[3] = {0};
+
+    if (!buf || !sgl) {
+        free(buf);
+        free(sgl);
+        return 1;
+    }
+
+    /* every 64th word with its second char mistyped */
+    for (w = buf; w < end; w = bench_next_word(w, end)) {
+        char typo[WORDMAX], prefix[5] = "";
+        size_t len = strlen(w);
+        if (len < sizeof(prefix) || len >= WORDMAX / 2 || nword++ % 64)
+            continue;
+        strcpy(typo, w);
+        typo[1] = typo[1] == 'x' ? 'y' : 'x';
+        strncpy(prefix, typo, sizeof(prefix) - 1);
+
+        for (int d = 1; d <= 2; d++) {
+            t1 = tvgetf();
+            tst_search_fuzzy(root, typo, d, sgl, &sidx, max);
+            t[d - 1] += tvgetf() - t1;
+            for (int i = 0; i < sidx; i++)
+                hits[d - 1] += !strcmp(sgl[i], w);
+        }
+        t1 = tvgetf();
+        tst_search_prefix_fuzzy(root, prefix, 1, sgl, &sidx, max);
+        t[2] += tvgetf() - t1;
+        hits[2] += sidx > 0;
+        queries++;
+    }
+    printf("%d mistyped words\n", queries);
+    for (int d = 1; d <= 2; d++)
+        printf("  fuzzy search within %d edits in %.6f sec, %d found\n", d,
+               t[d - 1], hits[d - 1]);
+    printf("  fuzzy prefix search within 1 edit in %.6f sec, %d found\n", t[2],
+           hits[2]);
+
+    free(sgl);
+    free(buf);
+    return 0;
+}
+
+/** state shared by the reader and writer threads of bench_concurrent(). */
+typedef struct bench_conc {
+    tst_tree *t;
+    char **words;  /* loaded words, looked up by the readers */
+    char **churn;  /* words absent from the tree, added and removed */
+    size_t nwords;
+    size_t nchurn;
+    size_t lookups; /* per reader */
+    int stop;       /* set once the readers are done */
+    size_t updates; /* insert/delete pairs applied by the writer */
+} bench_conc;
+
+typedef struct bench_reader {
+    bench_conc *c;
+    size_t start;
+    size_t hits;
+} bench_reader;
+
+static void *bench_conc_read(void *arg)
+{
+    bench_reader *br = arg;
+    bench_conc *c = br->c;
+    tst_reader *r = tst_tree_reader(c->t);
+
+    if (!r)
+        return NULL;
+    for (size_t i = 0, k = br->start; i < c->lookups; i++) {
+        tst_read_lock(r);
+        br->hits += tst_tree_search(c->t, c->words[k]) != NULL;
+        tst_read_unlock(r);
+        if ((k += 7919) >= c->nwords) /* prime stride over the words */
+            k -= c->nwords;
+    }
+    tst_reader_leave(r);
+    return NULL;
+}
+
+static void *bench_conc_write(void *arg)
+{
+    bench_conc *c = arg;
+
+    for (size_t i = 0; !__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE); i++) {
+        const char *w = c->churn[i % c->nchurn];
+        if (!tst_tree_ins(c->t, w))
+            break;
+        tst_tree_del(c->t, w);
+        c->updates++;
+    }
+    return NULL;
+}
+
+/** run 'nreaders' lookup threads, with the writer churning the tree if
+ *  'writer' is non-zero. returns the seconds taken, -1 on failure.
+ */
+static double bench_conc_run(bench_conc *c, int nreaders, int writer)
+{
+    pthread_t tid[nreaders], wid;
+    bench_reader br[nreaders];
+    double t1, t2;
+    int n = 0, stat = 0;
+
+    c->stop = 0;
+    c->updates = 0;
+    if (writer && pthread_create(&wid, NULL, bench_conc_write, c))
+        return -1;
+    t1 = tvgetf();
+    for (; n < nreaders; n++) {
+        br[n] = (bench_reader){.c = c, .start = n * c->nwords / nreaders};
+        if (pthread_create(&tid[n], NULL, bench_conc_read, &br[n]))
+            break;
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_join(tid[i], NULL);
+        stat |= br[i].hits != c->lookups; /* every word stays findable */
+    }
+    t2 = tvgetf();
+    __atomic_store_n(&c->stop, 1, __ATOMIC_RELEASE);
+    if (writer)
+        pthread_join(wid, NULL);
+    return n < nreaders || stat ? -1 : t2 - t1;
+}
+
+int bench_concurrent(const int cpy, const int maxthreads)
+{
+    size_t nwords, n = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char *cbuf = NULL;
+    bench_conc c = {.t = tst_tree_create_concurrent(cpy), .lookups = 1 << 18};
+    int stat = 1;
+
+    if (!buf || !words || !c.t)
+        goto out;
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+        words[n++] = w;
+    if (tst_build(c.t, (const char *const *) words, n))
+        goto out;
+
+    /* churn words: every 16th word with a '~' appended, not in the tree */
+    c.words = words;
+    c.nwords = n;
+    c.nchurn = (n + 15) / 16;
+    if (!(c.churn = malloc(c.nchurn * sizeof *c.churn)) ||
+        !(cbuf = malloc(c.nchurn * (WORDMAX + 1))))
+        goto out;
+    for (size_t i = 0; i < c.nchurn; i++) {
+        c.churn[i] = cbuf + i * (WORDMAX + 1);
+        snprintf(c.churn[i], WORDMAX + 1, "%s~", words[i * 16]);
+    }
+
+    printf("concurrent_tree, %zu lookups per reader\n", c.lookups);
+    for (int nr = 1; nr <= maxthreads; nr *= 2) {
+        double tro = bench_conc_run(&c, nr, 0);
+        double trw = bench_conc_run(&c, nr, 1);
+        if (tro < 0 || trw < 0) {
+            fprintf(stderr, "error: concurrent lookups failed.\n");
+            goto out;
+        }
+        printf("concurrent_tree, %d readers: %.3f Mlookups/sec, "
+               "%.3f Mlookups/sec with writer (%zu updates)\n",
+               nr, nr * c.lookups / tro / 1e6, nr * c.lookups / trw / 1e6,
+               c.updates);
+    }
+    stat = 0;
+
+out:
+    tst_tree_free(c.t);
+    free(c.churn);
+    free(cbuf);
+    free(words);
+    free(buf);
+    return stat;
+}
+
+/** chunk of the dictionary text split into words by one loader thread. */
+typedef struct bench_chunk {
+    char *start, *end; /* text, whole lines */
+    char **words;
+    size_t n;
+} bench_chunk;
+
+/** split the lines of a chunk in place as bench_load_words() does. */
+static void *bench_split(void *arg)
+{
+    bench_chunk *c = arg;
+    char *w = c->start;
+
+    c->n = 0;
+    while (w < c->end) {
+        char *delim = w;
+        while (delim < c->end && *delim != ',' && *delim != '\n')
+            delim++;
+        if (delim > w)
+            c->words[c->n++] = w;
+        if (delim == c->end)
+            break;
+        int comma = *delim == ',';
+        *delim = 0;
+        w = delim + 1 + (comma && delim + 1 < c->end && delim[1] == ' ');
+    }
+    return NULL;
+}
+
+/** read DICT_FILE 'scale' times into one buffer, every word of copy k > 0
+ *  suffixed with "~k" so all copies are distinct words. returns the text,
+ *  its size in 'size'.
+ */
+static char *bench_scaled_text(int scale, size_t *size)
+{
+    FILE *dict = fopen(DICT_FILE, "r");
+    char line[WORDMAX], *buf = NULL;
+    size_t cap = 0;
+
+    *size = 0;
+    if (!dict) {
+        fprintf(stderr, "error: file open failed in '%s'.\n", DICT_FILE);
+        return NULL;
+    }
+    for (int k = 0; k < scale; k++) {
+        rewind(dict);
+        while (fgets(line, sizeof line, dict)) {
+            char sfx[16] = "";
+            if (k)
+                snprintf(sfx, sizeof sfx, "~%d", k);
+            if (*size + 3 * strlen(line) + 2 * sizeof sfx > cap) {
+                char *nbuf = realloc(buf, cap = cap ? cap * 2 : 1 << 20);
+                if (!nbuf) {
+                    free(buf);
+                    fclose(dict);
+                    return NULL;
+                }
+                buf = nbuf;
+            }
+            for (char *c = line; *c; c++) {
+                if (*c == ',' || *c == '\n')
+                    *size += sprintf(buf + *size, "%s", sfx);
+                buf[(*size)++] = *c;
+            }
+        }
+    }
+    fclose(dict);
+    return buf;
+}
+
+/** split 'text' into 'words' on 'nthreads' threads, each taking a chunk cut
+ *  at a line end. returns the number of words, 0 on failure.
+ */
+static size_t bench_split_parallel(char *text,
+                                   size_t size,
+                                   char **words,
+                                   int nthreads)
+{
+    bench_chunk c[nthreads];
+    pthread_t tid[nthreads];
+    char *start = text, *end = text + size;
+    size_t n = 0;
+    int started = 0, ok = 1;
+
+    for (int i = 0; i < nthreads; i++) {
+        char *cut = i == nthreads - 1 ? end : text + size / nthreads * (i + 1);
+        if (cut < start)
+            cut = start;
+        while (cut < end && cut[-1] != '\n')
+            cut++;
+        /* a chunk holds at most one word per two bytes */
+        c[i] = (bench_chunk){.start = start, .end = cut,
+                             .words = malloc(((cut - start) / 2 + 1) *
+                                             sizeof(char *))};
+        ok &= c[i].words != NULL;
+        start = cut;
+    }
+    for (; ok && started < nthreads; started++)
+        if (pthread_create(&tid[started], NULL, bench_split, &c[started]))
+            ok = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (i < started)
+            pthread_join(tid[i], NULL);
+        if (ok) {
+            memcpy(words + n, c[i].words, c[i].n * sizeof *words);
+            n += c[i].n;
+        }
+        free(c[i].words);
+    }
+    return ok ? n : 0;
+}
+
+int bench_parallel(const int cpy, const int maxthreads, const int scale)
+{
+    size_t size, n = 0;
+    char *text = bench_scaled_text(scale, &size), *copy = NULL;
+    char **words = malloc((size / 2 + 1) * sizeof *words);
+    double t1, t2;
+    int stat = 1;
+
+    if (!text || !words || !(copy = malloc(size)))
+        goto out;
+
+    /* one thread splitting and inserting word by word, as test_common */
+    memcpy(copy, text, size);
+    t1 = tvgetf();
+    bench_chunk all = {.start = copy, .end = copy + size, .words = words};
+    bench_split(&all);
+    tst_tree *t = tst_tree_create(cpy);
+    for (size_t i = 0; t && i < all.n; i++)
+        if (!tst_tree_ins(t, words[i])) {
+            tst_tree_free(t);
+            t = NULL;
+        }
+    t2 = tvgetf();
+    tst_tree_free(t);
+    if (!t)
+        goto out;
+    printf("ternary_tree, inserted %zu words in %.6f sec\n", all.n, t2 - t1);
+
+    memcpy(copy, text, size);
+    t1 = tvgetf();
+    bench_split(&all);
+    t = tst_tree_create(cpy);
+    if (!t || tst_build(t, (const char *const *) words, all.n)) {
+        tst_tree_free(t);
+        goto out;
+    }
+    t2 = tvgetf();
+    tst_tree_free(t);
+    printf("balanced_tree, built %zu words in %.6f sec\n", all.n, t2 - t1);
+
+    for (int nt = 1; nt <= maxthreads; nt *= 2) {
+        memcpy(copy, text, size);
+        t1 = tvgetf();
+        n = bench_split_parallel(copy, size, words, nt);
+        t = tst_tree_create(cpy);
+        if (!n || !t ||
+            tst_build_parallel(t, (const char *const *) words, n, nt)) {
+            tst_tree_free(t);
+            goto out;
+        }
+        t2 = tvgetf();
+        tst_tree_free(t);
+        printf("parallel_tree, %d threads built %zu words in %.6f sec\n", nt,
+               n, t2 - t1);
+    }
+    stat = 0;
+
+out:
+    free(words);
+    free(copy);
+    free(text);
+    return stat;
+}
+
+/** filter under test by bench_bloom(), 'del' NULL if it can not remove. */
+typedef struct bench_filter {
+    const char *name;
+    void *f;
+    void (*add)(void *, const char *);
+    bool (*test)(void *, const char *);
+    bool (*del)(void *, const char *);
+    size_t bytes;
+} bench_filter;
+
+static void bench_bloom_add(void *f, const char *s)
+{
+    bloom_add(f, s);
+}
+
+static bool bench_bloom_test(void *f, const char *s)
+{
+    return bloom_test(f, s);
+}
+
+static void bench_block_add(void *f, const char *s)
+{
+    bloom_block_add(f, s);
+}
+
+static bool bench_block_test(void *f, const char *s)
+{
+    return bloom_block_test(f, s);
+}
+
+static void bench_count_add(void *f, const char *s)
+{
+    bloom_count_add(f, s);
+}
+
+static bool bench_count_test(void *f, const char *s)
+{
+    return bloom_count_test(f, s);
+}
+
+static bool bench_count_del(void *f, const char *s)
+{
+    return bloom_count_remove(f, s);
+}
+
+/** time adding 'n' distinct words to 'bf' and testing them back, then
+ *  testing 'n' absent words. a filter that can remove then drops every
+ *  other word and is tested on those deleted words. prints the timings
+ *  and the false positive rates.
+ */
+static void bench_bloom_run(const bench_filter *bf,
+                            char *const *words,
+                            char *const *absent,
+                            size_t n)
+{
+    size_t hits = 0, fp = 0;
+    double t1, tadd, thit, tmiss;
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i++)
+        bf->add(bf->f, words[i]);
+    tadd = tvgetf() - t1;
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i++)
+        hits += bf->test(bf->f, words[i]);
+    thit = tvgetf() - t1;
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i++)
+        fp += bf->test(bf->f, absent[i]);
+    tmiss = tvgetf() - t1;
+
+    printf("%s, %zu bytes: add %.3f Mops/sec, test hit %.3f Mops/sec, "
+           "test miss %.3f Mops/sec\n",
+           bf->name, bf->bytes, n / tadd / 1e6, n / thit / 1e6,
+           n / tmiss / 1e6);
+    printf("%s, %zu/%zu words found, false positive rate %.5f\n", bf->name,
+           hits, n, (double) fp / n);
+    if (!bf->del)
+        return;
+
+    size_t ndel = 0, stale = 0;
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i += 2)
+        ndel += bf->del(bf->f, words[i]);
+    t1 = tvgetf() - t1;
+    for (size_t i = 0; i < n; i += 2)
+        stale += bf->test(bf->f, words[i]);
+    printf("%s, removed %zu words at %.3f Mops/sec, %.5f of them still "
+           "reported\n",
+           bf->name, ndel, ndel / t1 / 1e6, (double) stale / ndel);
+}
+
+int bench_bloom(const double fpr)
+{
+    size_t nwords, n = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char **absent = malloc(nwords * sizeof *absent);
+    char *abuf = NULL;
+    tst_tree *seen = tst_tree_create(0);
+    bloom_t b = NULL;
+    bloom_block_t bb = NULL;
+    bloom_count_t bc = NULL;
+    int stat = 1;
+
+    if (!buf || !words || !absent || !seen)
+        goto out;
+    /* distinct words only, as a filter kept in sync with the tree holds */
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end)) {
+        if (tst_search(tst_tree_root(seen), w))
+            continue;
+        if (!tst_tree_ins(seen, w))
+            goto out;
+        words[n++] = w;
+    }
+
+    /* absent words, each word with a '~' appended */
+    if (!(abuf = malloc(n * (WORDMAX + 1))))
+        goto out;
+    for (size_t i = 0; i < n; i++) {
+        absent[i] = abuf + i * (WORDMAX + 1);
+        snprintf(absent[i], WORDMAX + 1, "%s~", words[i]);
+    }
+
+    /* the filter test_common used: 5000000 bits, djb2 and jenkins */
+    if (!(b = bloom_create(5000000)) || !(bb = bloom_block_create(n, fpr)) ||
+        !(bc = bloom_count_create(n, fpr)))
+        goto out;
+    bench_filter filters[] = {
+        {"bloom_filter", b, bench_bloom_add, bench_bloom_test, NULL,
+         5000000 / 8},
+        {"blocked_bloom", bb, bench_block_add, bench_block_test, NULL,
+         bloom_block_size(bb)},
+        {"counting_bloom", bc, bench_count_add, bench_count_test,
+         bench_count_del, bloom_count_size(bc)},
+    };
+    for (size_t i = 0; i < sizeof filters / sizeof *filters; i++)
+        bench_bloom_run(&filters[i], words, absent, n);
+    stat = 0;
+
+out:
+    bloom_free(b);
+    bloom_block_free(bb);
+    bloom_count_free(bc);
+    tst_tree_free(seen);
+    free(abuf);
+    free(absent);
+    free(words);
+    free(buf);
+    return stat;
+}
+
+/** keys per batch call in bench_batch(), as a request handler would. */
+#define BATCH_KEYS 64
+
+int bench_batch(const tst_node *root, const int max)
+{
+    size_t nwords, n = 0, np = 0, diffs = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char *pbuf = malloc(nwords * (PREFIX_LEN + 1));
+    char **prefixes = malloc(nwords * sizeof *prefixes);
+    void **res = malloc(nwords * sizeof *res);
+    void *bres[BATCH_KEYS];
+    char **sgl = malloc(max * sizeof *sgl);
+    char **bgl = malloc((size_t) BATCH_KEYS * max * sizeof *bgl);
+    int sidx, bidx[BATCH_KEYS];
+    double t1, tone, tbatch;
+
+    if (!buf || !words || !pbuf || !prefixes || !res || !sgl || !bgl) {
+        free(buf);
+        free(words);
+        free(pbuf);
+        free(prefixes);
+        free(res);
+        free(sgl);
+        free(bgl);
+        return 1;
+    }
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+        words[n++] = w;
+    /* the tree was loaded in file order, shuffle so lookups do not follow
+     * the order nodes were carved from the pool
+     */
+    srand(1);
+    for (size_t i = n; i > 1; i--) {
+        size_t j = rand() % i;
+        char *tmp = words[i - 1];
+        words[i - 1] = words[j];
+        words[j] = tmp;
+    }
+
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i++)
+        res[i] = tst_search(root, words[i]);
+    tone = tvgetf() - t1;
+    t1 = tvgetf();
+    for (size_t i = 0; i < n; i += BATCH_KEYS) {
+        size_t k = n - i < BATCH_KEYS ? n - i : BATCH_KEYS;
+        tst_search_batch(root, (const char *const *) words + i, k, bres);
+        for (size_t j = 0; j < k; j++)
+            diffs += bres[j] != res[i + j];
+    }
+    tbatch = tvgetf() - t1;
+    printf("ternary_tree, searched %zu words in %.6f sec, batched in %.6f "
+           "sec\n",
+           n, tone, tbatch);
+
+    /* prefixes of every other word, autocomplete sized results */
+    for (size_t i = 0; i < n; i += 2) {
+        prefixes[np] = pbuf + np * (PREFIX_LEN + 1);
+        snprintf(prefixes[np++], PREFIX_LEN + 1, "%s", words[i]);
+    }
+    t1 = tvgetf();
+    for (size_t i = 0; i < np; i++) {
+        res[i] = tst_search_prefix(root, prefixes[i], sgl, &sidx, max);
+        diffs += sidx > 0 && !res[i];
+    }
+    tone = tvgetf() - t1;
+    t1 = tvgetf();
+    for (size_t i = 0; i < np; i += BATCH_KEYS) {
+        size_t k = np - i < BATCH_KEYS ? np - i : BATCH_KEYS;
+        tst_search_prefix_batch(root, (const char *const *) prefixes + i, k,
+                                bgl, bidx, max, bres);
+        for (size_t j = 0; j < k; j++)
+            diffs += bres[j] != res[i + j];
+    }
+    tbatch = tvgetf() - t1;
+    printf("ternary_tree, searched %zu prefixes in %.6f sec, batched in %.6f "
+           "sec (%zu mismatches)\n",
+           np, tone, tbatch, diffs);
+
+    free(buf);
+    free(words);
+    free(pbuf);
+    free(prefixes);
+    free(res);
+    free(sgl);
+    free(bgl);
+    return diffs != 0;
+}
+
+/** state shared by the operations of bench_suite(). */
+typedef struct bench_suite_ctx {
+    tst_tree *tree;
+    bloom_count_t bloom;
+    char **sgl;
+    int max;
+    size_t found; /* results consumed, keeps the lookups live */
+} bench_suite_ctx;
+
+typedef void (*bench_suite_op)(bench_suite_ctx *c, const char *key);
+
+static void bench_suite_ins(bench_suite_ctx *c, const char *key)
+{
+    if (tst_tree_ins(c->tree, key))
+        bloom_count_add(c->bloom, key);
+}
+
+static void bench_suite_del(bench_suite_ctx *c, const char *key)
+{
+    if (!tst_tree_del(c->tree, key))
+        bloom_count_remove(c->bloom, key);
+}
+
+static void bench_suite_search(bench_suite_ctx *c, const char *key)
+{
+    c->found += tst_tree_search(c->tree, key) != NULL;
+}
+
+static void bench_suite_gated(bench_suite_ctx *c, const char *key)
+{
+    c->found +=
+        bloom_count_test(c->bloom, key) && tst_tree_search(c->tree, key);
+}
+
+static void bench_suite_prefix(bench_suite_ctx *c, const char *key)
+{
+    int sidx = 0;
+
+    tst_tree_search_prefix(c->tree, key, c->sgl, &sidx, c->max);
+    c->found += sidx;
+}
+
+/** a workload runs 'op' on every key, 'pre' and 'post' run untimed on every
+ *  key before and after each pass to bring the tree to the state 'op'
+ *  expects and back.
+ */
+typedef struct bench_workload {
+    const char *name;
+    bench_suite_op op, pre, post;
+    char **keys;
+    size_t n;
+} bench_workload;
+
+/** latency summary of a workload, in nanoseconds per operation. */
+typedef struct bench_stats {
+    size_t ops;
+    double secs, mean, p50, p90, p99, p999;
+    size_t hist[64]; /* hist[i] counts samples in [2^i, 2^(i+1)) ns */
+    perfcnt_val pv;  /* counters over the timed passes */
+} bench_stats;
+
+static uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/** nearest rank percentile 'p' of 'n' sorted samples. */
+static double bench_percentile(const double *s, size_t n, double p)
+{
+    size_t rank = ceil(p * n);
+    return s[rank ? rank - 1 : 0];
+}
+
+/** bench_suite_run() time 'cfg->warmup' + 'cfg->repeat' passes of 'wl',
+ *  'cfg->batch' operations per clock read. A sample is the mean latency of
+ *  one batch and only the repeated passes are sampled and counted by 'pc'.
+ */
+static int bench_suite_run(bench_suite_ctx *c,
+                           perfcnt *pc,
+                           const bench_workload *wl,
+                           const bench_suite_cfg *cfg,
+                           bench_stats *st)
+{
+    size_t batches = (wl->n + cfg->batch - 1) / cfg->batch, ns = 0;
+    double *samples = malloc(batches * cfg->repeat * sizeof *samples);
+    uint64_t total = 0;
+
+    if (!samples)
+        return 1;
+    *st = (bench_stats){.ops = wl->n * cfg->repeat};
+    for (int pass = 0; pass < cfg->warmup + cfg->repeat; pass++) {
+        if (wl->pre)
+            for (size_t i = 0; i < wl->n; i++)
+                wl->pre(c, wl->keys[i]);
+        if (pass >= cfg->warmup)
+            perfcnt_start(pc);
+        for (size_t i = 0; i < wl->n; i += cfg->batch) {
+            size_t k = wl->n - i < (size_t) cfg->batch ? wl->n - i
+                                                        : (size_t) cfg->batch;
+            uint64_t t = bench_ns();
+            for (size_t j = i; j < i + k; j++)
+                wl->op(c, wl->keys[j]);
+            t = bench_ns() - t;
+            if (pass < cfg->warmup)
+                continue;
+            total += t;
+            samples[ns++] = (double) t / k;
+        }
+        if (pass >= cfg->warmup)
+            perfcnt_stop(pc, &st->pv);
+        if (wl->post)
+            for (size_t i = 0; i < wl->n; i++)
+                wl->post(c, wl->keys[i]);
+    }
+
+    qsort(samples, ns, sizeof *samples, bench_cmp_double);
+    for (size_t i = 0; i < ns; i++) {
+        int b = 0;
+        for (uint64_t v = samples[i]; v > 1; v >>= 1)
+            b++;
+        st->hist[b]++;
+    }
+    st->secs = total / 1e9;
+    st->mean = ns ? (double) total / st->ops : 0;
+    if (ns) {
+        st->p50 = bench_percentile(samples, ns, 0.50);
+        st->p90 = bench_percentile(samples, ns, 0.90);
+        st->p99 = bench_percentile(samples, ns, 0.99);
+        st->p999 = bench_percentile(samples, ns, 0.999);
+    }
+    free(samples);
+    return 0;
+}
+
+/** bench_suite_wanted() non-zero if 'name' is in the comma separated list
+ *  'names', every workload is wanted for NULL or "all".
+ */
+static int bench_suite_wanted(const char *names, const char *name)
+{
+    size_t len = strlen(name);
+
+    if (!names || !strcmp(names, "all"))
+        return 1;
+    for (const char *p = names; *p; p += strcspn(p, ",")) {
+        p += *p == ',';
+        if (!strncmp(p, name, len) && (p[len] == ',' || !p[len]))
+            return 1;
+    }
+    return 0;
+}
+
+static void bench_suite_csv(FILE *fp,
+                            const char *mode,
+                            const char *name,
+                            const bench_stats *st)
+{
+    fprintf(fp, "%s,%s,%zu,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f", mode, name,
+            st->ops, st->secs > 0 ? st->ops / st->secs : 0, st->mean,
+            st->p50, st->p90, st->p99, st->p999);
+    /* counters per op, an empty field for a counter not available */
+    for (int i = 0; i < PERFCNT_MAX; i++)
+        if (st->pv.valid & 1u << i)
+            fprintf(fp, ",%.2f", (double) st->pv.v[i] / st->ops);
+        else
+            fprintf(fp, ",");
+    fprintf(fp, "\n");
+}
+
+static void bench_suite_json(FILE *fp,
+                             const char *name,
+                             const bench_stats *st,
+                             int first)
+{
+    int sep = 0;
+
+    fprintf(fp,
+            "%s\n    {\"name\": \"%s\", \"ops\": %zu, \"ops_per_sec\": %.0f, "
+            "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, "
+            "\"p99_ns\": %.1f, \"p999_ns\": %.1f, \"histogram\": [",
+            first ? "" : ",", name, st->ops,
+            st->secs > 0 ? st->ops / st->secs : 0, st->mean, st->p50, st->p90,
+            st->p99, st->p999);
+    for (int b = 0; b < 64; b++) {
+        if (!st->hist[b])
+            continue;
+        fprintf(fp, "%s[%llu, %zu]", sep++ ? ", " : "", 1ULL << b,
+                st->hist[b]);
+    }
+    fprintf(fp, "], \"per_op\": {");
+    for (int i = 0; i < PERFCNT_MAX; i++)
+        if (st->pv.valid & 1u << i)
+            fprintf(fp, "%s\"%s\": %.2f", i ? ", " : "", perfcnt_name(i),
+                    (double) st->pv.v[i] / st->ops);
+        else
+            fprintf(fp, "%s\"%s\": null", i ? ", " : "", perfcnt_name(i));
+    fprintf(fp, "}}");
+}
+
+/** prefix lengths of the prefix workloads. */
+static const int bench_prefix_lens[] = {1, 2, 3, 4, 6, 8};
+#define NPREFIX (sizeof bench_prefix_lens / sizeof *bench_prefix_lens)
+
+int bench_suite(tst_tree *tree,
+                bloom_count_t bloom,
+                const bench_suite_cfg *cfg)
+{
+    size_t nwords, n = 0, na = 0, np[NPREFIX] = {0};
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char **absent = malloc(nwords * sizeof *absent);
+    char *abuf = buf ? malloc(end - buf + nwords + 1) : NULL;
+    char **prefixes = malloc(NPREFIX * nwords * sizeof *prefixes);
+    char *pbuf = malloc(NPREFIX * nwords * 9);
+    char **sgl = malloc(cfg->max * sizeof *sgl);
+    char csvname[WORDMAX], jsonname[WORDMAX], pname[NPREFIX][16];
+    bench_workload wl[5 + NPREFIX];
+    bench_suite_ctx c = {tree, bloom, sgl, cfg->max, 0};
+    FILE *csv = NULL, *json = NULL;
+    perfcnt *pc = perfcnt_open();
+    int nwl = 0, first = 1, stat = 1;
+
+    snprintf(csvname, sizeof csvname, "%s.csv", cfg->out);
+    snprintf(jsonname, sizeof jsonname, "%s.json", cfg->out);
+    if (!buf || !words || !absent || !abuf || !prefixes || !pbuf || !sgl ||
+        cfg->batch < 1 || cfg->repeat < 1)
+        goto out;
+    if (!(csv = fopen(csvname, "w")) || !(json = fopen(jsonname, "w"))) {
+        fprintf(stderr, "error: file open failed in '%s'.\n",
+                csv ? jsonname : csvname);
+        goto out;
+    }
+
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+        words[n++] = w;
+
+    /* absent words, each once so every insert adds a word and every delete
+     * removes it, found by adding them to the tree and taking them out.
+     * In file order each one fits in 'abuf' at its word's offset + index.
+     */
+    for (size_t i = 0; i < n; i++) {
+        char *a = abuf + (words[i] - buf) + i;
+        sprintf(a, "%s~", words[i]);
+        if (!tst_tree_search(tree, a) && tst_tree_ins(tree, a))
+            absent[na++] = a;
+    }
+    for (size_t i = 0; i < na; i++)
+        tst_tree_del(tree, absent[i]);
+
+    /* the tree was loaded in file order, shuffle so lookups do not follow
+     * the order nodes were carved from the pool
+     */
+    srand(1);
+    bench_shuffle(words, n);
+    bench_shuffle(absent, na);
+
+    for (size_t l = 0; l < NPREFIX; l++) {
+        snprintf(pname[l], sizeof pname[l], "prefix%d", bench_prefix_lens[l]);
+        for (size_t i = 0; i < n; i++) {
+            char *p = pbuf + (l * nwords + np[l]) * 9;
+            if (strlen(words[i]) < (size_t) bench_prefix_lens[l])
+                continue;
+            snprintf(p, bench_prefix_lens[l] + 1, "%s", words[i]);
+            prefixes[l * nwords + np[l]++] = p;
+        }
+    }
+
+    wl[nwl++] = (bench_workload){"insert", bench_suite_ins, NULL,
+                                 bench_suite_del, absent, na};
+    wl[nwl++] = (bench_workload){"delete", bench_suite_del, bench_suite_ins,
+                                 NULL, absent, na};
+    wl[nwl++] = (bench_workload){"hit", bench_suite_search, NULL, NULL, words,
+                                 n};
+    wl[nwl++] = (bench_workload){"miss", bench_suite_search, NULL, NULL,
+                                 absent, na};
+    wl[nwl++] = (bench_workload){"bloom_miss", bench_suite_gated, NULL, NULL,
+                                 absent, na};
+    for (size_t l = 0; l < NPREFIX; l++)
+        wl[nwl++] = (bench_workload){pname[l], bench_suite_prefix, NULL, NULL,
+                                     prefixes + l * nwords, np[l]};
+
+    fprintf(csv, "mode,workload,ops,ops_per_sec,mean_ns,p50_ns,p90_ns,"
+                 "p99_ns,p999_ns");
+    for (int i = 0; i < PERFCNT_MAX; i++)
+        fprintf(csv, ",%s", perfcnt_name(i));
+    fprintf(csv, "\n");
+    fprintf(json,
+            "{\n  \"mode\": \"%s\", \"batch\": %d, \"warmup\": %d, "
+            "\"repeat\": %d, \"max\": %d,\n  \"workloads\": [",
+            cfg->mode, cfg->batch, cfg->warmup, cfg->repeat, cfg->max);
+    printf("%-10s %10s %12s %9s %9s %9s %9s %9s\n", "workload", "ops",
+           "ops/sec", "mean ns", "p50", "p90", "p99", "p99.9");
+    for (int i = 0; i < nwl; i++) {
+        bench_stats st;
+        if (!bench_suite_wanted(cfg->workloads, wl[i].name))
+            continue;
+        if (bench_suite_run(&c, pc, &wl[i], cfg, &st))
+            goto out;
+        printf("%-10s %10zu %12.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+               wl[i].name, st.ops, st.secs > 0 ? st.ops / st.secs : 0,
+               st.mean, st.p50, st.p90, st.p99, st.p999);
+        perfcnt_print(stdout, wl[i].name, &st.pv, st.ops);
+        bench_suite_csv(csv, cfg->mode, wl[i].name, &st);
+        bench_suite_json(json, wl[i].name, &st, first);
+        first = 0;
+    }
+    fprintf(json, "\n  ]\n}\n");
+    printf("ternary_tree, suite results in '%s' and '%s'\n", csvname,
+           jsonname);
+    stat = 0;
+
+out:
+    perfcnt_close(pc);
+    if (csv)
+        fclose(csv);
+    if (json)
+        fclose(json);
+    free(buf);
+    free(words);
+    free(absent);
+    free(abuf);
+    free(prefixes);
+    free(pbuf);
+    free(sgl);
+    return stat;
+}
+
+/** time exact and prefix lookups of 'words' on the radix tree, see
+ *  bench_lookups(), counting them with 'pc' into 'pexact' and 'pprefix'.
+ */
+static void bench_rdx_lookups(const tst_rdx *x,
+                              char *const *words,
+                              size_t n,
+                              char **sgl,
+                              const int max,
+                              perfcnt *pc,
+                              perfcnt_val *pexact,
+                              perfcnt_val *pprefix)
+{
+    char prefix[PREFIX_LEN + 1] = "";
+    int sidx = 0;
+
+    perfcnt_start(pc);
+    for (size_t i = 0; i < n; i++)
+        tst_rdx_search(x, words[i]);
+    perfcnt_stop(pc, pexact);
+
+    perfcnt_start(pc);
+    for (size_t i = 0; i < n; i += 16) {
+        strncpy(prefix, words[i], sizeof(prefix) - 1);
+        tst_rdx_search_prefix(x, prefix, sgl, &sidx, max);
+    }
+    perfcnt_stop(pc, pprefix);
+}
+
+static void bench_tst_lookups(const tst_node *root,
+                              char *const *words,
+                              size_t n,
+                              char **sgl,
+                              const int max,
+                              perfcnt *pc,
+                              perfcnt_val *pexact,
+                              perfcnt_val *pprefix)
+{
+    char prefix[PREFIX_LEN + 1] = "";
+    int sidx = 0;
+
+    perfcnt_start(pc);
+    for (size_t i = 0; i < n; i++)
+        tst_search(root, words[i]);
+    perfcnt_stop(pc, pexact);
+
+    perfcnt_start(pc);
+    for (size_t i = 0; i < n; i += 16) {
+        strncpy(prefix, words[i], sizeof(prefix) - 1);
+        tst_search_prefix(root, prefix, sgl, &sidx, max);
+    }
+    perfcnt_stop(pc, pprefix);
+}
+
+int bench_radix(const int cpy, const int max)
+{
+    size_t nwords, n = 0, nodes, bytes, diffs = 0;
+    const tst_node *root;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char **sgl = malloc(max * sizeof *sgl), **rgl = malloc(max * sizeof *rgl);
+    tst_tree *tree = tst_tree_create(cpy);
+    tst_rdx *x = tst_rdx_create(cpy);
+    perfcnt *pc = perfcnt_open();
+    perfcnt_val pexact = {0}, pprefix = {0};
+    int sidx, ridx, stat = 1;
+    double t1, t2;
+
+    if (!buf || !words || !sgl || !rgl || !tree || !x)
+        goto out;
+    /* each word once, so that deleting one takes it out of the tree */
+    t1 = tvgetf();
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end)) {
+        if (tst_rdx_search(x, w))
+            continue;
+        if (!tst_rdx_ins(x, w))
+            goto out;
+        words[n++] = w;
+    }
+    t2 = tvgetf();
+    printf("radix_tree, loaded %zu distinct words in %.6f sec\n", n, t2 - t1);
+    for (size_t i = 0; i < n; i++)
+        if (!tst_tree_ins(tree, words[i]))
+            goto out;
+    root = tst_tree_root(tree);
+
+    bytes = tst_memory_usage(tree, &nodes);
+    printf("ternary_tree, %zu nodes, %zu bytes\n", nodes, bytes);
+    bytes = tst_rdx_memory_usage(x, &nodes);
+    printf("radix_tree, %zu nodes, %zu bytes\n", nodes, bytes);
+
+    srand(1);
+    bench_shuffle(words, n);
+
+    t1 = tvgetf();
+    bench_tst_lookups(root, words, n, sgl, max, pc, &pexact, &pprefix);
+    t2 = tvgetf();
+    printf("ternary_tree, searched words and prefixes in %.6f sec\n",
+           t2 - t1);
+    perfcnt_print(stdout, "ternary_tree search", &pexact, n);
+    perfcnt_print(stdout, "ternary_tree prefix", &pprefix, (n + 15) / 16);
+
+    pexact = pprefix = (perfcnt_val){0};
+    t1 = tvgetf();
+    bench_rdx_lookups(x, words, n, sgl, max, pc, &pexact, &pprefix);
+    t2 = tvgetf();
+    printf("radix_tree, searched words and prefixes in %.6f sec\n", t2 - t1);
+    perfcnt_print(stdout, "radix_tree search", &pexact, n);
+    perfcnt_print(stdout, "radix_tree prefix", &pprefix, (n + 15) / 16);
+
+    /* delete half the words, the labels they split are merged back */
+    for (size_t i = 0; i < n; i += 2)
+        tst_rdx_del(x, words[i]);
+    tst_rdx_memory_usage(x, &nodes);
+    for (size_t i = 0; i < n; i += 2)
+        diffs += tst_rdx_search(x, words[i]) != NULL;
+    for (size_t i = 0; i < n; i += 2)
+        if (!tst_rdx_ins(x, words[i]))
+            goto out;
+
+    /* with the words back both trees return the same words in order */
+    for (size_t i = 0; i < n; i += 2) {
+        char prefix[PREFIX_LEN + 1] = "";
+        strncpy(prefix, words[i], sizeof(prefix) - 1);
+        tst_search_prefix(root, prefix, sgl, &sidx, max);
+        tst_rdx_search_prefix(x, prefix, rgl, &ridx, max);
+        diffs += sidx != ridx;
+        for (int j = 0; j < sidx && j < ridx; j++)
+            diffs += strcmp(sgl[j], rgl[j]) != 0;
+        diffs += !tst_rdx_search(x, words[i]);
+    }
+    printf("radix_tree, %zu nodes after deleting every other word, "
+           "re-inserted (%zu mismatches)\n",
+           nodes, diffs);
+    stat = diffs != 0;
+
+out:
+    perfcnt_close(pc);
+    tst_tree_free(tree);
+    tst_rdx_free(x);
+    free(buf);
+    free(words);
+    free(sgl);
+    free(rgl);
+    return stat;
+}
+
+int bench_engines(const int cpy, const int max)
+{
+    size_t nwords, n = 0, na = 0, np = 0, mismatches = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = malloc(nwords * sizeof *words);
+    char **shuffled = malloc(nwords * sizeof *shuffled);
+    char **absent = malloc(nwords * sizeof *absent);
+    char *abuf = buf ? malloc(end - buf + nwords + 1) : NULL;
+    char **prefixes = malloc(nwords * sizeof *prefixes);
+    char *pbuf = malloc(nwords * (PREFIX_LEN + 1));
+    char **sgl = malloc(max * sizeof *sgl), **ref = NULL;
+    int *nref = malloc(nwords * sizeof *nref);
+    tst_tree *seen = tst_tree_create(0);
+    perfcnt *pc = perfcnt_open();
+    int stat = 1, nrefs = 0;
+
+    if (!buf || !words || !shuffled || !absent || !abuf || !prefixes ||
+        !pbuf || !sgl || !nref || !seen ||
+        !(ref = malloc(nwords * max * sizeof *ref)))
+        goto out;
+    /* distinct words in file order, each insert adds a word and each delete
+     * takes one out
+     */
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end)) {
+        if (tst_search(tst_tree_root(seen), w))
+            continue;
+        if (!tst_tree_ins(seen, w))
+            goto out;
+        words[n] = w;
+        absent[na++] = abuf + (w - buf) + n;
+        sprintf(absent[na - 1], "%s~", w);
+        n++;
+    }
+    tst_tree_free(seen);
+    seen = NULL;
+
+    /* load in file order, look up and delete in random order */
+    memcpy(shuffled, words, n * sizeof *words);
+    srand(1);
+    bench_shuffle(shuffled, n);
+    bench_shuffle(absent, na);
+    for (size_t i = 0; i < n; i += 2) {
+        prefixes[np] = pbuf + np * (PREFIX_LEN + 1);
+        snprintf(prefixes[np++], PREFIX_LEN + 1, "%s", shuffled[i]);
+    }
+
+    printf("%-6s %10s %10s %10s %10s %10s %10s %10s %10s\n", "engine",
+           "nodes", "bytes", "load s", "hit s", "miss s", "prefix s",
+           "delete s", "mismatch");
+    for (int e = 0; dict_engines[e]; e++) {
+        const dict_ops *ops = dict_engines[e];
+        dict *d = dict_create(ops, cpy);
+        perfcnt_val pv[3] = {0};
+        size_t nodes, bytes, diffs = 0;
+        double t1, tload, thit, tmiss, tprefix, tdel;
+        int sidx;
+
+        if (!d)
+            goto out;
+        t1 = tvgetf();
+        for (size_t i = 0; i < n; i++)
+            if (!dict_ins(d, words[i])) {
+                dict_free(d);
+                goto out;
+            }
+        tload = tvgetf() - t1;
+        bytes = dict_memory_usage(d, &nodes);
+
+        perfcnt_start(pc);
+        t1 = tvgetf();
+        for (size_t i = 0; i < n; i++)
+            diffs += !dict_search(d, shuffled[i]);
+        thit = tvgetf() - t1;
+        perfcnt_stop(pc, &pv[0]);
+
+        t1 = tvgetf();
+        for (size_t i = 0; i < na; i++)
+            diffs += dict_search(d, absent[i]) != NULL;
+        tmiss = tvgetf() - t1;
+
+        /* the first engine gives the results the others are checked on */
+        perfcnt_start(pc);
+        t1 = tvgetf();
+        for (size_t i = 0; i < np; i++) {
+            dict_search_prefix(d, prefixes[i], sgl, &sidx, max);
+            if (!e) {
+                nrefs = i + 1;
+                for (nref[i] = 0; nref[i] < sidx; nref[i]++)
+                    if (!(ref[i * max + nref[i]] = strdup(sgl[nref[i]]))) {
+                        dict_free(d);
+                        goto out;
+                    }
+                continue;
+            }
+            diffs += sidx != nref[i];
+            for (int j = 0; j < sidx && j < nref[i]; j++)
+                diffs += strcmp(sgl[j], ref[i * max + j]) != 0;
+        }
+        tprefix = tvgetf() - t1;
+        perfcnt_stop(pc, &pv[1]);
+
+        perfcnt_start(pc);
+        t1 = tvgetf();
+        for (size_t i = 0; i < n; i++)
+            diffs += dict_del(d, shuffled[i]) != NULL;
+        tdel = tvgetf() - t1;
+        perfcnt_stop(pc, &pv[2]);
+
+        printf("%-6s %10zu %10zu %10.6f %10.6f %10.6f %10.6f %10.6f %10zu\n",
+               ops->name, nodes, bytes, tload, thit, tmiss, tprefix, tdel,
+               diffs);
+        perfcnt_print(stdout, "hit", &pv[0], n);
+        perfcnt_print(stdout, "prefix", &pv[1], np);
+        perfcnt_print(stdout, "delete", &pv[2], n);
+        mismatches += diffs;
+        dict_free(d);
+    }
+    stat = mismatches != 0;
+
+out:
+    for (int i = 0; i < nrefs; i++)
+        for (int j = 0; j < nref[i]; j++)
+            free(ref[i * max + j]);
+    tst_tree_free(seen);
+    perfcnt_close(pc);
+    free(buf);
+    free(words);
+    free(shuffled);
+    free(absent);
+    free(abuf);
+    free(prefixes);
+    free(pbuf);
+    free(sgl);
+    free(ref);
+    free(nref);
+    return stat;
+}
+
+/** connection of bench_client(), keeping 'depth' requests in flight. */
+typedef struct bench_conn {
+    const char *addr;
+    char *const *words;
+    size_t nwords;
+    size_t nreq, depth;
+    unsigned seed;
+    double *lat; /* ns from the send of each request to its reply */
+    int err;
+} bench_conn;
+
+/** bench_conn_send() write the 'n' bytes of 'buf' to 'fd'. */
+static int bench_conn_send(int fd, const char *buf, size_t n)
+{
+    while (n) {
+        ssize_t w = write(fd, buf, n);
+        if (w <= 0)
+            return -1;
+        buf += w;
+        n -= w;
+    }
+    return 0;
+}
+
+/** bench_conn_run() send finds of present words (70%), finds of absent
+ *  words (10%) and 3 byte prefixes (20%), topping the pipeline up after
+ *  each read. a reply is one line, the n-th line answers the n-th request.
+ */
+static void *bench_conn_run(void *arg)
+{
+    bench_conn *bc = arg;
+    uint64_t *sent = malloc(bc->depth * sizeof *sent);
+    char *obuf = malloc(bc->depth * (WORDMAX + 4)), in[1 << 16];
+    size_t nsent = 0, done = 0, inlen = 0;
+    int fd = server_connect(bc->addr);
+
+    if (fd < 0 || !sent || !obuf) {
+        bc->err = 1;
+        goto out;
+    }
+    while (done < bc->nreq) {
+        size_t olen = 0;
+        ssize_t n;
+
+        while (nsent < bc->nreq && nsent - done < bc->depth) {
+            const char *w = bc->words[rand_r(&bc->seed) % bc->nwords];
+            int r = rand_r(&bc->seed) % 10;
+            const char *fmt = r < 7 ? "f %.*s\n" : "f %.*s~\n";
+            if (r < 8)
+                olen += sprintf(obuf + olen, fmt, WORDMAX - 2, w);
+            else
+                olen += sprintf(obuf + olen, "s %.*s\n", PREFIX_LEN, w);
+            sent[nsent++ % bc->depth] = bench_ns();
+        }
+        if (olen && bench_conn_send(fd, obuf, olen)) {
+            bc->err = 1;
+            break;
+        }
+
+        if ((n = read(fd, in + inlen, sizeof in - inlen)) <= 0) {
+            bc->err = 1;
+            break;
+        }
+        uint64_t now = bench_ns();
+        char *p = in, *nl, *stop = in + inlen + n;
+        while ((nl = memchr(p, '\n', stop - p))) {
+            bc->lat[done] = now - sent[done % bc->depth];
+            done++;
+            p = nl + 1;
+        }
+        inlen = stop - p;
+        if (inlen == sizeof in) { /* a reply longer than the buffer */
+            bc->err = 1;
+            break;
+        }
+        memmove(in, p, inlen);
+    }
+out:
+    if (fd >= 0)
+        close(fd);
+    free(obuf);
+    free(sent);
+    return NULL;
+}
+
+int bench_client(const char *addr, int conns, int depth, size_t total)
+{
+    size_t nwords, n = 0, nreq = total / conns;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **words = buf ? malloc(nwords * sizeof *words) : NULL;
+    double *lat = malloc(nreq * conns * sizeof *lat);
+    bench_conn bc[conns];
+    pthread_t tid[conns];
+    int started = 0, stat = 1;
+    double t1, t2;
+
+    if (!words || !lat || !nreq)
+        goto out;
+    for (w = buf; w < end && n < nwords; w = bench_next_word(w, end))
+        words[n++] = w;
+
+    t1 = tvgetf();
+    for (; started < conns; started++) {
+        bc[started] = (bench_conn){
+            .addr = addr, .words = words, .nwords = n, .nreq = nreq,
+            .depth = depth, .seed = started + 1, .lat = lat + started * nreq};
+        if (pthread_create(&tid[started], NULL, bench_conn_run, &bc[started]))
+            break;
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    t2 = tvgetf();
+
+    if (!started)
+        goto out;
+    for (int i = 0; i < started; i++)
+        if (bc[i].err) {
+            fprintf(stderr, "error: connection %d to '%s' failed.\n", i, addr);
+            goto out;
+        }
+    total = nreq * started;
+    qsort(lat, total, sizeof *lat, bench_cmp_double);
+    printf("client, %d conns x %d in flight: %zu requests in %.6f sec, "
+           "%.0f req/s\n",
+           started, depth, total, t2 - t1, total / (t2 - t1));
+    printf("client, latency usec: p50 %.1f p90 %.1f p99 %.1f p999 %.1f "
+           "max %.1f\n",
+           bench_percentile(lat, total, 0.50) / 1e3,
+           bench_percentile(lat, total, 0.90) / 1e3,
+           bench_percentile(lat, total, 0.99) / 1e3,
+           bench_percentile(lat, total, 0.999) / 1e3, lat[total - 1] / 1e3);
+    stat = 0;
+out:
+    free(lat);
+    free(words);
+    free(buf);
+    return stat;
+}
+
+/** searches of the skewed prefix workload of bench_cache(), its Zipf
+ *  exponent, searches per insert or delete and cache sizes compared.
+ */
+#define CACHE_QUERIES 1000000
+#define CACHE_ZIPF 0.99
+#define CACHE_UPDATE 100
+static const int bench_cache_sizes[] = {0, 64, 512, 4096};
+
+/** bench_zipf() returns the rank drawn from the cumulative weights 'cdf'
+ *  of 'n' ranks.
+ */
+static size_t bench_zipf(const double *cdf, size_t n)
+{
+    double u = (rand() + 0.5) / ((double) RAND_MAX + 1);
+    size_t lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int bench_cache(tst_tree *tree, const int max)
+{
+    const size_t nupd = CACHE_QUERIES / CACHE_UPDATE;
+    size_t nwords, n = 0, np = 0, diffs = 0;
+    char *end, *w, *buf = bench_load_words(&nwords, &end);
+    char **prefixes = malloc(nwords * sizeof *prefixes);
+    char *pbuf = malloc(nwords * (PREFIX_LEN + 1));
+    double *cdf = malloc(nwords * sizeof *cdf);
+    char **q = malloc(CACHE_QUERIES * sizeof *q);
+    char *ubuf = malloc(nupd * WORDMAX);
+    int *qn = malloc(CACHE_QUERIES * sizeof *qn);
+    char **sgl = malloc(max * sizeof *sgl);
+    int sidx, stat = 1;
+    double sum = 0, t1, t2;
+
+    if (!buf || !prefixes || !pbuf || !cdf || !q || !ubuf || !qn || !sgl)
+        goto out;
+
+    /* distinct prefixes of the dictionary, ranked in random order */
+    for (w = buf; w < end; w = bench_next_word(w, end)) {
+        if (strlen(w) < PREFIX_LEN)
+            continue;
+        prefixes[n] = pbuf + n * (PREFIX_LEN + 1);
+        snprintf(prefixes[n++], PREFIX_LEN + 1, "%s", w);
+    }
+    qsort(prefixes, n, sizeof *prefixes, bench_cmp_str);
+    for (size_t i = 0; i < n; i++)
+        if (!np || strcmp(prefixes[i], prefixes[np - 1]))
+            prefixes[np++] = prefixes[i];
+    srand(1);
+    bench_shuffle(prefixes, np);
+    for (size_t i = 0; i < np; i++) {
+        sum += 1 / pow(i + 1, CACHE_ZIPF);
+        cdf[i] = sum;
+    }
+    for (size_t i = 0; i < np; i++)
+        cdf[i] /= sum;
+
+    /* the searches, and absent words under hot prefixes added then
+     * deleted in turn, so the tree ends as it started
+     */
+    for (size_t i = 0; i < CACHE_QUERIES; i++)
+        q[i] = prefixes[bench_zipf(cdf, np)];
+    for (size_t i = 0; i < nupd; i++)
+        snprintf(ubuf + i * WORDMAX, WORDMAX, "%s~%zu",
+                 prefixes[bench_zipf(cdf, np)], i / 2);
+    for (size_t i = 1; i < nupd; i += 2)
+        memcpy(ubuf + i * WORDMAX, ubuf + (i - 1) * WORDMAX, WORDMAX);
+
+    printf("%zu distinct prefixes of %d chars, %d searches, Zipf s=%.2f, "
+           "an update every %d\n",
+           np, PREFIX_LEN, CACHE_QUERIES, CACHE_ZIPF, CACHE_UPDATE);
+    for (size_t k = 0; k < sizeof bench_cache_sizes / sizeof *bench_cache_sizes;
+         k++) {
+        int entries = bench_cache_sizes[k];
+        tst_cache_stats st;
+
+        if (tst_tree_cache(tree, entries)) {
+            fprintf(stderr, "error: tst_tree_cache(%d) failed.\n", entries);
+            goto out;
+        }
+        t1 = tvgetf();
+        for (size_t i = 0; i < CACHE_QUERIES; i++) {
+            if (i % CACHE_UPDATE == 0) {
+                char *u = ubuf + i / CACHE_UPDATE * WORDMAX;
+                if (i / CACHE_UPDATE % 2)
+                    tst_tree_del(tree, u);
+                else
+                    tst_tree_ins(tree, u);
+            }
+            tst_tree_search_prefix(tree, q[i], sgl, &sidx, max);
+            if (!k)
+                qn[i] = sidx;
+            else
+                diffs += qn[i] != sidx;
+        }
+        t2 = tvgetf();
+        tst_tree_cache_stats(tree, &st);
+        printf("  cache %4d entries: %.6f sec, %.0f searches/sec, hits "
+               "%.1f%%, invalidated %zu, evicted %zu\n",
+               entries, t2 - t1, CACHE_QUERIES / (t2 - t1),
+               entries ? 100.0 * st.hits / (st.hits + st.misses) : 0.0,
+               st.invalidated, st.evicted);
+    }
+    printf("  %zu result counts differ from the uncached run\n", diffs);
+    stat = diffs != 0;
+out:
+    tst_tree_cache(tree, 0);
+    free(buf);
+    free(prefixes);
+    free(pbuf);
+    free(cdf);
+    free(q);
+    free(ubuf);
+    free(qn);
+    free(sgl);
+    return stat;
+}
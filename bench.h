@@ -1,5 +1,6 @@
 #ifndef BENCH_H
 #define BENCH_H
+#include "bloom.h"
 #include "tst.h"
 
 double tvgetf();
@@ -7,4 +8,118 @@ double tvgetf();
 
 int bench_test(const tst_node *root, char *out_file, const int max);
 
+/** bench_memory() report node count and memory of 'tree', then load the
+ *  dictionary into a compact tree and report the same for comparison.
+ */
+int bench_memory(const tst_tree *tree, const int cpy);
+
+/** bench_map() freeze the tree rooted at 'root' into 'map_file', map it
+ *  back and compare prefix search on the mapping against the tree.
+ */
+int bench_map(const tst_node *root, const char *map_file, const int max);
+
+/** bench_build() load the dictionary by insertion in file order and by
+ *  tst_build(), then time exact and prefix lookups on both trees.
+ */
+int bench_build(const int cpy, const int max);
+
+/** bench_rebalance() load the dictionary, churn the tree with rounds of
+ *  deletes and sorted reinserts, then tst_rebalance() part of it, all of
+ *  it and tst_compact() it, reporting the depth, dead nodes, memory and
+ *  lookup times at each stage.
+ */
+int bench_rebalance(const int cpy, const int max);
+
+/** bench_pages() page through the words prefixed with 'prefix', 'page'
+ *  words at a time, with a cursor and by re-running tst_search_prefix().
+ */
+int bench_pages(const tst_node *root, const char *prefix, const int page);
+
+/** bench_topk() time tst_search_prefix_topk() for 'k' words against
+ *  tst_search_prefix() for up to 'max' words on two char prefixes.
+ */
+int bench_topk(const tst_node *root, const int k, const int max);
+
+/** bench_fuzzy() mistype sampled words and time tst_search_fuzzy() and
+ *  tst_search_prefix_fuzzy() finding them back.
+ */
+int bench_fuzzy(const tst_node *root, const int max);
+
+/** bench_concurrent() time lookups from 1, 2, 4 .. 'maxthreads' reader
+ *  threads on a concurrent tree, alone and with a writer thread adding and
+ *  deleting words at the same time.
+ */
+int bench_concurrent(const int cpy, const int maxthreads);
+
+/** bench_parallel() load the dictionary repeated 'scale' times with the
+ *  serial loader, with tst_build() and with tst_build_parallel() on 1, 2,
+ *  4 .. 'maxthreads' threads splitting the text and building the tree.
+ */
+int bench_parallel(const int cpy, const int maxthreads, const int scale);
+
+/** bench_bloom() time add and test on the classic bloom filter and on the
+ *  blocked and counting filters sized for the dictionary at 'fpr', with
+ *  the measured false positive rate of each on absent words. The counting
+ *  filter also removes half the words and is tested on them.
+ */
+int bench_bloom(const double fpr);
+
+/** bench_batch() time exact and prefix lookups of the dictionary one at a
+ *  time and through tst_search_batch() and tst_search_prefix_batch(), up
+ *  to 'max' words per prefix, checking both agree.
+ */
+int bench_batch(const tst_node *root, const int max);
+
+/** bench_suite() settings, the workloads are a comma separated list of
+ *  insert, delete, hit, miss, bloom_miss and prefix1 .. prefix8, or "all".
+ */
+typedef struct bench_suite_cfg {
+    const char *mode;      /* label of the run in the output, e.g. "cpy" */
+    const char *workloads; /* workloads to run, NULL for all */
+    const char *out;       /* results go to 'out'.csv and 'out'.json */
+    int batch;             /* operations timed per clock read */
+    int warmup, repeat;    /* untimed and timed passes over the keys */
+    int max;               /* words returned per prefix search */
+} bench_suite_cfg;
+
+/** bench_suite() time insert and delete of absent words, exact lookups
+ *  hitting and missing, misses gated by 'bloom' and prefix searches of 1 to
+ *  8 bytes on 'tree', leaving it as it was. Reports ops/sec, the p50,
+ *  p90, p99 and p99.9 latency and the perfcnt.h counters per operation of
+ *  each workload on stdout, as CSV and as JSON with a log2 latency
+ *  histogram.
+ */
+int bench_suite(tst_tree *tree,
+                bloom_count_t bloom,
+                const bench_suite_cfg *cfg);
+
+/** bench_radix() load the distinct words of the dictionary into a radix
+ *  tree and a ternary tree and compare their nodes, memory, and exact and
+ *  prefix lookups with their counters, then delete every other word from
+ *  the radix tree and insert it back, checking it returns the same words.
+ */
+int bench_radix(const int cpy, const int max);
+
+/** bench_engines() run the same workload on every engine of dict.h: load
+ *  the dictionary, search every word and an absent word for each, search
+ *  prefixes for up to 'max' words and delete every word, reporting nodes,
+ *  memory, times and counters, and checking the prefix results of each
+ *  engine against the first.
+ */
+int bench_engines(const int cpy, const int max);
+
+/** bench_client() load the server at 'addr' from 'conns' connections each
+ *  keeping 'depth' requests in flight, 'total' requests in all, and report
+ *  the throughput and latency percentiles.
+ */
+int bench_client(const char *addr, int conns, int depth, size_t total);
+
+/** bench_cache() time tst_tree_search_prefix() on 'tree' for up to 'max'
+ *  words on a Zipf skewed stream of the dictionary prefixes, with absent
+ *  words added and deleted under them, without a cache and with caches of
+ *  growing size, reporting the hit rate and the entries invalidated by the
+ *  updates and evicted. The tree is left as it was.
+ */
+int bench_cache(tst_tree *tree, const int max);
+
 #endif
@@ -1,6 +1,12 @@
 #include "bloom.h"
+#include "math.h"
 #include "stdint.h"
 #include "stdlib.h"
+#include "string.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 struct bloom_hash {
     hash_function func;
@@ -106,3 +112,272 @@ bool bloom_test(bloom_t filter, const void *item)
     }
     return true;
 }
+
+/* 512-bit block, one cache line. */
+typedef struct bloom_line {
+    uint64_t w[8];
+} __attribute__((aligned(64))) bloom_line;
+
+struct bloom_block {
+    bloom_line *lines;
+    size_t nlines;
+    unsigned k; /* probes per item */
+};
+
+static inline uint64_t bloom_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* 64-bit string hash taking 8 bytes per step. */
+static uint64_t bloom_hash64(const char *s)
+{
+    size_t len = strlen(s);
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (len * 0x9fb21c651e98df25ULL);
+    uint64_t v;
+
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&v, s, 8);
+        h = (h ^ bloom_mix(v)) * 0x9fb21c651e98df25ULL;
+        h ^= h >> 29;
+    }
+    v = 0;
+    memcpy(&v, s, len);
+    return bloom_mix(h ^ v ^ (uint64_t) len << 56);
+}
+
+/* Expected false positive rate of 'n' items in 'nlines' lines of 'slots'
+ * slots with 'k' probes. The items of a line follow a Poisson law, so the
+ * rate is averaged over the line loads rather than taken at the mean. */
+static double bloom_line_fpr(size_t n,
+                             size_t nlines,
+                             unsigned slots,
+                             unsigned k)
+{
+    double load = (double) n / nlines, p = exp(-load), fpr = 0;
+    double jmax = load + 10 * sqrt(load) + 10;
+
+    for (unsigned j = 0; j <= jmax; j++) {
+        fpr += p * pow(1 - exp(-(double) k * j / slots), k);
+        p *= load / (j + 1);
+    }
+    return fpr;
+}
+
+/* Sizes a filter of 'n' items at a false positive rate of 'fpr' in lines
+ * of 'slots' slots. Starts from the unblocked optimum m = -n ln(p) / ln(2)^2
+ * and k = m / n ln(2), then adds lines until the uneven load of the lines
+ * still meets 'fpr'. */
+static void bloom_dims(size_t n,
+                       double fpr,
+                       unsigned slots,
+                       size_t *nlines,
+                       unsigned *k)
+{
+    double m, probes;
+
+    if (!n)
+        n = 1;
+    if (fpr <= 0 || fpr >= 1)
+        fpr = 0.01;
+    m = -(double) n * log(fpr) / (M_LN2 * M_LN2);
+    probes = round(m / n * M_LN2);
+    *k = probes < 1 ? 1 : probes > 16 ? 16 : probes;
+    *nlines = (size_t) ceil(m / slots);
+    while (bloom_line_fpr(n, *nlines, slots, *k) > fpr)
+        *nlines += *nlines / 16 + 1;
+}
+
+bloom_block_t bloom_block_create(size_t n, double fpr)
+{
+    bloom_block_t res;
+
+    if (!(res = calloc(1, sizeof(struct bloom_block))))
+        return NULL;
+    bloom_dims(n, fpr, 512, &res->nlines, &res->k);
+    if (posix_memalign((void **) &res->lines, 64,
+                       res->nlines * sizeof(bloom_line))) {
+        free(res);
+        return NULL;
+    }
+    memset(res->lines, 0, res->nlines * sizeof(bloom_line));
+    return res;
+}
+
+void bloom_block_free(bloom_block_t filter)
+{
+    if (filter) {
+        free(filter->lines);
+        free(filter);
+    }
+}
+
+/* Builds the mask of the k bits of 'hash' and returns its line. The upper
+ * half of the hash picks the line, the lower half seeds the enhanced double
+ * hashing of the bit positions, h1 += h2 and h2 += i at probe i. */
+static bloom_line *bloom_block_mask(bloom_block_t filter,
+                                    uint64_t hash,
+                                    bloom_line *mask)
+{
+    size_t line = (hash >> 32) * filter->nlines >> 32;
+    uint32_t h1 = hash, h2 = (uint32_t) bloom_mix(hash) | 1;
+
+    memset(mask, 0, sizeof *mask);
+    for (unsigned i = 0; i < filter->k; h1 += h2, h2 += i++)
+        mask->w[(h1 >> 6) & 7] |= 1ULL << (h1 & 63);
+    return &filter->lines[line];
+}
+
+void bloom_block_add(bloom_block_t filter, const char *item)
+{
+    bloom_line mask, *line;
+
+    line = bloom_block_mask(filter, bloom_hash64(item), &mask);
+    for (int i = 0; i < 8; i++)
+        line->w[i] |= mask.w[i];
+}
+
+bool bloom_block_test(bloom_block_t filter, const char *item)
+{
+    bloom_line mask, *line;
+
+    line = bloom_block_mask(filter, bloom_hash64(item), &mask);
+#ifdef __SSE2__
+    /* a bit of the mask missing from the line leaves a non-zero byte */
+    __m128i miss = _mm_setzero_si128();
+    for (int i = 0; i < 8; i += 2)
+        miss = _mm_or_si128(
+            miss, _mm_andnot_si128(_mm_load_si128((__m128i *) &line->w[i]),
+                                   _mm_load_si128((__m128i *) &mask.w[i])));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(miss, _mm_setzero_si128())) ==
+           0xffff;
+#else
+    uint64_t miss = 0;
+    for (int i = 0; i < 8; i++)
+        miss |= mask.w[i] & ~line->w[i];
+    return !miss;
+#endif
+}
+
+double bloom_block_fpr(bloom_block_t filter, size_t n)
+{
+    return bloom_line_fpr(n, filter->nlines, 512, filter->k);
+}
+
+size_t bloom_block_size(bloom_block_t filter)
+{
+    return filter->nlines * sizeof(bloom_line);
+}
+
+#define BLOOM_CMAX 15 /* saturated counter, sticks */
+
+struct bloom_count {
+    bloom_line *lines; /* 128 4-bit counters per line */
+    size_t nlines;
+    unsigned k;
+};
+
+bloom_count_t bloom_count_create(size_t n, double fpr)
+{
+    bloom_count_t res;
+
+    if (!(res = calloc(1, sizeof(struct bloom_count))))
+        return NULL;
+    bloom_dims(n, fpr, 128, &res->nlines, &res->k);
+    if (posix_memalign((void **) &res->lines, 64,
+                       res->nlines * sizeof(bloom_line))) {
+        free(res);
+        return NULL;
+    }
+    memset(res->lines, 0, res->nlines * sizeof(bloom_line));
+    return res;
+}
+
+void bloom_count_free(bloom_count_t filter)
+{
+    if (filter) {
+        free(filter->lines);
+        free(filter);
+    }
+}
+
+/* Stores the k counter indexes of 'item' in 'pos', returns its line. */
+static uint8_t *bloom_count_probe(bloom_count_t filter,
+                                  const char *item,
+                                  unsigned *pos)
+{
+    uint64_t hash = bloom_hash64(item);
+    size_t line = (hash >> 32) * filter->nlines >> 32;
+    uint32_t h1 = hash, h2 = (uint32_t) bloom_mix(hash) | 1;
+
+    for (unsigned i = 0; i < filter->k; h1 += h2, h2 += i++)
+        pos[i] = h1 & 127;
+    return (uint8_t *) &filter->lines[line];
+}
+
+static inline unsigned bloom_counter(const uint8_t *c, unsigned i)
+{
+    return (c[i >> 1] >> ((i & 1) * 4)) & 0xf;
+}
+
+static inline void bloom_counter_add(uint8_t *c, unsigned i, int delta)
+{
+    unsigned v = bloom_counter(c, i);
+
+    if (v == BLOOM_CMAX) /* saturated, the true count is lost */
+        return;
+    /* two probes of a removed key may share a counter it alone did not
+     * raise, never borrow from the neighbouring counter of the byte
+     */
+    if (!v && delta < 0)
+        return;
+    c[i >> 1] += delta * (1 << ((i & 1) * 4));
+}
+
+void bloom_count_add(bloom_count_t filter, const char *item)
+{
+    unsigned pos[16];
+    uint8_t *c = bloom_count_probe(filter, item, pos);
+
+    for (unsigned i = 0; i < filter->k; i++)
+        bloom_counter_add(c, pos[i], 1);
+}
+
+bool bloom_count_test(bloom_count_t filter, const char *item)
+{
+    unsigned pos[16];
+    uint8_t *c = bloom_count_probe(filter, item, pos);
+
+    for (unsigned i = 0; i < filter->k; i++)
+        if (!bloom_counter(c, pos[i]))
+            return false;
+    return true;
+}
+
+bool bloom_count_remove(bloom_count_t filter, const char *item)
+{
+    unsigned pos[16];
+    uint8_t *c = bloom_count_probe(filter, item, pos);
+
+    for (unsigned i = 0; i < filter->k; i++)
+        if (!bloom_counter(c, pos[i]))
+            return false;
+    for (unsigned i = 0; i < filter->k; i++)
+        bloom_counter_add(c, pos[i], -1);
+    return true;
+}
+
+double bloom_count_fpr(bloom_count_t filter, size_t n)
+{
+    return bloom_line_fpr(n, filter->nlines, 128, filter->k);
+}
+
+size_t bloom_count_size(bloom_count_t filter)
+{
+    return filter->nlines * sizeof(bloom_line);
+}
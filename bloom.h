@@ -26,4 +26,60 @@ void bloom_add(bloom_t filter, const void *item);
  * if the item was probably added before. */
 bool bloom_test(bloom_t filter, const void *item);
 
+/* Blocked bloom filter: every item hashes once to 64 bits, the hash picks a
+ * 64-byte block and k bit positions inside it by double hashing, so adding
+ * or testing an item touches a single cache line. */
+typedef struct bloom_block *bloom_block_t;
+
+/* Creates a blocked bloom filter sized for 'n' items at a false positive
+ * rate of 'fpr', picking the number of bits and probes. Returns NULL on
+ * allocation failure. */
+bloom_block_t bloom_block_create(size_t n, double fpr);
+
+/* Frees a blocked bloom filter. */
+void bloom_block_free(bloom_block_t filter);
+
+/* Adds a nul-terminated string to the blocked bloom filter. */
+void bloom_block_add(bloom_block_t filter, const char *item);
+
+/* Tests if a nul-terminated string is in the blocked bloom filter, with the
+ * same meaning as bloom_test(). */
+bool bloom_block_test(bloom_block_t filter, const char *item);
+
+/* Returns the expected false positive rate once 'n' items are added. */
+double bloom_block_fpr(bloom_block_t filter, size_t n);
+
+/* Returns the size of the bit array in bytes. */
+size_t bloom_block_size(bloom_block_t filter);
+
+/* Counting bloom filter: the blocked layout with a 4-bit counter in place
+ * of each bit, 128 counters per 64-byte line, so items can be removed. A
+ * counter reaching 15 sticks there and is never decremented, trading a
+ * slot that can no longer clear for never forgetting an item. */
+typedef struct bloom_count *bloom_count_t;
+
+/* Creates a counting bloom filter sized for 'n' items at a false positive
+ * rate of 'fpr'. Returns NULL on allocation failure. */
+bloom_count_t bloom_count_create(size_t n, double fpr);
+
+/* Frees a counting bloom filter. */
+void bloom_count_free(bloom_count_t filter);
+
+/* Adds a nul-terminated string to the counting bloom filter. */
+void bloom_count_add(bloom_count_t filter, const char *item);
+
+/* Removes one occurrence of a string added before. Returns false, leaving
+ * the filter untouched, if the string is definitely not in the filter. */
+bool bloom_count_remove(bloom_count_t filter, const char *item);
+
+/* Tests if a nul-terminated string is in the counting bloom filter, with
+ * the same meaning as bloom_test(). */
+bool bloom_count_test(bloom_count_t filter, const char *item);
+
+/* Returns the expected false positive rate with 'n' items in the filter. */
+double bloom_count_fpr(bloom_count_t filter, size_t n);
+
+/* Returns the size of the counter array in bytes. */
+size_t bloom_count_size(bloom_count_t filter);
+
 #endif
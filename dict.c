@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "art.h"
+#include "dict.h"
+#include "tst.h"
+#include "tst_idx.h"
+#include "tst_rdx.h"
+
+/* the ternary search tree hands nodes to traverse callbacks, the adapter
+ * hands them the word as the other engines do.
+ */
+typedef struct dict_tst_walk {
+    void (*fn)(const void *, void *);
+    void *data;
+} dict_tst_walk;
+
+static void dict_tst_word(const void *node, void *data)
+{
+    dict_tst_walk *w = data;
+    w->fn(tst_get_string(node), w->data);
+}
+
+static void *dict_tst_create(const int cpy)
+{
+    return tst_tree_create(cpy);
+}
+
+static void *dict_tst_ins(void *d, const char *s)
+{
+    return tst_tree_ins(d, s);
+}
+
+static void *dict_tst_del(void *d, const char *s)
+{
+    return tst_tree_del(d, s);
+}
+
+static void *dict_tst_search(const void *d, const char *s)
+{
+    return tst_tree_search(d, s);
+}
+
+static void *dict_tst_search_prefix(const void *d,
+                                    const char *s,
+                                    char **a,
+                                    int *n,
+                                    const int max)
+{
+    return tst_tree_search_prefix(d, s, a, n, max);
+}
+
+static void dict_tst_traverse(const void *d,
+                              void(fn)(const void *, void *),
+                              void *data)
+{
+    dict_tst_walk w = {fn, data};
+    tst_traverse_fn(tst_tree_root(d), dict_tst_word, &w);
+}
+
+static size_t dict_tst_memory_usage(const void *d, size_t *nodes)
+{
+    return tst_memory_usage(d, nodes);
+}
+
+static void dict_tst_free(void *d)
+{
+    tst_tree_free(d);
+}
+
+const dict_ops dict_tst = {
+    .name = "tst",
+    .create = dict_tst_create,
+    .ins = dict_tst_ins,
+    .del = dict_tst_del,
+    .search = dict_tst_search,
+    .search_prefix = dict_tst_search_prefix,
+    .traverse = dict_tst_traverse,
+    .memory_usage = dict_tst_memory_usage,
+    .free = dict_tst_free,
+};
+
+/* the other engines take their handle first, only the pointer types of
+ * their prototypes differ, so the operations are wrapped one by one.
+ */
+#define DICT_ENGINE(engine, prefix)                                          \
+    static void *dict_##engine##_create(const int cpy)                       \
+    {                                                                        \
+        return prefix##_create(cpy);                                         \
+    }                                                                        \
+    static void *dict_##engine##_ins(void *d, const char *s)                 \
+    {                                                                        \
+        return prefix##_ins(d, s);                                           \
+    }                                                                        \
+    static void *dict_##engine##_del(void *d, const char *s)                 \
+    {                                                                        \
+        return prefix##_del(d, s);                                           \
+    }                                                                        \
+    static void *dict_##engine##_search(const void *d, const char *s)        \
+    {                                                                        \
+        return prefix##_search(d, s);                                        \
+    }                                                                        \
+    static void *dict_##engine##_search_prefix(                              \
+        const void *d, const char *s, char **a, int *n, const int max)       \
+    {                                                                        \
+        return prefix##_search_prefix(d, s, a, n, max);                      \
+    }                                                                        \
+    static void dict_##engine##_traverse(                                    \
+        const void *d, void(fn)(const void *, void *), void *data)           \
+    {                                                                        \
+        prefix##_traverse_fn(d, fn, data);                                   \
+    }                                                                        \
+    static size_t dict_##engine##_memory_usage(const void *d, size_t *nodes) \
+    {                                                                        \
+        return prefix##_memory_usage(d, nodes);                              \
+    }                                                                        \
+    static void dict_##engine##_free(void *d)                                \
+    {                                                                        \
+        prefix##_free(d);                                                    \
+    }                                                                        \
+    const dict_ops dict_##engine = {                                         \
+        .name = #engine,                                                     \
+        .create = dict_##engine##_create,                                    \
+        .ins = dict_##engine##_ins,                                          \
+        .del = dict_##engine##_del,                                          \
+        .search = dict_##engine##_search,                                    \
+        .search_prefix = dict_##engine##_search_prefix,                      \
+        .traverse = dict_##engine##_traverse,                                \
+        .memory_usage = dict_##engine##_memory_usage,                        \
+        .free = dict_##engine##_free,                                        \
+    }
+
+DICT_ENGINE(idx, tst_idx);
+DICT_ENGINE(rdx, tst_rdx);
+DICT_ENGINE(art, art);
+
+const dict_ops *const dict_engines[] = {&dict_tst, &dict_idx, &dict_rdx,
+                                        &dict_art, NULL};
+
+const dict_ops *dict_engine(const char *name)
+{
+    for (int i = 0; dict_engines[i]; i++)
+        if (!strcmp(dict_engines[i]->name, name))
+            return dict_engines[i];
+    return NULL;
+}
+
+dict *dict_create(const dict_ops *ops, const int cpy)
+{
+    dict *d = malloc(sizeof *d);
+
+    if (!d)
+        return NULL;
+    d->ops = ops;
+    if (!(d->d = ops->create(cpy))) {
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void dict_free(dict *d)
+{
+    if (!d)
+        return;
+    d->ops->free(d->d);
+    free(d);
+}
+
+void *dict_ins(dict *d, const char *s)
+{
+    return d->ops->ins(d->d, s);
+}
+
+void *dict_del(dict *d, const char *s)
+{
+    return d->ops->del(d->d, s);
+}
+
+void *dict_search(const dict *d, const char *s)
+{
+    return d->ops->search(d->d, s);
+}
+
+void *dict_search_prefix(const dict *d,
+                         const char *s,
+                         char **a,
+                         int *n,
+                         const int max)
+{
+    return d->ops->search_prefix(d->d, s, a, n, max);
+}
+
+void dict_traverse_fn(const dict *d,
+                      void(fn)(const void *, void *),
+                      void *data)
+{
+    d->ops->traverse(d->d, fn, data);
+}
+
+size_t dict_memory_usage(const dict *d, size_t *nodes)
+{
+    return d->ops->memory_usage(d->d, nodes);
+}
@@ -0,0 +1,71 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include <stddef.h>
+
+/** operations of a dictionary engine, with the semantics of tst_tree_ins(),
+ *  tst_tree_del(), tst_tree_search() and tst_tree_search_prefix(). The
+ *  first argument of 'traverse' callbacks is the word itself.
+ */
+typedef struct dict_ops {
+    const char *name;
+    void *(*create)(const int cpy);
+    void *(*ins)(void *d, const char *s);
+    void *(*del)(void *d, const char *s);
+    void *(*search)(const void *d, const char *s);
+    void *(*search_prefix)(const void *d,
+                           const char *s,
+                           char **a,
+                           int *n,
+                           const int max);
+    void (*traverse)(const void *d,
+                     void(fn)(const void *, void *),
+                     void *data);
+    size_t (*memory_usage)(const void *d, size_t *nodes);
+    void (*free)(void *d);
+} dict_ops;
+
+/** a dictionary, an engine and its instance. */
+typedef struct dict {
+    const dict_ops *ops;
+    void *d;
+} dict;
+
+/** engines, in the order of dict_engines: the ternary search tree of
+ *  tst.h, the compact tree of tst_idx.h, the radix tree of tst_rdx.h and
+ *  the adaptive radix tree of art.h.
+ */
+extern const dict_ops dict_tst, dict_idx, dict_rdx, dict_art;
+
+/** every engine, NULL terminated. */
+extern const dict_ops *const dict_engines[];
+
+/** dict_engine() returns the engine called 'name', NULL if none is. */
+const dict_ops *dict_engine(const char *name);
+
+/** dict_create() returns an empty dictionary of engine 'ops', 'cpy' as in
+ *  tst_tree_create(). returns NULL on allocation failure.
+ */
+dict *dict_create(const dict_ops *ops, const int cpy);
+
+/** free the dictionary and all storage its engine owns. */
+void dict_free(dict *d);
+
+/** dict_ins(), dict_del(), dict_search(), dict_search_prefix(),
+ *  dict_traverse_fn() and dict_memory_usage() call the operation of the
+ *  engine of 'd'.
+ */
+void *dict_ins(dict *d, const char *s);
+void *dict_del(dict *d, const char *s);
+void *dict_search(const dict *d, const char *s);
+void *dict_search_prefix(const dict *d,
+                         const char *s,
+                         char **a,
+                         int *n,
+                         const int max);
+void dict_traverse_fn(const dict *d,
+                      void(fn)(const void *, void *),
+                      void *data);
+size_t dict_memory_usage(const dict *d, size_t *nodes);
+
+#endif
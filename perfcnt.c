@@ -0,0 +1,130 @@
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perfcnt.h"
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[PERFCNT_MAX] = {
+    [PERFCNT_CYCLES] = {"cycles", PERF_TYPE_HARDWARE,
+                        PERF_COUNT_HW_CPU_CYCLES},
+    [PERFCNT_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE,
+                              PERF_COUNT_HW_INSTRUCTIONS},
+    [PERFCNT_CACHE_MISSES] = {"cache-misses", PERF_TYPE_HARDWARE,
+                              PERF_COUNT_HW_CACHE_MISSES},
+    [PERFCNT_BRANCH_MISSES] = {"branch-misses", PERF_TYPE_HARDWARE,
+                               PERF_COUNT_HW_BRANCH_MISSES},
+    [PERFCNT_TASK_CLOCK] = {"task-clock", PERF_TYPE_SOFTWARE,
+                            PERF_COUNT_SW_TASK_CLOCK},
+    [PERFCNT_PAGE_FAULTS] = {"page-faults", PERF_TYPE_SOFTWARE,
+                             PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+/** one file descriptor per counter, -1 for a counter not available. The
+ *  counters are not grouped so that one missing event does not take the
+ *  others down with it.
+ */
+struct perfcnt {
+    int fd[PERFCNT_MAX];
+};
+
+perfcnt *perfcnt_open(void)
+{
+    perfcnt *p = malloc(sizeof *p);
+    int n = 0;
+
+    if (!p)
+        return NULL;
+    for (int i = 0; i < PERFCNT_MAX; i++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1; /* allowed unprivileged */
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        p->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        n += p->fd[i] >= 0;
+    }
+    if (!n) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void perfcnt_close(perfcnt *p)
+{
+    if (!p)
+        return;
+    for (int i = 0; i < PERFCNT_MAX; i++)
+        if (p->fd[i] >= 0)
+            close(p->fd[i]);
+    free(p);
+}
+
+void perfcnt_start(perfcnt *p)
+{
+    if (!p)
+        return;
+    for (int i = 0; i < PERFCNT_MAX; i++) {
+        if (p->fd[i] < 0)
+            continue;
+        ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perfcnt_stop(perfcnt *p, perfcnt_val *v)
+{
+    if (!p)
+        return;
+    for (int i = 0; i < PERFCNT_MAX; i++)
+        if (p->fd[i] >= 0)
+            ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int i = 0; i < PERFCNT_MAX; i++) {
+        uint64_t r[3]; /* value, time enabled, time running */
+
+        if (p->fd[i] < 0 || read(p->fd[i], r, sizeof r) != sizeof r)
+            continue;
+        if (r[2] && r[2] < r[1]) /* shared the pmu with other events */
+            r[0] = (double) r[0] * r[1] / r[2];
+        v->v[i] += r[0];
+        v->valid |= 1u << i;
+    }
+}
+
+const char *perfcnt_name(int i)
+{
+    return i >= 0 && i < PERFCNT_MAX ? events[i].name : NULL;
+}
+
+void perfcnt_print(FILE *fp,
+                   const char *phase,
+                   const perfcnt_val *v,
+                   size_t ops)
+{
+    if (!v->valid || !ops)
+        return;
+    fprintf(fp, "perf, %s: %zu ops", phase, ops);
+    for (int i = 0; i < PERFCNT_MAX; i++)
+        if (v->valid & 1u << i)
+            fprintf(fp, ", %.2f %s", (double) v->v[i] / ops, events[i].name);
+    fprintf(fp, " per op");
+    if ((v->valid & 1u << PERFCNT_CYCLES) &&
+        (v->valid & 1u << PERFCNT_INSTRUCTIONS) && v->v[PERFCNT_CYCLES])
+        fprintf(fp, ", %.2f ipc",
+                (double) v->v[PERFCNT_INSTRUCTIONS] / v->v[PERFCNT_CYCLES]);
+    fprintf(fp, "\n");
+}
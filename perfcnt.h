@@ -0,0 +1,60 @@
+#ifndef PERFCNT_H
+#define PERFCNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* forward declaration of a set of performance counters of the calling
+ * thread. The counters are opened with perf_event_open() on user space
+ * only, which perf_event_paranoid <= 2 (the default) allows without root.
+ */
+typedef struct perfcnt perfcnt;
+
+/** counters of a set, a counter the kernel or the machine does not offer
+ *  (e.g. hardware events in a virtual machine) is left out.
+ */
+enum {
+    PERFCNT_CYCLES,
+    PERFCNT_INSTRUCTIONS,
+    PERFCNT_CACHE_MISSES,
+    PERFCNT_BRANCH_MISSES,
+    PERFCNT_TASK_CLOCK, /* nanoseconds on cpu */
+    PERFCNT_PAGE_FAULTS,
+    PERFCNT_MAX
+};
+
+/** counts accumulated over one or more measured phases. */
+typedef struct perfcnt_val {
+    uint64_t v[PERFCNT_MAX];
+    unsigned valid; /* bit i set if v[i] was counted */
+} perfcnt_val;
+
+/** perfcnt_open() open the counters for the calling thread, threads it
+ *  starts are not counted. returns NULL if no counter could be opened.
+ */
+perfcnt *perfcnt_open(void);
+
+/** perfcnt_close() close the counters of 'p', NULL is ignored. */
+void perfcnt_close(perfcnt *p);
+
+/** perfcnt_start() zero and start the counters of 'p'. */
+void perfcnt_start(perfcnt *p);
+
+/** perfcnt_stop() stop the counters of 'p' and add their counts to 'v',
+ *  scaled up for the time a counter was multiplexed out.
+ */
+void perfcnt_stop(perfcnt *p, perfcnt_val *v);
+
+/** perfcnt_name() returns the short name of counter 'i', e.g. "cycles". */
+const char *perfcnt_name(int i);
+
+/** perfcnt_print() print the counts of 'v' per operation for 'ops'
+ *  operations of 'phase' on one line, nothing if no counter is valid.
+ */
+void perfcnt_print(FILE *fp,
+                   const char *phase,
+                   const perfcnt_val *v,
+                   size_t ops);
+
+#endif
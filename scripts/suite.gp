@@ -0,0 +1,17 @@
+reset
+set ylabel 'latency(nsec)'
+set style data histogram
+set style histogram cluster gap 1
+set style fill solid
+set key left top
+set datafile separator ','
+set logscale y
+set title 'latency percentiles per workload'
+set term png enhanced font 'Verdana,10'
+set output 'suite.png'
+set xtics rotate by 45 right
+
+plot 'bench_suite_cpy.csv' every ::1 using 6:xtic(2) title 'cpy p50', \
+'' every ::1 using 8 title 'cpy p99', \
+'bench_suite_ref.csv' every ::1 using 6 title 'ref p50', \
+'' every ::1 using 8 title 'ref p99'
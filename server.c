@@ -0,0 +1,515 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "utf8.h"
+
+/** events per epoll_wait(), lookups per batched walk, longest request. */
+#define SRV_EVENTS 64
+#define SRV_BATCH 64
+#define SRV_LINEMAX 1024
+#define SRV_WRDMAX 256
+
+/** bytes read from a connection per round, the rest waits for the next. */
+#define SRV_INMAX (64 * SRV_LINEMAX)
+
+/** connection of a client, with the bytes read and not yet parsed and the
+ *  replies not yet written.
+ */
+typedef struct srv_conn {
+    struct srv_conn *prev, *next;
+    int fd;
+    char *in;
+    size_t inlen, incap;
+    char *out;
+    size_t outlen, outoff, outcap;
+    int eof;         /* 1 once the client closed its end, 2 to drop it */
+    unsigned events; /* epoll events registered for the socket */
+} srv_conn;
+
+/** request parsed in a round, 'key' is the offset of 'word' folded in
+ *  sv->keys for a normalized tree, or -1 to look 'word' up as is in a tree
+ *  that is not. an offset
+ *  survives sv->keys moving when the round outgrows it.
+ */
+typedef struct srv_req {
+    srv_conn *c;
+    char op;
+    const char *word;
+    long key;
+} srv_req;
+
+typedef struct srv {
+    const server_cfg *cfg;
+    int ep, lfd;
+    srv_conn *conns; /* open connections, closed on stop */
+    srv_req *reqs;
+    size_t nreqs, reqcap;
+    char *keys; /* folded keys of a round, SRV_WRDMAX bytes per request */
+    char **kept; /* words inserted in a reference tree, owned here */
+    size_t nkept, keptcap;
+    char **a;    /* prefix results of a batch, cfg->max per request */
+    size_t requests, batches, batched;
+} srv;
+
+static volatile sig_atomic_t srv_stop;
+
+static void srv_on_signal(int sig)
+{
+    (void) sig;
+    srv_stop = 1;
+}
+
+/** a number is a port of 127.0.0.1, anything else a socket path. */
+static int srv_is_port(const char *addr)
+{
+    return *addr && strspn(addr, "0123456789") == strlen(addr);
+}
+
+/** srv_addr() fill 'un' or 'in' from 'addr', returns the address length,
+ *  0 if 'addr' is too long for a socket path.
+ */
+static socklen_t srv_addr(const char *addr,
+                          struct sockaddr_un *un,
+                          struct sockaddr_in *in)
+{
+    if (srv_is_port(addr)) {
+        memset(in, 0, sizeof *in);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(atoi(addr));
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return sizeof *in;
+    }
+    if (strlen(addr) >= sizeof un->sun_path)
+        return 0;
+    memset(un, 0, sizeof *un);
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, addr);
+    return sizeof *un;
+}
+
+int server_listen(const char *addr)
+{
+    struct sockaddr_un un;
+    struct sockaddr_in in;
+    socklen_t len = srv_addr(addr, &un, &in);
+    struct sockaddr *sa = len == sizeof in ? (struct sockaddr *) &in
+                                           : (struct sockaddr *) &un;
+    int fd, on = 1;
+
+    if (!len || (fd = socket(sa->sa_family, SOCK_STREAM | SOCK_NONBLOCK,
+                             0)) < 0)
+        return -1;
+    if (sa->sa_family == AF_UNIX)
+        unlink(addr);
+    else
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if (bind(fd, sa, len) || listen(fd, SOMAXCONN)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_connect(const char *addr)
+{
+    struct sockaddr_un un;
+    struct sockaddr_in in;
+    socklen_t len = srv_addr(addr, &un, &in);
+    struct sockaddr *sa = len == sizeof in ? (struct sockaddr *) &in
+                                           : (struct sockaddr *) &un;
+    int fd, on = 1;
+
+    if (!len || (fd = socket(sa->sa_family, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, sa, len)) {
+        close(fd);
+        return -1;
+    }
+    if (sa->sa_family == AF_INET) /* replies are small and pipelined */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+/** srv_reserve() make room for 'n' more bytes in the buffer 'p'. */
+static int srv_reserve(char **p, size_t len, size_t *cap, size_t n)
+{
+    size_t c = *cap ? *cap : 4096;
+    char *np;
+
+    if (len + n <= *cap)
+        return 0;
+    while (c < len + n)
+        c *= 2;
+    if (!(np = realloc(*p, c)))
+        return -1;
+    *p = np;
+    *cap = c;
+    return 0;
+}
+
+/** srv_reply() append 'n' bytes of 's' to the replies of 'c'. */
+static void srv_reply(srv_conn *c, const char *s, size_t n)
+{
+    if (c->eof > 1) /* out of memory already, the connection is dropped */
+        return;
+    if (srv_reserve(&c->out, c->outlen, &c->outcap, n)) {
+        c->eof = 2;
+        return;
+    }
+    memcpy(c->out + c->outlen, s, n);
+    c->outlen += n;
+}
+
+static void srv_reply_str(srv_conn *c, const char *s)
+{
+    srv_reply(c, s, strlen(s));
+}
+
+static void srv_close(srv *sv, srv_conn *c)
+{
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        sv->conns = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    epoll_ctl(sv->ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+static void srv_accept(srv *sv)
+{
+    int fd;
+
+    while ((fd = accept(sv->lfd, NULL, NULL)) >= 0) {
+        srv_conn *c = calloc(1, sizeof *c);
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        if (!c || fcntl(fd, F_SETFL, O_NONBLOCK) ||
+            epoll_ctl(sv->ep, EPOLL_CTL_ADD, fd, &ev)) {
+            free(c);
+            close(fd);
+        } else {
+            c->fd = fd;
+            c->events = EPOLLIN;
+            c->next = sv->conns;
+            if (sv->conns)
+                sv->conns->prev = c;
+            sv->conns = c;
+        }
+    }
+}
+
+/** srv_read() read what 'c' has sent, up to SRV_INMAX bytes pending, so
+ *  a client streaming without a newline is refused by srv_parse() before
+ *  its buffer grows past that. returns -1 if the connection is to be
+ *  dropped at once.
+ */
+static int srv_read(srv_conn *c)
+{
+    while (c->inlen < SRV_INMAX) {
+        ssize_t n;
+        if (srv_reserve(&c->in, c->inlen, &c->incap, SRV_LINEMAX))
+            return -1;
+        n = recv(c->fd, c->in + c->inlen, c->incap - c->inlen, 0);
+        if (n > 0)
+            c->inlen += n;
+        else if (!n) {
+            c->eof = 1;
+            return 0;
+        } else
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return 0; /* the level-triggered poll reports the rest next round */
+}
+
+/** srv_flush() write the pending replies of 'c', polling for EPOLLOUT
+ *  while the socket buffer is full and no longer for EPOLLIN once the
+ *  client closed its end. returns -1 if the connection is done.
+ */
+static int srv_flush(srv *sv, srv_conn *c)
+{
+    while (c->outoff < c->outlen) {
+        ssize_t n = send(c->fd, c->out + c->outoff, c->outlen - c->outoff,
+                         MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0)
+            return -1;
+        c->outoff += n;
+    }
+    if (c->outoff == c->outlen)
+        c->outoff = c->outlen = 0;
+
+    unsigned events = (c->eof ? 0 : EPOLLIN) | (c->outlen ? EPOLLOUT : 0);
+    if (events != c->events) {
+        struct epoll_event ev = {.events = events, .data.ptr = c};
+        epoll_ctl(sv->ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+    return c->eof && !c->outlen ? -1 : 0;
+}
+
+/** srv_parse() queue the complete lines of 'c' as requests of the round,
+ *  their words stay in the input buffer until the round is answered.
+ *  returns the bytes parsed.
+ */
+static size_t srv_parse(srv *sv, srv_conn *c)
+{
+    size_t off = 0;
+    char *nl;
+
+    while ((nl = memchr(c->in + off, '\n', c->inlen - off))) {
+        char *line = c->in + off;
+        srv_req *r;
+
+        off = nl + 1 - c->in;
+        *nl = 0;
+        if (nl > line && nl[-1] == '\r')
+            nl[-1] = 0;
+        if (sv->nreqs == sv->reqcap) {
+            size_t cap = sv->reqcap ? sv->reqcap * 2 : 256;
+            srv_req *nr = realloc(sv->reqs, cap * sizeof *nr);
+            char *nk = realloc(sv->keys, cap * SRV_WRDMAX);
+            if (nr)
+                sv->reqs = nr;
+            if (nk)
+                sv->keys = nk;
+            if (!nr || !nk) {
+                c->eof = 2;
+                return off;
+            }
+            sv->reqcap = cap;
+        }
+        r = &sv->reqs[sv->nreqs];
+        *r = (srv_req){.c = c, .op = line[0], .word = line + 2, .key = -1};
+        if (!line[0] || line[1] != ' ' || !line[2])
+            r->op = '?';
+        if (sv->cfg->norm && (r->op == 'f' || r->op == 's')) {
+            long koff = (long) (sv->nreqs * SRV_WRDMAX);
+            if (utf8_fold(r->word, sv->keys + koff, SRV_WRDMAX) >= 0)
+                r->key = koff;
+            else /* the raw word would be looked up among folded keys */
+                r->op = '?';
+        }
+        sv->nreqs++;
+    }
+    /* a line that can never end is refused */
+    if (c->inlen - off >= SRV_LINEMAX) {
+        c->eof = 2;
+        off = c->inlen;
+    }
+    return off;
+}
+
+/** srv_key() the word request 'r' looks up in the tree. */
+static const char *srv_key(const srv *sv, const srv_req *r)
+{
+    return r->key < 0 ? r->word : sv->keys + r->key;
+}
+
+/** srv_reads() answer the finds and prefixes of requests [lo, hi) in two
+ *  batched walks, replies in request order.
+ */
+static void srv_reads(srv *sv, size_t lo, size_t hi)
+{
+    const tst_node *root = tst_tree_root(sv->cfg->tree);
+    const char *fkeys[SRV_BATCH], *skeys[SRV_BATCH];
+    void *fres[SRV_BATCH], *sres[SRV_BATCH];
+    int cnt[SRV_BATCH];
+    size_t nf = 0, ns = 0, max = sv->cfg->max;
+
+    for (size_t i = lo; i < hi; i++)
+        if (sv->reqs[i].op == 'f')
+            fkeys[nf++] = srv_key(sv, &sv->reqs[i]);
+        else
+            skeys[ns++] = srv_key(sv, &sv->reqs[i]);
+    tst_search_batch(root, fkeys, nf, fres);
+    tst_search_prefix_batch(root, skeys, ns, sv->a, cnt, max, sres);
+    sv->batches++;
+    sv->batched += hi - lo;
+
+    nf = ns = 0;
+    for (size_t i = lo; i < hi; i++) {
+        srv_conn *c = sv->reqs[i].c;
+        char buf[32];
+        if (sv->reqs[i].op == 'f') {
+            const char *w = fres[nf++];
+            if (w) {
+                srv_reply(c, "1 ", 2);
+                srv_reply_str(c, w);
+                srv_reply(c, "\n", 1);
+            } else
+                srv_reply(c, "0\n", 2);
+            continue;
+        }
+        int n = sres[ns] ? cnt[ns] : 0;
+        snprintf(buf, sizeof buf, "%d", n);
+        srv_reply_str(c, buf);
+        for (int k = 0; k < n; k++) {
+            srv_reply(c, "\t", 1);
+            srv_reply_str(c, sv->a[ns * max + k]);
+        }
+        srv_reply(c, "\n", 1);
+        ns++;
+    }
+}
+
+/** srv_update() apply the insert or delete 'r' and reply. */
+static void srv_update(srv *sv, const srv_req *r)
+{
+    tst_tree *t = sv->cfg->tree;
+    const char *w = r->word;
+    void *res;
+
+    if (r->op == 'd') {
+        res = tst_tree_del(t, w);
+        srv_reply_str(r->c, res == (void *) -1 ? "0\n" : "1\n");
+        return;
+    }
+    /* a reference tree points at the word, it needs a home of its own */
+    if (!sv->cfg->cpy && !tst_tree_search(t, w)) {
+        char *copy = NULL;
+        if (sv->nkept == sv->keptcap) {
+            size_t cap = sv->keptcap ? sv->keptcap * 2 : 256;
+            char **nk = realloc(sv->kept, cap * sizeof *nk);
+            if (!nk) {
+                srv_reply(r->c, "0\n", 2);
+                return;
+            }
+            sv->kept = nk;
+            sv->keptcap = cap;
+        }
+        if (!(copy = strdup(w))) {
+            srv_reply(r->c, "0\n", 2);
+            return;
+        }
+        sv->kept[sv->nkept++] = copy;
+        w = copy;
+    }
+    if ((res = tst_tree_ins(t, w))) {
+        srv_reply(r->c, "1 ", 2);
+        srv_reply_str(r->c, res);
+        srv_reply(r->c, "\n", 1);
+    } else
+        srv_reply(r->c, "0\n", 2);
+}
+
+/** srv_round() answer the requests of the round in order, runs of finds
+ *  and prefixes up to SRV_BATCH long share a batched walk.
+ */
+static void srv_round(srv *sv)
+{
+    size_t lo = 0;
+
+    for (size_t i = 0; i <= sv->nreqs; i++) {
+        char op = i < sv->nreqs ? sv->reqs[i].op : 0;
+        int read = op == 'f' || op == 's';
+
+        if (read && i - lo < SRV_BATCH)
+            continue;
+        if (i > lo)
+            srv_reads(sv, lo, i);
+        lo = i;
+        if (read || i == sv->nreqs)
+            continue;
+        if (op == 'a' || op == 'd')
+            srv_update(sv, &sv->reqs[i]);
+        else
+            srv_reply(sv->reqs[i].c, "?\n", 2);
+        lo = i + 1;
+    }
+    sv->requests += sv->nreqs;
+    sv->nreqs = 0;
+}
+
+int server_run(const server_cfg *cfg)
+{
+    struct sigaction sa = {.sa_handler = srv_on_signal};
+    struct epoll_event evs[SRV_EVENTS];
+    srv_conn *ready[SRV_EVENTS];
+    size_t parsed[SRV_EVENTS];
+    srv sv = {.cfg = cfg, .ep = -1, .lfd = -1};
+    int err = -1;
+
+    if (!(sv.a = malloc(SRV_BATCH * cfg->max * sizeof *sv.a)))
+        return -1;
+    if ((sv.lfd = server_listen(cfg->addr)) < 0 ||
+        (sv.ep = epoll_create1(0)) < 0) {
+        fprintf(stderr, "error: can not listen on '%s'.\n", cfg->addr);
+        goto out;
+    }
+    struct epoll_event lev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(sv.ep, EPOLL_CTL_ADD, sv.lfd, &lev))
+        goto out;
+
+    sigaction(SIGINT, &sa, NULL); /* no SA_RESTART, epoll_wait() returns */
+    sigaction(SIGTERM, &sa, NULL);
+    printf("server, listening on %s\n", cfg->addr);
+    fflush(stdout);
+
+    while (!srv_stop) {
+        int n = epoll_wait(sv.ep, evs, SRV_EVENTS, -1), nready = 0;
+
+        if (n < 0 && errno != EINTR)
+            break;
+        /* read every connection first, so the round batches them all */
+        for (int i = 0; i < n; i++) {
+            srv_conn *c = evs[i].data.ptr;
+            if (!c) {
+                srv_accept(&sv);
+                continue;
+            }
+            if ((evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) &&
+                srv_read(c) < 0) {
+                srv_close(&sv, c);
+                continue;
+            }
+            ready[nready++] = c;
+        }
+        for (int i = 0; i < nready; i++)
+            parsed[i] = srv_parse(&sv, ready[i]);
+        srv_round(&sv);
+        for (int i = 0; i < nready; i++) {
+            srv_conn *c = ready[i];
+            memmove(c->in, c->in + parsed[i], c->inlen - parsed[i]);
+            c->inlen -= parsed[i];
+            if (c->eof > 1 || srv_flush(&sv, c))
+                srv_close(&sv, c);
+        }
+    }
+    printf("server, %zu requests, %zu batched walks of %.2f on average\n",
+           sv.requests, sv.batches,
+           sv.batches ? (double) sv.batched / sv.batches : 0.0);
+    err = 0;
+out:
+    while (sv.conns)
+        srv_close(&sv, sv.conns);
+    if (sv.ep >= 0)
+        close(sv.ep);
+    if (sv.lfd >= 0) {
+        close(sv.lfd);
+        if (!srv_is_port(cfg->addr))
+            unlink(cfg->addr);
+    }
+    for (size_t i = 0; i < sv.nkept; i++)
+        free(sv.kept[i]);
+    free(sv.kept);
+    free(sv.reqs);
+    free(sv.keys);
+    free(sv.a);
+    return err;
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "tst.h"
+
+/* dictionary server, one process serving a warm tree to many clients over
+ * a Unix domain socket or a loopback TCP port. The protocol is one line
+ * per request and one line per reply, requests may be pipelined:
+ *
+ *     f <word>      find      "1 <word>" or "0"
+ *     s <prefix>    prefix    "<n>" then "\t<word>" for each word found
+ *     a <word>      insert    "1 <word>" or "0" on failure
+ *     d <word>      delete    "1" if removed or its refcnt dropped, "0"
+ *
+ * anything else, or a find or prefix of a word a normalized tree can not
+ * fold, is answered with "?". Requests read in the same round of the event
+ * loop are grouped: consecutive finds and prefixes, whatever connection
+ * they came from, are walked together with tst_search_batch() and
+ * tst_search_prefix_batch(), an insert or delete ends the group.
+ */
+
+/** server settings. */
+typedef struct server_cfg {
+    const char *addr; /* socket path, or a port number for 127.0.0.1 */
+    tst_tree *tree;
+    int cpy;          /* non-zero if the tree copies inserted words */
+    int norm;         /* non-zero if the tree is normalized */
+    int max;          /* words returned by a prefix request */
+} server_cfg;
+
+/** server_listen() returns a listening socket bound to 'addr', -1 on
+ *  error. A stale socket file at 'addr' is replaced.
+ */
+int server_listen(const char *addr);
+
+/** server_connect() returns a socket connected to the server at 'addr',
+ *  -1 on error.
+ */
+int server_connect(const char *addr);
+
+/** server_run() serve 'cfg->tree' until SIGINT or SIGTERM, then print the
+ *  request and batch counts. returns 0 on a clean stop, -1 if the socket
+ *  can not be set up.
+ */
+int server_run(const server_cfg *cfg);
+
+#endif
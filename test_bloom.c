@@ -0,0 +1,87 @@
+#include <stdio.h>
+
+/* white box test, the counters and probes of the counting filter are
+ * private to bloom.c
+ */
+#include "bloom.c"
+
+#define CHECK(cond, ...)                      \
+    do {                                      \
+        if (!(cond)) {                        \
+            fprintf(stderr, "FAIL: ");        \
+            fprintf(stderr, __VA_ARGS__);     \
+            fprintf(stderr, "\n");            \
+            return 1;                         \
+        }                                     \
+    } while (0)
+
+/** a key never added whose probes share a counter is removed while every
+ *  probe is held at 1 by other keys: the shared counter must stop at 0 and
+ *  leave the rest of its line alone.
+ */
+static int test_count_repeated_probe(void)
+{
+    bloom_count_t f = bloom_count_create(1000, 0.01);
+    unsigned pos[16], probed[128] = {0}, before[128];
+    char item[32];
+    uint8_t *c = NULL;
+    int dup = -1;
+
+    CHECK(f, "bloom_count_create()");
+    for (int n = 0; dup < 0 && n < 100000; n++) {
+        snprintf(item, sizeof item, "word%d", n);
+        c = bloom_count_probe(f, item, pos);
+        for (unsigned i = 0; i < f->k; i++)
+            for (unsigned j = 0; j < i; j++)
+                if (pos[i] == pos[j])
+                    dup = pos[i];
+    }
+    CHECK(dup >= 0, "no key with a repeated probe");
+
+    for (unsigned i = 0; i < f->k; i++) {
+        probed[pos[i]] = 1;
+        if (!bloom_counter(c, pos[i]))
+            bloom_counter_add(c, pos[i], 1);
+    }
+    for (unsigned i = 0; i < 128; i++)
+        before[i] = bloom_counter(c, i);
+
+    CHECK(bloom_count_remove(f, item), "remove of a false positive");
+    for (unsigned i = 0; i < 128; i++)
+        CHECK(bloom_counter(c, i) == (probed[i] ? 0 : before[i]),
+              "counter %u is %u after removing '%s' (shared counter %d)", i,
+              bloom_counter(c, i), item, dup);
+    bloom_count_free(f);
+    return 0;
+}
+
+/** keys added then removed are gone, the others stay. */
+static int test_count_add_remove(void)
+{
+    bloom_count_t f = bloom_count_create(1000, 0.01);
+    char item[32];
+
+    CHECK(f, "bloom_count_create()");
+    for (int n = 0; n < 1000; n++) {
+        snprintf(item, sizeof item, "word%d", n);
+        bloom_count_add(f, item);
+    }
+    for (int n = 0; n < 1000; n += 2) {
+        snprintf(item, sizeof item, "word%d", n);
+        CHECK(bloom_count_remove(f, item), "remove of '%s'", item);
+    }
+    for (int n = 1; n < 1000; n += 2) {
+        snprintf(item, sizeof item, "word%d", n);
+        CHECK(bloom_count_test(f, item), "'%s' lost", item);
+    }
+    bloom_count_free(f);
+    return 0;
+}
+
+int main(void)
+{
+    int fail = test_count_repeated_probe() | test_count_add_remove();
+
+    printf("test_bloom: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}
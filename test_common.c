@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,20 +7,47 @@
 
 #include "bench.c"
 #include "bloom.h"
+#include "perfcnt.h"
+#include "server.h"
+#include "text.h"
 #include "tst.h"
+#include "tst_log.h"
+#include "utf8.h"
 
-#define TableSize 5000000 /* size of bloom filter */
-#define HashNumber 2      /* number of hash functions */
+#define BloomFPR 0.01 /* target false positive rate of bloom filter */
 
 /** constants insert, delete, max word(s) & stack nodes */
-enum { INS, DEL, WRDMAX = 256, STKMAX = 512, LMAX = 1024 };
+enum {
+    INS,
+    DEL,
+    WRDMAX = 256,
+    STKMAX = 512,
+    LMAX = 1024,
+    TOPK = 10,
+    FUZZYDIST = 2,
+    READERS = 8,
+    SCALE = 10,
+    SUITE_BATCH = 64,
+    SUITE_WARMUP = 1,
+    SUITE_REPEAT = 3,
+    SNAPEVERY = 1024,
+    CLIENT_CONNS = 8,
+    CLIENT_DEPTH = 16,
+    CLIENT_REQS = 400000
+};
 
 int REF = INS;
 
 
 #define BENCH_TEST_FILE "bench_ref.txt"
+#define MAP_FILE "cities.tst"
+#define LOG_BASE "cities" /* cities.snap and cities.log.<lsn> */
+#define SERVE_ADDR "tst.sock"
 
-long poolsize = 2000000 * WRDMAX;
+/* REF mechanism: words of the file are referenced in its mapping, the pool
+ * only holds the words added with the 'a' command
+ */
+long poolsize = 4096 * WRDMAX;
 
 /* simple trim '\n' from end of buffer filled by fgets */
 static void rmcrlf(char *s)
@@ -29,21 +57,54 @@ static void rmcrlf(char *s)
         s[--len] = 0;
 }
 
+/* key of 's' for the bloom filter and the raw tree searches, its folded
+ * form written to 'key' when the tree is normalized.
+ */
+static const char *query_key(int norm, const char *s, char *key)
+{
+    if (norm && utf8_fold(s, key, WRDMAX) >= 0)
+        return key;
+    return s;
+}
+
+/* words of the tree to add to the bloom filter */
+typedef struct bloom_words {
+    bloom_count_t bloom;
+    int norm;
+} bloom_words;
+
+static void bloom_add_word(const void *node, void *data)
+{
+    bloom_words *bw = data;
+    char key[WRDMAX];
+
+    bloom_count_add(bw->bloom,
+                    query_key(bw->norm, tst_get_string(node), key));
+}
+
 #define IN_FILE "cities.txt"
 
 int main(int argc, char **argv)
 {
-    char word[WRDMAX] = "";
+    char word[WRDMAX] = "", key[WRDMAX], hi[WRDMAX], hikey[WRDMAX];
     char *sgl[LMAX] = {NULL};
-    tst_node *root = NULL, *res = NULL;
+    tst_tree *tree = NULL;
+    tst_node *res = NULL;
     int idx = 0, sidx = 0;
+    unsigned line = 0;
     double t1, t2;
-    int CPYmask = -1;
+    int CPYmask = -1, norm = 0, stat = 0; /* exit status of a mode */
+    tst_log *wal = NULL;
     if (argc < 2) {
         printf("too less argument\n");
         return 1;
     }
 
+    /* the load generator needs no tree, e.g. ./test_common --client 7000 */
+    if (!strcmp(argv[1], "--client"))
+        return bench_client(argc > 2 ? argv[2] : SERVE_ADDR, CLIENT_CONNS,
+                            CLIENT_DEPTH, CLIENT_REQS);
+
     if (!strcmp(argv[1], "CPY") || (argc > 2 && !strcmp(argv[2], "CPY"))) {
         CPYmask = 0;
         REF = DEL;
@@ -51,6 +112,14 @@ int main(int argc, char **argv)
     } else
         printf("REF mechanism\n");
 
+    /* NORM: case and accent insensitive tree, e.g. ./test_common CPY NORM */
+    if (argc > 2 && !strcmp(argv[2], "NORM")) {
+        norm = 1;
+        printf("normalized keys\n");
+    }
+    /* WAL: updates survive a restart, e.g. ./test_common CPY WAL */
+    int durable = argc > 2 && !strcmp(argv[2], "WAL");
+
     char *Top = word;
     char *pool = NULL;
 
@@ -63,48 +132,180 @@ int main(int argc, char **argv)
         Top = pool;
     }
 
-    FILE *fp = fopen(IN_FILE, "r");
+    text txt = {0};
 
-    if (!fp) { /* prompt, open, validate file for reading */
-        fprintf(stderr, "error: file open failed '%s'.\n", argv[1]);
+    if (text_map(&txt, IN_FILE) < 0) { /* map the file, tokens in place */
+        fprintf(stderr, "error: file open failed '%s'.\n", IN_FILE);
+        free(pool);
         return 1;
     }
+    /* counters of this thread, the load and each command are counted
+     * apart when the kernel lets us open them
+     */
+    perfcnt *pc = perfcnt_open();
+    perfcnt_val pv = {0};
+
+    perfcnt_start(pc);
     t1 = tvgetf();
 
-    bloom_t bloom = bloom_create(TableSize);
+    tree = norm ? tst_tree_create_norm(REF) : tst_tree_create(REF);
+    if (!tree) {
+        fprintf(stderr, "error: memory exhausted, tst_tree_create.\n");
+        text_unmap(&txt);
+        return 1;
+    }
 
-    char buf[WORDMAX];
-    while (fgets(buf, WORDMAX, fp)) {
-        int offset = 0;
-        for (int i = 0, j = 0; buf[i + offset]; i++) {
-            Top[i] =
-                (buf[i + j] == ',' || buf[i + j] == '\n') ? '\0' : buf[i + j];
-            j += (buf[i + j] == ',');
+    /* the last snapshot replaces the file, the log then adds what changed */
+    long loaded = -1;
+    if (durable) {
+        if (!(wal = tst_log_open(LOG_BASE, tree, SNAPEVERY, TST_LOG_SYNC))) {
+            fprintf(stderr, "error: log '%s' can not be recovered.\n",
+                    LOG_BASE);
+            text_unmap(&txt);
+            return 1;
         }
-        while (*Top) {
-            if (!tst_ins(&root, Top, REF)) { /* fail to insert */
-                fprintf(stderr, "error: memory exhausted, tst_insert.\n");
-                fclose(fp);
-                return 1;
-            }
-            bloom_add(bloom, Top);
-            idx++;
-            int len = strlen(Top);
-            offset += len + 1;
-            Top += len + 1;
+        if ((loaded = tst_log_loaded(wal)) >= 0)
+            idx = loaded;
+    }
+
+    char *w;
+    while (loaded < 0 && (w = text_token(&txt, &line))) {
+        /* cities.txt is ordered by population, earlier lines score higher */
+        if (!tst_tree_ins_score(tree, w, UINT_MAX - line)) {
+            fprintf(stderr, "error: memory exhausted, tst_insert.\n");
+            text_unmap(&txt);
+            return 1;
         }
-        Top -= offset & ~CPYmask;
-        memset(Top, '\0', WORDMAX);
+        idx++;
+    }
+    if (wal) {
+        long n = tst_log_replay(wal);
+        if (n < 0) {
+            fprintf(stderr, "error: log '%s' can not be appended.\n",
+                    LOG_BASE);
+            text_unmap(&txt);
+            return 1;
+        }
+        printf("log, replayed %ld records\n", n);
+        if (loaded < 0) /* first run, no snapshot yet */
+            tst_log_snapshot(wal);
     }
     t2 = tvgetf();
-    fclose(fp);
+    perfcnt_stop(pc, &pv);
+    if (!CPYmask) /* CPY mechanism copied every word, the mapping can go */
+        text_unmap(&txt);
     printf("ternary_tree, loaded %d words in %.6f sec\n", idx, t2 - t1);
+    perfcnt_print(stdout, "load", &pv, idx);
+
+    /* size the filter from the words loaded, with room for as many again */
+    bloom_count_t bloom = bloom_count_create(2 * idx, BloomFPR);
+    if (!bloom) {
+        fprintf(stderr, "error: memory exhausted, bloom_count_create.\n");
+        stat = 1;
+        goto quit;
+    }
+    bloom_words bw = {.bloom = bloom, .norm = norm};
+    tst_traverse_fn(tst_tree_root(tree), bloom_add_word, &bw);
 
     if (argc == 3 && strcmp(argv[1], "--bench") == 0) {
-        int stat = bench_test(root, BENCH_TEST_FILE, LMAX);
-        tst_free(root);
-        free(pool);
-        return stat;
+        stat = bench_test(tst_tree_root(tree), BENCH_TEST_FILE, LMAX);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--mem") == 0) {
+        stat = bench_memory(tree, REF);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--freeze") == 0) {
+        stat = bench_map(tst_tree_root(tree), MAP_FILE, LMAX);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--build") == 0) {
+        stat = bench_build(REF, LMAX);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--rebalance") == 0) {
+        stat = bench_rebalance(REF, LMAX);
+        goto quit;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--pages") == 0) {
+        stat = bench_pages(tst_tree_root(tree), argv[3], 10);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--topk") == 0) {
+        stat = bench_topk(tst_tree_root(tree), TOPK, LMAX);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--fuzzy") == 0) {
+        stat = bench_fuzzy(tst_tree_root(tree), LMAX);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--concurrent") == 0) {
+        stat = bench_concurrent(REF, READERS);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--parallel") == 0) {
+        stat = bench_parallel(REF, READERS, SCALE);
+        goto quit;
+    }
+
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--serve") == 0) {
+        server_cfg cfg = {
+            .addr = argc == 4 ? argv[3] : SERVE_ADDR,
+            .tree = tree,
+            .cpy = REF,
+            .norm = norm,
+            .max = TOPK,
+        };
+        stat = server_run(&cfg) ? 1 : 0;
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--bloom") == 0) {
+        stat = bench_bloom(BloomFPR);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--batch") == 0) {
+        stat = bench_batch(tst_tree_root(tree), TOPK);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--cache") == 0) {
+        stat = bench_cache(tree, LMAX);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--engines") == 0) {
+        stat = bench_engines(REF, TOPK);
+        goto quit;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--radix") == 0) {
+        stat = bench_radix(REF, TOPK);
+        goto quit;
+    }
+
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--suite") == 0) {
+        bench_suite_cfg cfg = {
+            .mode = REF ? "cpy" : "ref",
+            .workloads = argc == 4 ? argv[3] : NULL,
+            .out = REF ? "bench_suite_cpy" : "bench_suite_ref",
+            .batch = SUITE_BATCH,
+            .warmup = SUITE_WARMUP,
+            .repeat = SUITE_REPEAT,
+            .max = TOPK,
+        };
+        stat = bench_suite(tree, bloom, &cfg);
+        goto quit;
     }
 
     FILE *output;
@@ -121,6 +322,9 @@ int main(int argc, char **argv)
             " a  add word to the tree\n"
             " f  find word in tree\n"
             " s  search words matching prefix\n"
+            " t  top 10 words matching prefix\n"
+            " z  search words within 2 edits\n"
+            " r  list words in a range\n"
             " d  delete word from the tree\n"
             " q  quit, freeing all data\n\n"
             "choice: ");
@@ -132,6 +336,11 @@ int main(int argc, char **argv)
 
         switch (*word) {
         case 'a':
+            /* room for a whole line, Top is read into before the insert */
+            if (CPYmask && Top + WRDMAX > pool + poolsize) {
+                fprintf(stderr, "error: word pool exhausted.\n");
+                break;
+            }
             printf("enter word to add: ");
             if (argc > 2 && strcmp(argv[1], "--bench") == 0)
                 strcpy(Top, argv[4]);
@@ -141,19 +350,28 @@ int main(int argc, char **argv)
             }
             rmcrlf(Top);
 
+            pv = (perfcnt_val){0};
+            perfcnt_start(pc);
             t1 = tvgetf();
-            if (bloom_test(bloom, Top)) /* if detected by filter, skip */
-                res = NULL;
-            else { /* update via tree traversal and bloom filter */
-                bloom_add(bloom, Top);
-                res = tst_ins(&root, Top, REF);
+            {
+                /* the filter holds each distinct word once: a word it has
+                 * never seen is new, on a maybe the tree decides.
+                 */
+                const char *k = query_key(norm, Top, key);
+                int fresh =
+                    !bloom_count_test(bloom, k) || !tst_tree_search(tree, Top);
+                res = wal ? tst_log_ins(wal, Top, 0) : tst_tree_ins(tree, Top);
+                if (res && fresh)
+                    bloom_count_add(bloom, k);
             }
             t2 = tvgetf();
+            perfcnt_stop(pc, &pv);
             if (res) {
                 idx++;
                 Top += (strlen(Top) + 1) & CPYmask;
                 printf("  %s - inserted in %.10f sec. (%d words in tree)\n",
                        (char *) res, t2 - t1, idx);
+                perfcnt_print(stdout, "insert", &pv, 1);
             }
 
             if (argc > 2 && strcmp(argv[1], "--bench") == 0)  // a for auto
@@ -168,22 +386,23 @@ int main(int argc, char **argv)
             rmcrlf(word);
             t1 = tvgetf();
 
-            if (bloom_test(bloom, word)) {
+            if (bloom_count_test(bloom, query_key(norm, word, key))) {
                 t2 = tvgetf();
                 printf("  Bloomfilter found %s in %.6f sec.\n", word, t2 - t1);
-                printf(
-                    "  Probability of false positives:%lf\n",
-                    pow(1 - exp(-(double) HashNumber /
-                                (double) ((double) TableSize / (double) idx)),
-                        HashNumber));
+                printf("  Probability of false positives:%lf\n",
+                       bloom_count_fpr(bloom, idx));
+                pv = (perfcnt_val){0};
+                perfcnt_start(pc);
                 t1 = tvgetf();
-                res = tst_search(root, word);
+                res = tst_tree_search(tree, word);
                 t2 = tvgetf();
+                perfcnt_stop(pc, &pv);
                 if (res)
                     printf("  ----------\n  Tree found %s in %.6f sec.\n",
                            (char *) res, t2 - t1);
                 else
                     printf("  ----------\n  %s not found by tree.\n", word);
+                perfcnt_print(stdout, "search", &pv, 1);
             } else
                 printf("  %s not found by bloom filter.\n", word);
             break;
@@ -197,11 +416,16 @@ int main(int argc, char **argv)
                 break;
             }
             rmcrlf(word);
+            pv = (perfcnt_val){0};
+            perfcnt_start(pc);
             t1 = tvgetf();
-            res = tst_search_prefix(root, word, sgl, &sidx, LMAX);
+            res = tst_tree_search_prefix(tree, word, sgl, &sidx, LMAX);
             t2 = tvgetf();
+            perfcnt_stop(pc, &pv);
             if (res) {
-                printf("  %s - searched prefix in %.6f sec\n\n", word, t2 - t1);
+                printf("  %s - searched prefix in %.6f sec\n", word, t2 - t1);
+                perfcnt_print(stdout, "prefix search", &pv, 1);
+                printf("\n");
                 for (int i = 0; i < sidx; i++)
                     printf("suggest[%d] : %s\n", i, sgl[i]);
             } else
@@ -210,6 +434,80 @@ int main(int argc, char **argv)
             if (argc > 2 && strcmp(argv[1], "--bench") == 0)  // a for auto
                 goto quit;
             break;
+        case 't':
+            printf("find top words matching prefix (at least 1 char): ");
+
+            if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+                strcpy(word, argv[4]);
+            else if (!fgets(word, sizeof word, stdin)) {
+                fprintf(stderr, "error: insufficient input.\n");
+                break;
+            }
+            rmcrlf(word);
+            t1 = tvgetf();
+            res = tst_search_prefix_topk(tst_tree_root(tree),
+                                         query_key(norm, word, key), sgl,
+                                         &sidx, TOPK);
+            t2 = tvgetf();
+            if (res) {
+                printf("  %s - searched top %d in %.6f sec\n\n", word, TOPK,
+                       t2 - t1);
+                for (int i = 0; i < sidx; i++)
+                    printf("top[%d] : %s\n", i, sgl[i]);
+            } else
+                printf("  %s - not found\n", word);
+
+            if (argc > 2 && strcmp(argv[1], "--bench") == 0)  // a for auto
+                goto quit;
+            break;
+        case 'z':
+            printf("find words within %d edits: ", FUZZYDIST);
+            if (!fgets(word, sizeof word, stdin)) {
+                fprintf(stderr, "error: insufficient input.\n");
+                break;
+            }
+            rmcrlf(word);
+            t1 = tvgetf();
+            res = tst_search_fuzzy(tst_tree_root(tree),
+                                   query_key(norm, word, key), FUZZYDIST, sgl,
+                                   &sidx, LMAX);
+            t2 = tvgetf();
+            if (res) {
+                printf("  %s - fuzzy searched in %.6f sec\n\n", word, t2 - t1);
+                for (int i = 0; i < sidx; i++)
+                    printf("fuzzy[%d] : %s\n", i, sgl[i]);
+            } else
+                printf("  %s - not found\n", word);
+            break;
+        case 'r': {
+            tst_iter *it;
+            char *w;
+
+            printf("list words from: ");
+            if (!fgets(word, sizeof word, stdin)) {
+                fprintf(stderr, "error: insufficient input.\n");
+                break;
+            }
+            printf("up to (empty for no bound): ");
+            if (!fgets(hi, sizeof hi, stdin)) {
+                fprintf(stderr, "error: insufficient input.\n");
+                break;
+            }
+            rmcrlf(word);
+            rmcrlf(hi);
+            t1 = tvgetf();
+            it = tst_range(tst_tree_root(tree), query_key(norm, word, key),
+                           *hi ? query_key(norm, hi, hikey) : NULL);
+            for (sidx = 0; it && sidx < LMAX && (w = tst_iter_next(it));)
+                sgl[sidx++] = w;
+            t2 = tvgetf();
+            tst_iter_end(it);
+            printf("  %s - listed %d words in %.6f sec\n\n", word, sidx,
+                   t2 - t1);
+            for (int i = 0; i < sidx; i++)
+                printf("range[%d] : %s\n", i, sgl[i]);
+            break;
+        }
         case 'd':
             printf("enter word to del: ");
             if (!fgets(word, sizeof word, stdin)) {
@@ -218,14 +516,20 @@ int main(int argc, char **argv)
             }
             rmcrlf(word);
             printf("  deleting %s\n", word);
+            pv = (perfcnt_val){0};
+            perfcnt_start(pc);
             t1 = tvgetf();
             /* FIXME: remove reference to each string */
-            res = tst_del(&root, word, REF);
+            res = wal ? tst_log_del(wal, word) : tst_tree_del(tree, word);
+            if (!res) /* last occurrence gone, drop it from the filter */
+                bloom_count_remove(bloom, query_key(norm, word, key));
             t2 = tvgetf();
+            perfcnt_stop(pc, &pv);
             if (res)
                 printf("  delete failed.\n");
             else {
                 printf("  deleted %s in %.6f sec\n", word, t2 - t1);
+                perfcnt_print(stdout, "delete", &pv, 1);
                 idx--;
             }
             break;
@@ -238,13 +542,13 @@ int main(int argc, char **argv)
     }
 
 quit:
+    perfcnt_close(pc);
+    /* strings are freed with the tree for CPY mechanism */
+    tst_tree_free(tree);
+    tst_log_close(wal); /* after the tree, it may reference recovered words */
     free(pool);
-    /* for REF mechanism */
-    if (CPYmask)
-        tst_free(root);
-    else
-        tst_free_all(root);
-
-    bloom_free(bloom);
-    return 0;
+    text_unmap(&txt);
+
+    bloom_count_free(bloom);
+    return stat;
 }
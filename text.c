@@ -0,0 +1,140 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "text.h"
+
+/** zero bytes mapped past the file, a block load starting inside the file
+ *  never reaches beyond them.
+ */
+#define TEXT_PAD 64
+
+/** text_mask() returns the mask of the bytes of 'p[0..64)' that end a token,
+ *  a comma, a newline or the nul-character the padding starts with.
+ */
+static uint64_t text_mask(const char *p)
+{
+    uint64_t mask = 0;
+
+#if defined(__AVX2__)
+    const __m256i comma = _mm256_set1_epi8(','), nl = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    for (int i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+        __m256i d = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, comma),
+                            _mm256_cmpeq_epi8(v, nl)),
+            _mm256_cmpeq_epi8(v, zero));
+        mask |= (uint64_t)(uint32_t) _mm256_movemask_epi8(d) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(','), nl = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        __m128i d = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, nl)),
+            _mm_cmpeq_epi8(v, zero));
+        mask |= (uint64_t)(uint16_t) _mm_movemask_epi8(d) << i;
+    }
+#else
+    for (int i = 0; i < 64; i++)
+        if (p[i] == ',' || p[i] == '\n' || !p[i])
+            mask |= 1ULL << i;
+#endif
+    return mask;
+}
+
+int text_map(text *t, const char *path)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    struct stat st;
+    char *base;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    t->size = st.st_size;
+    t->maplen = (t->size + TEXT_PAD + page - 1) / page * page;
+
+    /* reserve zeroed pages for the file and its padding, then map the file
+     * over the front of them: a load past the end of the file finds zeros
+     * where the file alone would raise SIGBUS
+     */
+    base = mmap(NULL, t->maplen, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (t->size && mmap(base, t->size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, t->maplen);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    madvise(base, t->size, MADV_SEQUENTIAL);
+
+    t->base = t->start = t->blk = base;
+    t->mask = text_mask(base);
+    t->line = 0;
+    return 0;
+}
+
+char *text_token(text *t, unsigned *line)
+{
+    char *end = t->base + t->size;
+
+    for (;;) {
+        while (!t->mask) {
+            t->blk += 64;
+            if (t->blk > end)
+                return NULL;
+            t->mask = text_mask(t->blk);
+        }
+
+        char *d = t->blk + __builtin_ctzll(t->mask), *tok = t->start;
+        unsigned tline = t->line;
+        t->mask &= t->mask - 1;
+        if (d < t->start) /* the space skipped after a comma */
+            continue;
+
+        if (d >= end) { /* the padding, the last token ends at the file */
+            t->start = d;
+            t->blk = end;
+            t->mask = 0;
+        } else if (*d == '\n') {
+            t->start = d + 1;
+            t->line++;
+        } else {
+            t->start = d + 1 + (d[1] == ' ' && d + 1 < end);
+        }
+        *d = 0;
+        if (d > tok) {
+            if (line)
+                *line = tline;
+            return tok;
+        }
+        if (d >= end)
+            return NULL;
+    }
+}
+
+void text_unmap(text *t)
+{
+    if (t->base)
+        munmap(t->base, t->maplen);
+    t->base = NULL;
+}
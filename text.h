@@ -0,0 +1,37 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** a dictionary file mapped private and writable. Tokens are terminated in
+ *  place, the writes land in copy-on-write pages of the mapping and never
+ *  reach the file, so the words can be handed to a tree by reference for
+ *  as long as the mapping lives.
+ */
+typedef struct text {
+    char *base;    /* file contents, zero padded past the end */
+    size_t size;   /* bytes of the file */
+    size_t maplen; /* bytes mapped */
+    char *start;   /* start of the next token */
+    char *blk;     /* 64 byte block being split */
+    uint64_t mask; /* delimiters of 'blk' not consumed yet */
+    unsigned line; /* line of 'start', from 0 */
+} text;
+
+/** text_map() map the file at 'path' into 't'. returns 0 on success, -1 on
+ *  error with errno set.
+ */
+int text_map(text *t, const char *path);
+
+/** text_token() returns the next token, NULL past the last one. Tokens
+ *  are split at commas and newlines and a space after a comma is skipped,
+ *  so "city, country" gives two tokens. Empty tokens are skipped. The
+ *  line of the token is stored in 'line' if non-NULL.
+ */
+char *text_token(text *t, unsigned *line);
+
+/** text_unmap() release the mapping, the tokens go with it. */
+void text_unmap(text *t);
+
+#endif
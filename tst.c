@@ -1,18 +1,284 @@
+#include <limits.h>
+#include <pthread.h>
+
 #include "tst.h"
+#include "tst_epoch.h"
+#include "utf8.h"
 
 /** max word length to store in ternary search tree, stack size */
 #define WRDMAX 128
 #define STKMAX (WRDMAX * 2)
 
+/** child pointers readers may load while a concurrent writer publishes
+ *  them: nodes are fully built before the release store linking them.
+ */
+#define LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
 /** ternary search tree node. */
 typedef struct tst_node {
     char key;               /* char key for node (null for node with string) */
     unsigned refcnt;        /* refcnt tracks occurrence of word (for delete) */
+    unsigned score;         /* score of the word (node with string only) */
+    unsigned maxscore;      /* highest word score in the node subtree */
     struct tst_node *lokid; /* ternary low child pointer */
     struct tst_node *eqkid; /* ternary equal child pointer */
     struct tst_node *hikid; /* ternary high child pointer */
 } tst_node;
 
+/** number of nodes carved from each pool chunk. */
+#define POOLCHUNK 4096
+
+/** chunk of contiguous nodes owned by a node pool. */
+typedef struct tst_chunk {
+    struct tst_chunk *next;
+    tst_node nodes[POOLCHUNK];
+} tst_chunk;
+
+/** bytes of each string heap chunk and longest string the heap holds, a
+ *  normalized tree keys words by their folded form only, so the spelling
+ *  stored can be longer than a key.
+ */
+#define HEAPCHUNK 65536
+#define HEAPWORD 1024
+
+/** chunk of packed strings, each stored as a 2 byte big endian length
+ *  followed by the nul-terminated string, the length counting neither.
+ */
+typedef struct tst_strchunk {
+    struct tst_strchunk *next;
+    size_t used;
+    char buf[HEAPCHUNK];
+} tst_strchunk;
+
+/** append-only string heap of a copying tree. Words are packed in order in
+ *  the newest chunk, a delete only counts the bytes it leaves dead and the
+ *  heap is compacted once they outweigh the live ones.
+ */
+typedef struct tst_heap {
+    tst_strchunk *chunks; /* newest chunk first */
+    tst_strchunk *spare;  /* chunks reserved for a compaction */
+    size_t live, dead;    /* bytes of stored and of deleted strings */
+} tst_heap;
+
+/** node pool, nodes are carved in order from the newest chunk and nodes
+ *  released by delete are kept on a free list threaded through 'eqkid'.
+ */
+typedef struct tst_pool {
+    tst_chunk *chunks; /* newest chunk first */
+    size_t used;       /* nodes handed out from the newest chunk */
+    tst_node *free;    /* released nodes available for reuse */
+    tst_epoch *epoch;  /* defers releases in concurrent mode, else NULL */
+    tst_heap heap;     /* copied strings, unused in concurrent mode */
+} tst_pool;
+
+/** cached result of a prefix search, its 'n' word pointers followed by the
+ *  prefix in one block. Entries of a hash bucket are chained through
+ *  'next', and so are free entries.
+ */
+typedef struct tst_cent {
+    char **words;  /* words found then the prefix, NULL if free */
+    void *res;     /* what tst_search_prefix() returned */
+    unsigned hash; /* hash of the prefix */
+    int len;       /* length of the prefix */
+    int max, n;    /* words asked for and found */
+    int next;      /* next entry of the chain, -1 at the end */
+    int ref;       /* set on a hit, cleared as the CLOCK hand passes */
+} tst_cent;
+
+/** bounded prefix result cache of a tree, CLOCK eviction. */
+typedef struct tst_cache {
+    tst_cent *ent;       /* 'cap' entries */
+    int *bucket;         /* first entry of each chain, -1 if empty */
+    unsigned mask;       /* buckets - 1, a power of two minus one */
+    int cap, hand, free; /* entries, CLOCK hand, first free entry */
+    size_t bytes;        /* bytes held by the entries */
+    tst_cache_stats st;
+} tst_cache;
+
+/** tree handle, owns the root and the node pool. */
+struct tst_tree {
+    tst_node *root;
+    tst_pool pool;
+    tst_cache *cache; /* prefix results, NULL if not enabled */
+    int cpy;          /* non-zero if the tree stores copies of the strings */
+    int norm;         /* non-zero if words are keyed by utf8_fold() */
+    /* words removed per leading byte since its subtree was rebalanced */
+    size_t churn[256];
+};
+
+/** tst_node_alloc() returns a zeroed node, from 'pool' if non-NULL,
+ *  otherwise from the heap. returns NULL on allocation failure.
+ */
+static tst_node *tst_node_alloc(tst_pool *pool)
+{
+    tst_node *node;
+
+    if (!pool)
+        return calloc(1, sizeof(tst_node));
+
+    if (pool->free) {
+        node = pool->free;
+        pool->free = node->eqkid;
+    } else {
+        if (!pool->chunks || pool->used == POOLCHUNK) {
+            tst_chunk *chunk = malloc(sizeof *chunk);
+            if (!chunk)
+                return NULL;
+            chunk->next = pool->chunks;
+            pool->chunks = chunk;
+            pool->used = 0;
+        }
+        node = &pool->chunks->nodes[pool->used++];
+    }
+    memset(node, 0, sizeof *node);
+    return node;
+}
+
+static void tst_node_recycle(void *node, void *pool)
+{
+    ((tst_node *) node)->eqkid = ((tst_pool *) pool)->free;
+    ((tst_pool *) pool)->free = node;
+}
+
+static void tst_word_free(void *s, void *unused)
+{
+    (void) unused;
+    free(s);
+}
+
+/** tst_heap_dup() append a copy of 's' to 'h', returns the copy, NULL on
+ *  allocation failure or if 's' is longer than HEAPWORD.
+ */
+static char *tst_heap_dup(tst_heap *h, const char *s)
+{
+    size_t len = strlen(s);
+    tst_strchunk *c = h->chunks;
+    char *p;
+
+    if (len + 3 > HEAPWORD)
+        return NULL;
+    if (!c || c->used + len + 3 > HEAPCHUNK) {
+        if ((c = h->spare))
+            h->spare = c->next;
+        else if (!(c = malloc(sizeof *c)))
+            return NULL;
+        c->next = h->chunks;
+        c->used = 0;
+        h->chunks = c;
+    }
+    p = c->buf + c->used;
+    *p++ = len >> 8;
+    *p++ = len;
+    memcpy(p, s, len + 1);
+    c->used += len + 3;
+    h->live += len + 3;
+    return p;
+}
+
+/** tst_heap_drop() count the copy 's' of 'h' as dead, its bytes are only
+ *  reclaimed by tst_heap_compact().
+ */
+static void tst_heap_drop(tst_heap *h, const char *s)
+{
+    const unsigned char *u = (const unsigned char *) s;
+    size_t bytes = (u[-2] << 8 | u[-1]) + 3;
+
+    h->live -= bytes;
+    h->dead += bytes;
+}
+
+/** tst_heap_move() copy the word of every terminal node below 'p' to 'h'
+ *  in tree order, so words sharing a prefix end up side by side.
+ */
+static void tst_heap_move(tst_node *p, tst_heap *h)
+{
+    if (!p)
+        return;
+    tst_heap_move(p->lokid, h);
+    if (p->key)
+        tst_heap_move(p->eqkid, h);
+    else if (p->eqkid)
+        p->eqkid = (tst_node *) tst_heap_dup(h, (char *) p->eqkid);
+    tst_heap_move(p->hikid, h);
+}
+
+static void tst_heap_free(tst_heap *h)
+{
+    for (int i = 0; i < 2; i++) {
+        tst_strchunk *c = i ? h->spare : h->chunks;
+        while (c) {
+            tst_strchunk *next = c->next;
+            free(c);
+            c = next;
+        }
+    }
+    *h = (tst_heap){NULL};
+}
+
+/** tst_heap_compact() repack the live words of the tree at 'root' into
+ *  fresh chunks and drop the old ones. Every chunk is reserved before a
+ *  word moves, the heap is left as is on allocation failure. returns 0 on
+ *  success, -1 otherwise.
+ */
+static int tst_heap_compact(tst_heap *h, tst_node *root)
+{
+    /* a chunk wastes less than the longest word at its end */
+    size_t n = h->live / (HEAPCHUNK - HEAPWORD) + 1;
+    tst_heap fresh = {NULL};
+
+    for (size_t i = 0; i < n; i++) {
+        tst_strchunk *c = malloc(sizeof *c);
+        if (!c) {
+            tst_heap_free(&fresh);
+            return -1;
+        }
+        c->next = fresh.spare;
+        fresh.spare = c;
+    }
+    tst_heap_move(root, &fresh);
+    tst_heap_free(h);
+    *h = fresh;
+    return 0;
+}
+
+/** tst_word_copy() returns a copy of 's' for a copying tree, packed in the
+ *  heap of 'pool' unless the tree is concurrent (strings then move to no
+ *  heap a reader could still be scanning) or there is no pool.
+ */
+static char *tst_word_copy(tst_pool *pool, const char *s)
+{
+    if (pool && !pool->epoch)
+        return tst_heap_dup(&pool->heap, s);
+    return strdup(s);
+}
+
+/** tst_node_release() returns 'node' to 'pool', or to the heap if NULL.
+ *  In concurrent mode the node is only recycled once readers are done.
+ */
+static void tst_node_release(tst_pool *pool, tst_node *node)
+{
+    if (!pool)
+        free(node);
+    else if (pool->epoch)
+        tst_epoch_retire(pool->epoch, node, tst_node_recycle, pool);
+    else
+        tst_node_recycle(node, pool);
+}
+
+/** tst_word_release() free a copied word, deferred in concurrent mode and
+ *  left to the next compaction of a string heap.
+ */
+static void tst_word_release(tst_pool *pool, void *s)
+{
+    if (!pool)
+        free(s);
+    else if (pool->epoch)
+        tst_epoch_retire(pool->epoch, s, tst_word_free, NULL);
+    else
+        tst_heap_drop(&pool->heap, s);
+}
+
 /** struct to use for static stack to remove nodes. */
 typedef struct tst_stack {
     void *data[STKMAX];
@@ -51,7 +317,7 @@ static void *tst_stack_pop(tst_stack *s)
  *  NULL on success (deleted), otherwise returns the address of victim
  *  if refcnt non-zero.
  */
-static void *tst_del_word(tst_stack *stk, const int freeword)
+static void *tst_del_word(tst_stack *stk, const int freeword, tst_pool *pool)
 {
     tst_node **pvictim = tst_stack_pop(stk);
     tst_node *victim = *pvictim;
@@ -65,16 +331,18 @@ static void *tst_del_word(tst_stack *stk, const int freeword)
         return victim;
     }
 
+    void *word = victim->eqkid;
+    STORE(victim->eqkid, NULL);
     if (freeword) /* Free the string in CPY mode. */
-        free(victim->eqkid);
-    victim->eqkid = NULL;
+        tst_word_release(pool, word);
+    victim->score = 0;
 
     /* Remove unique suffix chain - victim have no children.
      * Simply remove until the first node found with children.
      */
     while (!victim->lokid && !victim->hikid && !victim->eqkid) {
-        free(victim);
-        *pvictim = NULL;
+        STORE(*pvictim, NULL);
+        tst_node_release(pool, victim);
         pvictim = tst_stack_pop(stk);
         if (!pvictim) {
             /* Stack empty, which means reached the root of the tree. */
@@ -105,20 +373,20 @@ static void *tst_del_word(tst_stack *stk, const int freeword)
          * and left a node with no 'eqkid'.
          */
         if (!victim->lokid->hikid) {
-            victim->lokid->hikid = victim->hikid;
-            *pvictim = victim->lokid;
+            STORE(victim->lokid->hikid, victim->hikid);
+            STORE(*pvictim, victim->lokid);
         } else if (!victim->hikid->lokid) {
-            victim->hikid->lokid = victim->lokid;
-            *pvictim = victim->hikid;
+            STORE(victim->hikid->lokid, victim->lokid);
+            STORE(*pvictim, victim->hikid);
         } else /* The subtrees are non-rotatable. */
             return NULL;
     } else if (victim->lokid) {
-        *pvictim = victim->lokid;
+        STORE(*pvictim, victim->lokid);
     } else if (victim->hikid) {
-        *pvictim = victim->hikid;
+        STORE(*pvictim, victim->hikid);
     }
 
-    free(victim);
+    tst_node_release(pool, victim);
     return NULL;
 }
 
@@ -140,15 +408,46 @@ static tst_node **next_node(tst_node **root, const char **s)
     return root;
 }
 
-/** tst_del() del copy or reference of 's' from ternary search tree.
- *  If 's' already exists in tree, decrement node->refcnt.
- *  If node->refcnt is zero after decrement, remove assoshiated nodes.
- *  If 'cpy' is non-zero, free the allocated space of string.
- *  Returns the address of 's' in tree on delete if refcnt non-zero,
- *  -1 on 's' not found in ternary search tree,
- *  otherwise returns NULL.
+/** tst_maxscore() the highest word score below 'p' from its kids. */
+static unsigned tst_maxscore(const tst_node *p)
+{
+    unsigned max = p->score;
+
+    if (p->key && p->eqkid)
+        max = p->eqkid->maxscore;
+    if (p->lokid && p->lokid->maxscore > max)
+        max = p->lokid->maxscore;
+    if (p->hikid && p->hikid->maxscore > max)
+        max = p->hikid->maxscore;
+    return max;
+}
+
+/** tst_rescore() recompute 'maxscore' bottom up along the search path of
+ *  's', the only nodes whose subtree changes when 's' is deleted.
  */
-void *tst_del(tst_node **root, const char *s, const int cpy)
+static void tst_rescore(tst_node *p, const char *s)
+{
+    int diff;
+
+    if (!p)
+        return;
+    diff = *s - p->key;
+    if (diff == 0 && *s)
+        tst_rescore(p->eqkid, s + 1);
+    else if (diff < 0)
+        tst_rescore(p->lokid, s);
+    else if (diff > 0)
+        tst_rescore(p->hikid, s);
+    p->maxscore = tst_maxscore(p);
+}
+
+/** tst_del_node() delete 's' below 'root', releasing nodes to 'pool'
+ *  (heap if NULL). see tst_del() for the return values.
+ */
+static void *tst_del_node(tst_node **root,
+                          const char *s,
+                          const int cpy,
+                          tst_pool *pool)
 {
     const char *p = s;
     tst_stack stk = {.data = {NULL}, .idx = 0};
@@ -156,31 +455,70 @@ void *tst_del(tst_node **root, const char *s, const int cpy)
 
     if (!root || !s)
         return NULL;                /* validate parameters */
-    if (strlen(s) + 1 > STKMAX / 2) /* limit length to 1/2 STKMAX */
-        return NULL;                /* 128 char word length is plenty */
+    if (strlen(s) + 1 > STKMAX / 2) /* never inserted, so not found */
+        return (void *) -1;
 
     pcurr = root;
     while ((curr = *pcurr)) {
         tst_stack_push(&stk, pcurr); /* push ptr to node on stack for del */
         if (*p == 0 && curr->key == 0) {
+            if (!curr->eqkid) /* word left behind by a previous delete */
+                return (void *) -1;
+            void *res;
             (*pcurr)->refcnt--;
-            return tst_del_word(&stk, cpy);
+            if (!(res = tst_del_word(&stk, cpy, pool)))
+                tst_rescore(*root, s);
+            return res;
         }
         pcurr = next_node(pcurr, &p);
     }
     return (void *) -1;
 }
 
-/** tst_ins() insert copy or reference of 's' from ternary search tree.
- *  insert all nodes required for 's' in tree at eqkid node of leaf.
- *  Insert 's' at node->eqkid with node->key set to the nul-character after
- *  final node in search path.
- *  If 'cpy' is non-zero allocate storage for 's', otherwise save pointer to
- *  's'. If 's' already exists in tree, increment node->refcnt. (to be used
- *  for del). returns address of 's' in tree on successful insert , NULL on
- *  allocation failure.
+/** tst_del() del copy or reference of 's' from ternary search tree.
+ *  If 's' already exists in tree, decrement node->refcnt.
+ *  If node->refcnt is zero after decrement, remove assoshiated nodes.
+ *  If 'cpy' is non-zero, free the allocated space of string.
+ *  Returns the address of 's' in tree on delete if refcnt non-zero,
+ *  -1 on 's' not found in ternary search tree,
+ *  otherwise returns NULL.
  */
-void *tst_ins(tst_node **root, const char *s, const int cpy)
+void *tst_del(tst_node **root, const char *s, const int cpy)
+{
+    return tst_del_node(root, s, cpy, NULL);
+}
+
+/** tst_store() set the final node 'curr' of 's' to hold a copy of 's' if
+ *  'cpy' is non-zero, a pointer to 's' otherwise, with a refcnt of 1.
+ *  returns the stored string, NULL on allocation failure.
+ */
+static void *tst_store(tst_node *curr,
+                       const char *s,
+                       const int cpy,
+                       tst_pool *pool)
+{
+    if (cpy) { /* allocate storage for 's' */
+        const char *eqdata = tst_word_copy(pool, s);
+        if (!eqdata)
+            return NULL;
+        STORE(curr->eqkid, (tst_node *) eqdata);
+    } else /* save pointer to 's' (allocated elsewhere) */
+        STORE(curr->eqkid, (tst_node *) s);
+    curr->refcnt = 1;
+    return (void *) curr->eqkid;
+}
+
+/** tst_ins_node() insert 'word' under the key 's' with 'score' below
+ *  'root', taking new nodes from 'pool' (heap if NULL). the key is the
+ *  word itself except in a normalized tree, where the first spelling of a
+ *  key is the one stored. see tst_ins() for the return values.
+ */
+static void *tst_ins_node(tst_node **root,
+                          const char *s,
+                          const char *word,
+                          const int cpy,
+                          const unsigned score,
+                          tst_pool *pool)
 {
     const char *p = s;
     tst_node *curr, **pcurr;
@@ -192,45 +530,89 @@ void *tst_ins(tst_node **root, const char *s, const int cpy)
 
     pcurr = root;
     while ((curr = *pcurr)) {
+        if (curr->maxscore < score) /* 's' joins the subtree of 'curr' */
+            curr->maxscore = score;
         if (*p == 0 && curr->key == 0) {
+            if (!curr->eqkid) { /* revive node left behind by a delete */
+                curr->score = score;
+                return tst_store(curr, word, cpy, pool);
+            }
+            if (curr->score < score) /* a word keeps its best score */
+                curr->score = score;
             curr->refcnt++;
             return (void *) curr->eqkid;
         }
         pcurr = next_node(pcurr, &p);
     }
 
-    /* if not duplicate, insert remaining chars into tree rooted at curr */
+    /* if not duplicate, build the remaining chars as a chain off the tree
+     * and link it at curr last, so a concurrent reader sees all or none.
+     */
+    tst_node *chain = NULL, **plink = &chain;
+    void *res;
     for (;;) {
-        /* allocate memory for node, and fill. use calloc (or include
-         * string.h and initialize w/memset) to avoid valgrind warning
+        /* allocate memory for node, and fill. nodes are zeroed (calloc or
+         * memset in the pool) to avoid valgrind warning
          * "Conditional jump or move depends on uninitialised value(s)"
          */
-        if (!(*pcurr = calloc(1, sizeof **pcurr))) {
+        if (!(*plink = tst_node_alloc(pool))) {
             fprintf(stderr, "error: tst_insert(), memory exhausted.\n");
-            return NULL;
+            res = NULL;
+            break;
         }
-        curr = *pcurr;
+        curr = *plink;
         curr->key = *p;
         curr->refcnt = 1;
+        curr->maxscore = score;
         curr->lokid = curr->hikid = curr->eqkid = NULL;
 
         /* Place nodes until end of the string, at end of stign allocate
          * space for data, copy data as final eqkid, and return.
          */
         if (*p++ == 0) {
-            if (cpy) { /* allocate storage for 's' */
-                const char *eqdata = strdup(s);
-                if (!eqdata)
-                    return NULL;
-                curr->eqkid = (tst_node *) eqdata;
-                return (void *) eqdata;
-            } else { /* save pointer to 's' (allocated elsewhere) */
-                curr->eqkid = (tst_node *) s;
-                return (void *) s;
-            }
+            curr->score = score;
+            res = tst_store(curr, word, cpy, pool);
+            break;
         }
-        pcurr = &(curr->eqkid);
+        plink = &(curr->eqkid);
+    }
+
+    if (res) {
+        STORE(*pcurr, chain);
+        return res;
     }
+    while (chain) { /* drop the unlinked chain, never seen by readers */
+        tst_node *next = chain->key ? chain->eqkid : NULL;
+        if (pool)
+            tst_node_recycle(chain, pool);
+        else
+            free(chain);
+        chain = next;
+    }
+    return NULL;
+}
+
+/** tst_ins() insert copy or reference of 's' from ternary search tree.
+ *  insert all nodes required for 's' in tree at eqkid node of leaf.
+ *  Insert 's' at node->eqkid with node->key set to the nul-character after
+ *  final node in search path.
+ *  If 'cpy' is non-zero allocate storage for 's', otherwise save pointer to
+ *  's'. If 's' already exists in tree, increment node->refcnt. (to be used
+ *  for del). returns address of 's' in tree on successful insert , NULL on
+ *  allocation failure.
+ */
+void *tst_ins(tst_node **root, const char *s, const int cpy)
+{
+    return tst_ins_node(root, s, s, cpy, 0, NULL);
+}
+
+/** tst_ins_score() tst_ins() attaching 'score' to 's', see tst.h. */
+void *tst_ins_score(tst_node **root,
+                    const char *s,
+                    const int cpy,
+                    const unsigned score)
+{
+    return tst_ins_node(root, s, s, cpy, score, NULL);
 }
 
 /** tst_search(), non-recursive find of a string internary tree.
@@ -244,37 +626,33 @@ void *tst_search(const tst_node *p, const char *s)
         int diff = *s - curr->key; /* calculate the difference */
         if (diff == 0) {           /* handle the equal case */
             if (*s == 0)           /* if *s = curr->key = nul-char, 's' found */
-                return (void *) curr->eqkid; /* return pointer to 's' */
+                return (void *) LOAD(curr->eqkid); /* return pointer to 's' */
             s++;
-            curr = curr->eqkid;
+            curr = LOAD(curr->eqkid);
         } else if (diff < 0) /* handle the less than case */
-            curr = curr->lokid;
+            curr = LOAD(curr->lokid);
         else
-            curr = curr->hikid; /* handle the greater than case */
+            curr = LOAD(curr->hikid); /* handle the greater than case */
     }
     return NULL;
 }
 
-/** fill ptr array 'a' with strings matching prefix at node 'p'.
- *  the 'a' array will hold pointers to stored strings with prefix
- *  matching the string passed to tst_matching, ending in 'c', the
- *  nchr'th char in in each matched string.
+/** fill ptr array 'a' with the strings stored in the subtree at 'p',
+ *  the eq kid of the node matching the last char of the prefix. every
+ *  word below it has the prefix, so the stored strings are not compared
+ *  (in a normalized tree they hold the original spelling, not the key).
  */
-void tst_suggest(const tst_node *p,
-                 const char c,
-                 const size_t nchr,
-                 char **a,
-                 int *n,
-                 const int max)
+static void tst_suggest(const tst_node *p, char **a, int *n, const int max)
 {
     if (!p || *n >= max)
         return;
-    tst_suggest(p->lokid, c, nchr, a, n, max);
+    tst_suggest(LOAD(p->lokid), a, n, max);
+    char *word = (char *) LOAD(p->eqkid);
     if (p->key)
-        tst_suggest(p->eqkid, c, nchr, a, n, max);
-    else if (*(((char *) p->eqkid) + nchr - 1) == c && *n < max)
-        a[(*n)++] = (char *) p->eqkid;
-    tst_suggest(p->hikid, c, nchr, a, n, max);
+        tst_suggest((tst_node *) word, a, n, max);
+    else if (word && *n < max)
+        a[(*n)++] = word;
+    tst_suggest(LOAD(p->hikid), a, n, max);
 }
 
 /** tst_search_prefix fills ptr array 'a' with words prefixed with 's'.
@@ -312,78 +690,1853 @@ void *tst_search_prefix(const tst_node *root,
             /* check if prefix number of chars reached */
             if ((size_t)(s - start) == nchr - 1) {
                 /* call tst_suggest to fill a with pointer to matching words */
-                tst_suggest(curr, curr->key, nchr, a, n, max);
+                tst_suggest(LOAD(curr->eqkid), a, n, max);
                 return (void *) curr;
             }
             if (*s == 0) /* no matching prefix found in tree */
-                return (void *) curr->eqkid;
+                return (void *) LOAD(curr->eqkid);
 
             s++;
-            curr = curr->eqkid;
+            curr = LOAD(curr->eqkid);
         } else if (diff < 0) /* handle the less than case */
-            curr = curr->lokid;
+            curr = LOAD(curr->lokid);
         else
-            curr = curr->hikid; /* handle the greater than case */
+            curr = LOAD(curr->hikid); /* handle the greater than case */
     }
     return NULL;
 }
 
-/** tst_traverse_fn(), traverse tree calling 'fn' on each word.
- *  prototype fonr 'fn' is void fn(const void *, void *). data can
- *  be NULL if unused.
+/** lookups a batch keeps in flight, enough misses to cover the latency. */
+#define BATCHWIN 16
+
+/** in flight lookup of a batch, the key left to match from 'curr'. */
+typedef struct tst_batch_ent {
+    const tst_node *curr;
+    const char *s;
+    size_t i; /* index of the key in the batch */
+} tst_batch_ent;
+
+/** tst_batch_step() advance 'e' by one node as tst_search() or, with
+ *  'prefix', as the descent of tst_search_prefix() does, and prefetch the
+ *  next node. returns non-zero once the lookup is over, its node in 'res'
+ *  (the word for a search, the node of the last prefix char otherwise).
  */
-void tst_traverse_fn(const tst_node *p,
-                     void(fn)(const void *, void *),
-                     void *data)
+static int tst_batch_step(tst_batch_ent *e, int prefix, const void **res)
 {
-    if (!p)
-        return;
-    tst_traverse_fn(p->lokid, fn, data);
-    if (p->key)
-        tst_traverse_fn(p->eqkid, fn, data);
+    const tst_node *curr = e->curr;
+    int diff;
+
+    if (!curr) {
+        *res = NULL;
+        return 1;
+    }
+    diff = *e->s - curr->key;
+    if (diff == 0) {
+        if (prefix && !e->s[1]) {
+            *res = curr;
+            return 1;
+        }
+        if (*e->s == 0) {
+            *res = LOAD(curr->eqkid);
+            return 1;
+        }
+        e->s++;
+        e->curr = LOAD(curr->eqkid);
+    } else if (diff < 0)
+        e->curr = LOAD(curr->lokid);
     else
-        fn(p, data);
-    tst_traverse_fn(p->hikid, fn, data);
+        e->curr = LOAD(curr->hikid);
+    __builtin_prefetch(e->curr);
+    return 0;
 }
 
-/** free the ternary search tree rooted at p, data storage internal. */
-void tst_free_all(tst_node *p)
+/** tst_batch_run() run the 'n' lookups of 'keys' below 'root' BATCHWIN at
+ *  a time in round robin, so while one waits on its prefetched node the
+ *  others make progress. the node each ends on is stored in 'res'.
+ */
+static void tst_batch_run(const tst_node *root,
+                          const char *const *keys,
+                          size_t n,
+                          int prefix,
+                          const void **res)
 {
-    if (!p)
+    tst_batch_ent win[BATCHWIN];
+    size_t next = 0, live = 0;
+
+    __builtin_prefetch(root);
+    while (live < BATCHWIN && next < n) {
+        if (prefix && !*keys[next]) { /* empty prefix, nothing to match */
+            res[next++] = NULL;
+            continue;
+        }
+        win[live++] = (tst_batch_ent){.curr = root, .s = keys[next],
+                                      .i = next};
+        next++;
+    }
+    while (live) {
+        for (size_t j = 0; j < live;) {
+            const void *node;
+            if (!tst_batch_step(&win[j], prefix, &node)) {
+                j++;
+                continue;
+            }
+            res[win[j].i] = node;
+            /* refill the slot with the next key, or shrink the window */
+            while (next < n && prefix && !*keys[next])
+                res[next++] = NULL;
+            if (next < n) {
+                win[j] = (tst_batch_ent){.curr = root, .s = keys[next],
+                                         .i = next};
+                next++;
+            } else
+                win[j] = win[--live];
+        }
+    }
+}
+
+/** tst_search_batch() tst_search() for 'n' keys at once, see tst.h. */
+void tst_search_batch(const tst_node *root,
+                      const char *const *keys,
+                      size_t n,
+                      void **res)
+{
+    tst_batch_run(root, keys, n, 0, (const void **) res);
+}
+
+/** tst_search_prefix_batch() tst_search_prefix() for 'n' prefixes at once,
+ *  see tst.h.
+ */
+void tst_search_prefix_batch(const tst_node *root,
+                             const char *const *keys,
+                             size_t n,
+                             char **a,
+                             int *cnt,
+                             const int max,
+                             void **res)
+{
+    tst_batch_run(root, keys, n, 1, (const void **) res);
+    for (size_t i = 0; i < n; i++) {
+        const tst_node *curr = res[i];
+        cnt[i] = 0;
+        if (curr)
+            tst_suggest(LOAD(curr->eqkid), a + i * max, &cnt[i], max);
+    }
+}
+
+/** state of a fuzzy search, the Levenshtein rows of the current path. */
+typedef struct tst_fuzzy {
+    const char *s;
+    size_t len;   /* length of 's', each row holds len + 1 distances */
+    int maxdist;  /* largest edit distance accepted */
+    int prefix;   /* match words with a prefix within maxdist */
+    int *rows;    /* row of depth d at rows + d * (len + 1) */
+    char **a;
+    int *n;
+    int max;
+} tst_fuzzy;
+
+/** append every word below 'p' to the fuzzy results, in order. */
+static void tst_fuzzy_all(const tst_node *p, tst_fuzzy *f)
+{
+    if (!p || *f->n >= f->max)
         return;
-    tst_free_all(p->lokid);
+    tst_fuzzy_all(p->lokid, f);
     if (p->key)
-        tst_free_all(p->eqkid);
-    tst_free_all(p->hikid);
-    if (!p->key && p->refcnt > 0)
-        free(p->eqkid);
-    free(p);
+        tst_fuzzy_all(p->eqkid, f);
+    else if (p->eqkid && *f->n < f->max)
+        f->a[(*f->n)++] = (char *) p->eqkid;
+    tst_fuzzy_all(p->hikid, f);
 }
 
-/** free the ternary search tree rooted at p, data storage external. */
-void tst_free(tst_node *p)
+/** tst_fuzzy_walk() visit the words below 'p' at 'depth', whose path to
+ *  'p' has the Levenshtein row 'prev' against 's'. lo/hi kids share the
+ *  row of 'p', an eq kid gets the row extended by the key of 'p', and a
+ *  branch is cut as soon as no entry of its row is within maxdist.
+ */
+static void tst_fuzzy_walk(const tst_node *p, size_t depth, tst_fuzzy *f)
 {
-    if (!p)
+    const int *prev = f->rows + depth * (f->len + 1);
+    int *row = f->rows + (depth + 1) * (f->len + 1);
+    int min;
+
+    if (!p || *f->n >= f->max)
         return;
-    tst_free(p->lokid);
-    if (p->key)
-        tst_free(p->eqkid);
-    tst_free(p->hikid);
-    free(p);
+
+    tst_fuzzy_walk(p->lokid, depth, f);
+    if (!p->key) {
+        if (p->eqkid && prev[f->len] <= f->maxdist && *f->n < f->max)
+            f->a[(*f->n)++] = (char *) p->eqkid;
+    } else if (depth + 1 < WRDMAX) {
+        min = row[0] = prev[0] + 1;
+        for (size_t i = 1; i <= f->len; i++) {
+            int sub = prev[i - 1] + (f->s[i - 1] != p->key);
+            int del = prev[i] + 1, ins = row[i - 1] + 1;
+            row[i] = sub < del ? sub : del;
+            if (ins < row[i])
+                row[i] = ins;
+            if (row[i] < min)
+                min = row[i];
+        }
+        if (f->prefix && row[f->len] <= f->maxdist)
+            tst_fuzzy_all(p->eqkid, f); /* every word below matches */
+        else if (min <= f->maxdist)
+            tst_fuzzy_walk(p->eqkid, depth + 1, f);
+    }
+    tst_fuzzy_walk(p->hikid, depth, f);
 }
 
-/** access functions tst_get_key(), tst_get_refcnt, & tst_get_string().
- *  provide access to struct members through opaque pointers availale
- *  to program.
+/** run a fuzzy search, see tst_search_fuzzy() and tst_search_prefix_fuzzy()
+ *  in tst.h.
  */
-char tst_get_key(const tst_node *node)
+static void *tst_fuzzy_search(const tst_node *root,
+                              const char *s,
+                              const int maxdist,
+                              const int prefix,
+                              char **a,
+                              int *n,
+                              const int max)
 {
-    return node->key;
+    tst_fuzzy f = {.s = s, .len = strlen(s), .maxdist = maxdist,
+                   .prefix = prefix, .a = a, .n = n, .max = max};
+
+    *n = 0;
+    if (maxdist < 0 || f.len + 1 > STKMAX / 2)
+        return NULL;
+    if (!(f.rows = malloc((size_t) WRDMAX * (f.len + 1) * sizeof *f.rows)))
+        return NULL;
+
+    for (size_t i = 0; i <= f.len; i++) /* distance from the empty path */
+        f.rows[i] = i;
+    if (prefix && f.rows[f.len] <= maxdist)
+        tst_fuzzy_all(root, &f);
+    else
+        tst_fuzzy_walk(root, 0, &f);
+
+    free(f.rows);
+    return *n ? (void *) a[0] : NULL;
 }
 
-unsigned tst_get_refcnt(const tst_node *node)
+/** tst_search_fuzzy() fills 'a' with words within 'maxdist' edits of 's'. */
+void *tst_search_fuzzy(const tst_node *root,
+                       const char *s,
+                       const int maxdist,
+                       char **a,
+                       int *n,
+                       const int max)
 {
-    return node->refcnt;
+    return tst_fuzzy_search(root, s, maxdist, 0, a, n, max);
+}
+
+/** tst_search_prefix_fuzzy() fills 'a' with words having a prefix within
+ *  'maxdist' edits of 's'.
+ */
+void *tst_search_prefix_fuzzy(const tst_node *root,
+                              const char *s,
+                              const int maxdist,
+                              char **a,
+                              int *n,
+                              const int max)
+{
+    return tst_fuzzy_search(root, s, maxdist, 1, a, n, max);
+}
+
+/** entry of the top-k search queue, either a subtree ranked by its
+ *  maxscore or a word ranked by its score.
+ */
+typedef struct tst_topk_ent {
+    const tst_node *node;
+    unsigned prio;
+    int word;
+} tst_topk_ent;
+
+/** max-heap of top-k search entries. */
+typedef struct tst_topk_heap {
+    tst_topk_ent *ent;
+    size_t n, cap;
+} tst_topk_heap;
+
+static int tst_heap_push(tst_topk_heap *h,
+                         const tst_node *node,
+                         unsigned prio,
+                         int word)
+{
+    size_t i;
+
+    if (!node)
+        return 0;
+    if (h->n == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : STKMAX;
+        tst_topk_ent *ent = realloc(h->ent, cap * sizeof *ent);
+        if (!ent)
+            return -1;
+        h->ent = ent;
+        h->cap = cap;
+    }
+    for (i = h->n++; i && h->ent[(i - 1) / 2].prio < prio; i = (i - 1) / 2)
+        h->ent[i] = h->ent[(i - 1) / 2];
+    h->ent[i] = (tst_topk_ent){.node = node, .prio = prio, .word = word};
+    return 0;
+}
+
+static tst_topk_ent tst_heap_pop(tst_topk_heap *h)
+{
+    tst_topk_ent top = h->ent[0], last = h->ent[--h->n];
+    size_t i = 0, kid;
+
+    while ((kid = 2 * i + 1) < h->n) {
+        if (kid + 1 < h->n && h->ent[kid + 1].prio > h->ent[kid].prio)
+            kid++;
+        if (h->ent[kid].prio <= last.prio)
+            break;
+        h->ent[i] = h->ent[kid];
+        i = kid;
+    }
+    h->ent[i] = last;
+    return top;
+}
+
+/** tst_search_prefix_topk() fills 'a' with the 'k' highest scored words
+ *  prefixed with 's', see tst.h.
+ */
+void *tst_search_prefix_topk(const tst_node *root,
+                             const char *s,
+                             char **a,
+                             int *n,
+                             const int k)
+{
+    tst_topk_heap h = {.ent = NULL, .n = 0, .cap = 0};
+    const tst_node *curr = root, *start = NULL;
+
+    *n = 0;
+    if (!*s)
+        start = root;
+    while (curr && !start) {
+        int diff = *s - curr->key;
+        if (diff == 0) {
+            if (!s[1]) { /* words below the last char of the prefix */
+                if (!(start = curr->eqkid))
+                    return NULL;
+                break;
+            }
+            s++;
+            curr = curr->eqkid;
+        } else if (diff < 0)
+            curr = curr->lokid;
+        else
+            curr = curr->hikid;
+    }
+    if (!start)
+        return NULL;
+
+    /* best first: a word popped from the queue outranks everything left,
+     * and a subtree whose maxscore is below the k-th word is never opened.
+     */
+    if (tst_heap_push(&h, start, start->maxscore, 0))
+        goto out;
+    while (h.n && *n < k) {
+        tst_topk_ent e = tst_heap_pop(&h);
+        const tst_node *p = e.node;
+
+        if (e.word) {
+            a[(*n)++] = (char *) p->eqkid;
+            continue;
+        }
+        if (tst_heap_push(&h, p->lokid, p->lokid ? p->lokid->maxscore : 0,
+                          0) ||
+            tst_heap_push(&h, p->hikid, p->hikid ? p->hikid->maxscore : 0,
+                          0))
+            break;
+        if (p->key) {
+            if (tst_heap_push(&h, p->eqkid,
+                              p->eqkid ? p->eqkid->maxscore : 0, 0))
+                break;
+        } else if (p->eqkid && tst_heap_push(&h, p, p->score, 1))
+            break;
+    }
+
+out:
+    free(h.ent);
+    return (void *) start;
+}
+
+/** entry of the prefix iterator stack, 'self' set once the lo subtree of
+ *  'node' has been pushed, so the eq subtree or word is next.
+ */
+typedef struct tst_iter_ent {
+    const tst_node *node;
+    int self;
+} tst_iter_ent;
+
+/** prefix iterator, an explicit in-order traversal stack. */
+struct tst_prefix_iter {
+    tst_iter_ent *stk;
+    size_t idx, cap;
+};
+
+static int tst_iter_push(tst_prefix_iter *it, const tst_node *node, int self)
+{
+    if (!node)
+        return 0;
+    if (it->idx == it->cap) {
+        size_t cap = it->cap ? it->cap * 2 : STKMAX;
+        tst_iter_ent *stk = realloc(it->stk, cap * sizeof *stk);
+        if (!stk)
+            return -1;
+        it->stk = stk;
+        it->cap = cap;
+    }
+    it->stk[it->idx++] = (tst_iter_ent){.node = node, .self = self};
+    return 0;
+}
+
+/** tst_prefix_iter_begin() start iterating words prefixed with 's'. */
+tst_prefix_iter *tst_prefix_iter_begin(const tst_node *root, const char *s)
+{
+    tst_prefix_iter *it = calloc(1, sizeof *it);
+    const tst_node *curr = root;
+
+    if (!it)
+        return NULL;
+    if (!*s) { /* every word of the tree */
+        if (tst_iter_push(it, root, 0))
+            goto fail;
+        return it;
+    }
+
+    while (curr) {
+        int diff = *s - curr->key;
+        if (diff == 0) {
+            if (!s[1]) { /* words below the last char of the prefix */
+                if (tst_iter_push(it, curr->eqkid, 0))
+                    goto fail;
+                break;
+            }
+            s++;
+            curr = curr->eqkid;
+        } else if (diff < 0)
+            curr = curr->lokid;
+        else
+            curr = curr->hikid;
+    }
+    return it;
+
+fail:
+    tst_prefix_iter_end(it);
+    return NULL;
+}
+
+/** tst_prefix_iter_next() returns the next word, NULL when exhausted. */
+char *tst_prefix_iter_next(tst_prefix_iter *it)
+{
+    while (it->idx) {
+        tst_iter_ent e = it->stk[--it->idx];
+        const tst_node *p = e.node;
+
+        if (!e.self) { /* hi after self after lo */
+            if (tst_iter_push(it, p->hikid, 0) || tst_iter_push(it, p, 1) ||
+                tst_iter_push(it, p->lokid, 0))
+                return NULL;
+        } else if (p->key) {
+            if (tst_iter_push(it, p->eqkid, 0))
+                return NULL;
+        } else if (p->eqkid)
+            return (char *) p->eqkid;
+    }
+    return NULL;
+}
+
+/** tst_prefix_iter_end() release the iterator. */
+void tst_prefix_iter_end(tst_prefix_iter *it)
+{
+    if (!it)
+        return;
+    free(it->stk);
+    free(it);
+}
+
+/** compare strings in tree order, chars compare as signed as in next_node().
+ */
+static int tst_strcmp(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a - *b;
+}
+
+/** parts of a node an ordered iterator steps through, in tree order. */
+enum { POS_ENTER, POS_LO, POS_MID, POS_HI, POS_LEAVE };
+
+/** node on the path of an ordered iterator and the part of it the
+ *  iterator stands in: below its lo, eq or hi kid, or on the node itself
+ *  for the terminal node of the current word.
+ */
+typedef struct tst_pos {
+    const tst_node *node;
+    int part;
+} tst_pos;
+
+/** ordered iterator, the path from the root to its position. Ranges stop
+ *  at the terminal node 'stop' and do not step back past 'first'.
+ */
+struct tst_iter {
+    const tst_node *root;
+    tst_pos *path;
+    size_t idx, cap;
+    const tst_node *cur;   /* terminal node of the current word, or NULL */
+    const tst_node *first; /* lowest terminal node of a range, or NULL */
+    const tst_node *stop;  /* terminal node past a range, or NULL */
+    int bounded;           /* non-zero if the range has a lower bound */
+    int edge;              /* 1 past the last word, -1 before the first */
+};
+
+static int tst_iter_descend(tst_iter *it, const tst_node *node, int part)
+{
+    if (!node)
+        return 0;
+    if (it->idx == it->cap) {
+        size_t cap = it->cap ? it->cap * 2 : STKMAX;
+        tst_pos *path = realloc(it->path, cap * sizeof *path);
+        if (!path)
+            return -1;
+        it->path = path;
+        it->cap = cap;
+    }
+    it->path[it->idx++] = (tst_pos){.node = node, .part = part};
+    return 0;
+}
+
+/** tst_iter_step() move to the next terminal node in 'dir', 1 forward and
+ *  -1 backward, and return it. Each node is entered on the side the walk
+ *  comes from and left on the other, so the two directions share a path.
+ *  returns NULL past the last word in 'dir' or on allocation failure.
+ */
+static const tst_node *tst_iter_step(tst_iter *it, int dir)
+{
+    int enter = dir > 0 ? POS_ENTER : POS_LEAVE;
+
+    while (it->idx) {
+        tst_pos *top = &it->path[it->idx - 1];
+        const tst_node *p = top->node;
+
+        top->part += dir;
+        switch (top->part) {
+        case POS_LO:
+            if (tst_iter_descend(it, p->lokid, enter))
+                return NULL;
+            break;
+        case POS_MID:
+            if (!p->key) {
+                if (p->eqkid)
+                    return p;
+            } else if (tst_iter_descend(it, p->eqkid, enter))
+                return NULL;
+            break;
+        case POS_HI:
+            if (tst_iter_descend(it, p->hikid, enter))
+                return NULL;
+            break;
+        default: /* both sides done */
+            it->idx--;
+        }
+    }
+    return NULL;
+}
+
+/** tst_iter_seek() set the path of 'it' just before the first word not
+ *  below 'key' in tree order, following 'key' down as tst_search() does
+ *  and recording on each node which side of it 'key' lies, O(depth).
+ */
+static int tst_iter_seek(tst_iter *it, const char *key)
+{
+    const tst_node *p = it->root;
+
+    it->idx = 0;
+    it->cur = NULL;
+    it->edge = 0;
+    while (p) {
+        int diff = *key - p->key;
+        if (diff < 0) {
+            if (tst_iter_descend(it, p, POS_LO))
+                return -1;
+            p = p->lokid;
+        } else if (diff > 0) {
+            if (tst_iter_descend(it, p, POS_HI))
+                return -1;
+            p = p->hikid;
+        } else if (*key) {
+            if (tst_iter_descend(it, p, POS_MID))
+                return -1;
+            key++;
+            p = p->eqkid;
+        } else { /* 'key' itself, past the words of its lo side */
+            if (tst_iter_descend(it, p, POS_LO))
+                return -1;
+            return tst_iter_descend(it, p->lokid, POS_LEAVE);
+        }
+    }
+    return 0;
+}
+
+/** tst_iter_rewind() set the path of 'it' before the first word, or past
+ *  the last word with 'part' POS_LEAVE.
+ */
+static int tst_iter_rewind(tst_iter *it, int part)
+{
+    it->idx = 0;
+    it->edge = 0;
+    return tst_iter_descend(it, it->root, part);
+}
+
+/** tst_iter_bound() set 'bound' to the terminal node of the first word
+ *  not below 'key', NULL if there is none. returns -1 on allocation
+ *  failure, 0 otherwise.
+ */
+static int tst_iter_bound(tst_iter *it, const char *key,
+                          const tst_node **bound)
+{
+    if (tst_iter_seek(it, key))
+        return -1;
+    *bound = tst_iter_step(it, 1);
+    return *bound || !it->idx ? 0 : -1;
+}
+
+/** tst_seek() start an ordered iterator just before the first word not
+ *  below 'key'.
+ */
+tst_iter *tst_seek(const tst_node *root, const char *key)
+{
+    tst_iter *it = calloc(1, sizeof *it);
+
+    if (!it)
+        return NULL;
+    it->root = root;
+    if (tst_iter_seek(it, key)) {
+        tst_iter_end(it);
+        return NULL;
+    }
+    return it;
+}
+
+/** tst_range() start an ordered iterator over the words in [lo, hi). */
+tst_iter *tst_range(const tst_node *root, const char *lo, const char *hi)
+{
+    tst_iter *it = calloc(1, sizeof *it);
+
+    if (!it)
+        return NULL;
+    it->root = root;
+    if (hi && tst_iter_bound(it, hi, &it->stop))
+        goto fail;
+    if (lo) {
+        it->bounded = 1;
+        if (tst_iter_bound(it, lo, &it->first))
+            goto fail;
+        if (hi && tst_strcmp(lo, hi) >= 0) /* empty */
+            it->stop = it->first;
+    }
+    if (lo ? tst_iter_seek(it, lo) : tst_iter_rewind(it, POS_ENTER))
+        goto fail;
+    return it;
+
+fail:
+    tst_iter_end(it);
+    return NULL;
+}
+
+/** tst_iter_next() step forward, see tst.h. */
+char *tst_iter_next(tst_iter *it)
+{
+    const tst_node *n;
+
+    if (it->edge > 0 || (it->stop && it->cur == it->stop))
+        return NULL;
+    if (it->edge < 0 && tst_iter_rewind(it, POS_ENTER))
+        return NULL;
+    if (!(n = tst_iter_step(it, 1))) {
+        it->idx = 0;
+        it->edge = 1;
+    }
+    it->cur = n;
+    return n && n != it->stop ? (char *) n->eqkid : NULL;
+}
+
+/** tst_iter_prev() step backward, see tst.h. */
+char *tst_iter_prev(tst_iter *it)
+{
+    const tst_node *n;
+    int first;
+
+    if (it->edge < 0 || (it->bounded && !it->first))
+        return NULL;
+    if (it->bounded && !it->cur && !it->edge)
+        return NULL; /* already before the lower bound */
+    first = it->bounded && it->cur == it->first;
+    if (it->edge > 0 && tst_iter_rewind(it, POS_LEAVE))
+        return NULL;
+    if (!(n = tst_iter_step(it, -1))) {
+        it->idx = 0;
+        it->edge = -1;
+    }
+    it->cur = first ? NULL : n;
+    return it->cur ? (char *) it->cur->eqkid : NULL;
+}
+
+/** tst_iter_end() release an ordered iterator. */
+void tst_iter_end(tst_iter *it)
+{
+    if (!it)
+        return;
+    free(it->path);
+    free(it);
+}
+
+/** tst_traverse_fn(), traverse tree calling 'fn' on each word.
+ *  prototype fonr 'fn' is void fn(const void *, void *). data can
+ *  be NULL if unused.
+ */
+void tst_traverse_fn(const tst_node *p,
+                     void(fn)(const void *, void *),
+                     void *data)
+{
+    if (!p)
+        return;
+    tst_traverse_fn(p->lokid, fn, data);
+    if (p->key)
+        tst_traverse_fn(p->eqkid, fn, data);
+    else if (p->eqkid)
+        fn(p, data);
+    tst_traverse_fn(p->hikid, fn, data);
+}
+
+/** walk the words below 'p' in order, 'key' holding the 'depth' chars of
+ *  the path down to 'p'.
+ */
+static void tst_traverse_key(const tst_node *p,
+                             char *key,
+                             size_t depth,
+                             void(fn)(const void *, const char *, void *),
+                             void *data)
+{
+    if (!p)
+        return;
+    tst_traverse_key(p->lokid, key, depth, fn, data);
+    if (p->key) {
+        key[depth] = p->key;
+        tst_traverse_key(p->eqkid, key, depth + 1, fn, data);
+    } else if (p->eqkid) {
+        key[depth] = 0;
+        fn(p, key, data);
+    }
+    tst_traverse_key(p->hikid, key, depth, fn, data);
+}
+
+/** tst_traverse_key_fn() tst_traverse_fn() passing the key of each word. */
+void tst_traverse_key_fn(const tst_node *p,
+                         void(fn)(const void *, const char *, void *),
+                         void *data)
+{
+    char key[STKMAX];
+
+    tst_traverse_key(p, key, 0, fn, data);
+}
+
+/** free the ternary search tree rooted at p, data storage internal. */
+void tst_free_all(tst_node *p)
+{
+    if (!p)
+        return;
+    tst_free_all(p->lokid);
+    if (p->key)
+        tst_free_all(p->eqkid);
+    tst_free_all(p->hikid);
+    if (!p->key && p->refcnt > 0)
+        free(p->eqkid);
+    free(p);
+}
+
+/** free the ternary search tree rooted at p, data storage external. */
+void tst_free(tst_node *p)
+{
+    if (!p)
+        return;
+    tst_free(p->lokid);
+    if (p->key)
+        tst_free(p->eqkid);
+    tst_free(p->hikid);
+    free(p);
+}
+
+/** free the strings of a tree with internal data storage, nodes untouched. */
+static void tst_free_strings(tst_node *p)
+{
+    if (!p)
+        return;
+    tst_free_strings(p->lokid);
+    if (p->key)
+        tst_free_strings(p->eqkid);
+    else if (p->refcnt > 0)
+        free(p->eqkid);
+    tst_free_strings(p->hikid);
+}
+
+/** tst_tree_create() allocate an empty tree handle owning a node pool.
+ *  If 'cpy' is non-zero the tree stores copies of inserted strings,
+ *  otherwise references. returns NULL on allocation failure.
+ */
+tst_tree *tst_tree_create(const int cpy)
+{
+    tst_tree *t = calloc(1, sizeof *t);
+    if (t)
+        t->cpy = cpy;
+    return t;
+}
+
+/** tst_tree_create_norm() tst_tree_create() for a normalized tree. */
+tst_tree *tst_tree_create_norm(const int cpy)
+{
+    tst_tree *t = tst_tree_create(cpy);
+    if (t)
+        t->norm = 1;
+    return t;
+}
+
+/** tst_tree_create_concurrent() tst_tree_create() for one writer and many
+ *  readers, nodes and strings are released through an epoch domain.
+ */
+tst_tree *tst_tree_create_concurrent(const int cpy)
+{
+    tst_tree *t = tst_tree_create(cpy);
+
+    if (t && !(t->pool.epoch = tst_epoch_create())) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/** tst_tree_reader() register a reader thread of a concurrent tree. */
+tst_reader *tst_tree_reader(tst_tree *t)
+{
+    return t->pool.epoch ? tst_reader_join(t->pool.epoch) : NULL;
+}
+
+/** tst_tree_key() returns the key of 's' in 't', 's' itself unless the tree
+ *  is normalized, then the folded form written to 'key'. returns NULL if
+ *  the folded key does not fit in STKMAX chars.
+ */
+static const char *tst_tree_key(const tst_tree *t, const char *s, char *key)
+{
+    if (!t->norm)
+        return s;
+    return utf8_fold(s, key, STKMAX) < 0 ? NULL : key;
+}
+
+/** tst_cache_hash() FNV-1a of the first 'len' chars of 's', extending the
+ *  hash 'h' of the chars before them.
+ */
+static unsigned tst_cache_hash(unsigned h, const char *s, int len)
+{
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char) s[i]) * 16777619u;
+    return h;
+}
+
+#define CACHE_SEED 2166136261u
+
+/** tst_cache_find() returns the entry holding 'key' of 'len' chars searched
+ *  for 'max' words, -1 if none. 'prev' is set to the entry before it in
+ *  its chain, -1 if it is first.
+ */
+static int tst_cache_find(const tst_cache *c,
+                          const char *key,
+                          int len,
+                          unsigned h,
+                          int max,
+                          int *prev)
+{
+    *prev = -1;
+    for (int i = c->bucket[h & c->mask]; i >= 0; i = c->ent[i].next) {
+        const tst_cent *e = &c->ent[i];
+        if (e->hash == h && e->len == len && e->max == max &&
+            !memcmp(e->words + e->n, key, len))
+            return i;
+        *prev = i;
+    }
+    return -1;
+}
+
+/** tst_cache_drop() unlink entry 'i', 'prev' in its chain, and free it. */
+static void tst_cache_drop(tst_cache *c, int i, int prev)
+{
+    tst_cent *e = &c->ent[i];
+
+    if (prev < 0)
+        c->bucket[e->hash & c->mask] = e->next;
+    else
+        c->ent[prev].next = e->next;
+    c->bytes -= e->n * sizeof *e->words + e->len + 1;
+    free(e->words);
+    e->words = NULL;
+    e->next = c->free;
+    c->free = i;
+    c->st.entries--;
+}
+
+/** tst_cache_evict() free the first entry the CLOCK hand finds unreferenced,
+ *  clearing the references of those it passes.
+ */
+static void tst_cache_evict(tst_cache *c)
+{
+    for (;; c->hand = (c->hand + 1) % c->cap) {
+        tst_cent *e = &c->ent[c->hand];
+        int prev = -1;
+
+        if (e->ref) {
+            e->ref = 0;
+            continue;
+        }
+        for (int i = c->bucket[e->hash & c->mask]; i != c->hand;
+             i = c->ent[i].next)
+            prev = i;
+        tst_cache_drop(c, c->hand, prev);
+        c->st.evicted++;
+        c->hand = (c->hand + 1) % c->cap;
+        return;
+    }
+}
+
+/** tst_cache_put() keep the result of searching 'key' for 'max' words,
+ *  silently giving up on allocation failure.
+ */
+static void tst_cache_put(tst_cache *c,
+                          const char *key,
+                          int len,
+                          unsigned h,
+                          int max,
+                          char **a,
+                          int n,
+                          void *res)
+{
+    size_t bytes = n * sizeof *a + len + 1;
+    char **words = malloc(bytes);
+    tst_cent *e;
+    int i;
+
+    if (!words)
+        return;
+    if (c->free < 0)
+        tst_cache_evict(c);
+    i = c->free;
+    e = &c->ent[i];
+    c->free = e->next;
+    memcpy(words, a, n * sizeof *a);
+    memcpy(words + n, key, len + 1);
+    *e = (tst_cent){.words = words, .res = res, .hash = h, .len = len,
+                    .max = max, .n = n, .next = c->bucket[h & c->mask]};
+    c->bucket[h & c->mask] = i;
+    c->bytes += bytes;
+    c->st.entries++;
+}
+
+/** tst_cache_clear() drop every entry, counting them as invalidated. */
+static void tst_cache_clear(tst_cache *c)
+{
+    if (!c)
+        return;
+    c->st.invalidated += c->st.entries;
+    c->free = -1;
+    for (int i = c->cap - 1; i >= 0; i--) {
+        free(c->ent[i].words);
+        c->ent[i] = (tst_cent){.next = c->free};
+        c->free = i;
+    }
+    for (unsigned b = 0; b <= c->mask; b++)
+        c->bucket[b] = -1;
+    c->bytes = 0;
+    c->st.entries = 0;
+}
+
+/** tst_cache_invalidate() drop the entries of every prefix of 'key', the
+ *  only searches an insert or delete of 'key' can change. O(strlen(key))
+ *  hash lookups, the prefix hashes being extended one char at a time.
+ */
+static void tst_cache_invalidate(tst_cache *c, const char *key)
+{
+    unsigned h = CACHE_SEED;
+
+    if (!c || !c->st.entries || !key)
+        return;
+    for (int len = 1; key[len - 1]; len++) {
+        int prev = -1, i;
+
+        h = tst_cache_hash(h, key + len - 1, 1);
+        for (i = c->bucket[h & c->mask]; i >= 0;) {
+            tst_cent *e = &c->ent[i];
+            int next = e->next;
+
+            if (e->hash == h && e->len == len &&
+                !memcmp(e->words + e->n, key, len)) {
+                tst_cache_drop(c, i, prev);
+                c->st.invalidated++;
+            } else
+                prev = i;
+            i = next;
+        }
+    }
+}
+
+/** tst_tree_ins() insert 's' into 't', nodes taken from the tree pool. */
+void *tst_tree_ins(tst_tree *t, const char *s)
+{
+    return tst_tree_ins_score(t, s, 0);
+}
+
+/** tst_tree_ins_score() insert 's' with 'score' into 't'. */
+void *tst_tree_ins_score(tst_tree *t, const char *s, const unsigned score)
+{
+    char buf[STKMAX];
+    const char *key = tst_tree_key(t, s, buf);
+
+    void *res = tst_ins_node(&t->root, key, s, t->cpy, score, &t->pool);
+
+    tst_cache_invalidate(t->cache, key);
+    if (t->pool.epoch)
+        tst_epoch_poll(t->pool.epoch);
+    return res;
+}
+
+/** tst_tree_del() delete 's' from 't', nodes returned to the tree pool. */
+void *tst_tree_del(tst_tree *t, const char *s)
+{
+    char buf[STKMAX];
+    const char *key = tst_tree_key(t, s, buf);
+
+    void *res;
+
+    if (!key)
+        return (void *) -1;
+    res = tst_del_node(&t->root, key, t->cpy, &t->pool);
+    if (!res) /* a delete that only dropped a refcnt changed no node */
+        t->churn[(unsigned char) *key]++;
+    tst_cache_invalidate(t->cache, key);
+    if (t->pool.epoch)
+        tst_epoch_poll(t->pool.epoch);
+    else if (t->pool.heap.dead > t->pool.heap.live &&
+             t->pool.heap.dead >= HEAPCHUNK) {
+        tst_heap_compact(&t->pool.heap, t->root);
+        tst_cache_clear(t->cache); /* cached words have moved */
+    }
+    return res;
+}
+
+/** tst_tree_search() tst_search() on 't', folding 's' in a normalized tree.
+ */
+void *tst_tree_search(const tst_tree *t, const char *s)
+{
+    char buf[STKMAX];
+    const char *key = tst_tree_key(t, s, buf);
+
+    return key ? tst_search(tst_tree_root(t), key) : NULL;
+}
+
+/** tst_tree_search_prefix() tst_search_prefix() on 't', folding 's' in a
+ *  normalized tree.
+ */
+void *tst_tree_search_prefix(const tst_tree *t,
+                             const char *s,
+                             char **a,
+                             int *n,
+                             const int max)
+{
+    char buf[STKMAX];
+    const char *key = tst_tree_key(t, s, buf);
+    tst_cache *c = t->cache;
+    unsigned h;
+    void *res;
+    int len, i, prev;
+
+    *n = 0;
+    if (!key)
+        return NULL;
+    if (!c || !*key)
+        return tst_search_prefix(tst_tree_root(t), key, a, n, max);
+
+    len = strlen(key);
+    h = tst_cache_hash(CACHE_SEED, key, len);
+    if ((i = tst_cache_find(c, key, len, h, max, &prev)) >= 0) {
+        tst_cent *e = &c->ent[i];
+        memcpy(a, e->words, e->n * sizeof *a);
+        *n = e->n;
+        e->ref = 1;
+        c->st.hits++;
+        return e->res;
+    }
+    c->st.misses++;
+    res = tst_search_prefix(tst_tree_root(t), key, a, n, max);
+    tst_cache_put(c, key, len, h, max, a, *n, res);
+    return res;
+}
+
+/** tst_tree_cache() set up, resize or drop the prefix cache of 't', the
+ *  counters start again from zero.
+ */
+int tst_tree_cache(tst_tree *t, int entries)
+{
+    tst_cache *c;
+    unsigned nb = 1;
+
+    if (t->pool.epoch)
+        return -1;
+    if (t->cache) {
+        tst_cache_clear(t->cache);
+        free(t->cache->ent);
+        free(t->cache->bucket);
+    }
+    if (entries <= 0) {
+        free(t->cache);
+        t->cache = NULL;
+        return 0;
+    }
+    while (nb < (unsigned) entries) /* a load factor of at most one */
+        nb <<= 1;
+    if (!(c = t->cache ? t->cache : calloc(1, sizeof *c)))
+        return -1;
+    c->ent = calloc(entries, sizeof *c->ent);
+    c->bucket = malloc(nb * sizeof *c->bucket);
+    if (!c->ent || !c->bucket) {
+        free(c->ent);
+        free(c->bucket);
+        free(c);
+        t->cache = NULL;
+        return -1;
+    }
+    c->cap = entries;
+    c->mask = nb - 1;
+    c->hand = 0;
+    tst_cache_clear(c);
+    c->st = (tst_cache_stats){0};
+    t->cache = c;
+    return 0;
+}
+
+/** tst_tree_cache_stats() copy the cache counters of 't'. */
+void tst_tree_cache_stats(const tst_tree *t, tst_cache_stats *st)
+{
+    *st = t->cache ? t->cache->st : (tst_cache_stats){0};
+}
+
+/** word and its number of occurrences, for tst_build(). 'key' is the word
+ *  or its folded form in a normalized tree, 'pos' its index in the input.
+ */
+typedef struct tst_bword {
+    const char *key;
+    const char *s;
+    size_t pos;
+    unsigned refcnt;
+} tst_bword;
+
+/** order words by key, then by input position so the first spelling of a
+ *  key leads its group.
+ */
+static int tst_cmp_words(const void *a, const void *b)
+{
+    const tst_bword *wa = a, *wb = b;
+    int diff = tst_strcmp(wa->key, wb->key);
+
+    if (diff)
+        return diff;
+    return (wa->pos > wb->pos) - (wa->pos < wb->pos);
+}
+
+/** tst_build_range() build the subtree for words [lo, hi) of 'w', which
+ *  share their first 'depth' chars. the median word picks the key, words
+ *  before and after the group sharing that key build the lo and hi kids
+ *  and the group builds the eq kid, so each lo/hi subtree is balanced by
+ *  word count. sets 'err' on allocation failure.
+ */
+static tst_node *tst_build_range(tst_pool *pool,
+                                 const int cpy,
+                                 const tst_bword *w,
+                                 size_t lo,
+                                 size_t hi,
+                                 size_t depth,
+                                 int *err)
+{
+    size_t mid = lo + (hi - lo) / 2, glo = mid, ghi = mid + 1;
+    tst_node *node;
+    char c;
+
+    if (lo >= hi || *err)
+        return NULL;
+
+    c = w[mid].key[depth];
+    while (glo > lo && w[glo - 1].key[depth] == c)
+        glo--;
+    while (ghi < hi && w[ghi].key[depth] == c)
+        ghi++;
+
+    if (!(node = tst_node_alloc(pool))) {
+        *err = 1;
+        return NULL;
+    }
+    node->key = c;
+    node->refcnt = 1;
+    node->lokid = tst_build_range(pool, cpy, w, lo, glo, depth, err);
+    if (c)
+        node->eqkid = tst_build_range(pool, cpy, w, glo, ghi, depth + 1, err);
+    else if (tst_store(node, w[mid].s, cpy, pool)) /* group is the word */
+        node->refcnt = w[mid].refcnt;
+    else
+        *err = 1;
+    node->hikid = tst_build_range(pool, cpy, w, ghi, hi, depth, err);
+    return node;
+}
+
+/** insert words [lo, hi) of 'w' median first into a non-empty tree. */
+static int tst_build_ins(tst_tree *t, const tst_bword *w, size_t lo, size_t hi)
+{
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (lo >= hi)
+        return 0;
+    for (unsigned i = 0; i < w[mid].refcnt; i++)
+        if (!tst_tree_ins(t, w[mid].s))
+            return -1;
+    if (tst_build_ins(t, w, lo, mid))
+        return -1;
+    return tst_build_ins(t, w, mid + 1, hi);
+}
+
+/** tst_build_words() returns the words of 'words' the tree can hold with
+ *  their key, unsorted, their count in 'm'. the folded keys of a normalized
+ *  tree are kept in one block returned in 'keys'. NULL on allocation
+ *  failure.
+ */
+static tst_bword *tst_build_words(const tst_tree *t,
+                                  const char *const *words,
+                                  size_t n,
+                                  size_t *m,
+                                  char **keys)
+{
+    tst_bword *w = malloc((n ? n : 1) * sizeof *w);
+    char buf[STKMAX], *k = NULL;
+    size_t bytes = 0;
+
+    *m = 0;
+    *keys = NULL;
+    if (!w)
+        return NULL;
+
+    /* a normalized tree is sorted on the folded keys, kept in one block */
+    if (t->norm) {
+        for (size_t i = 0; i < n; i++) {
+            int len = utf8_fold(words[i], buf, sizeof buf);
+            if (len >= 0)
+                bytes += len + 1;
+        }
+        if (!(k = *keys = malloc(bytes ? bytes : 1))) {
+            free(w);
+            return NULL;
+        }
+    }
+
+    /* words the tree can not hold are skipped */
+    for (size_t i = 0; i < n; i++) {
+        const char *key = words[i];
+        if (t->norm) {
+            /* a fold that fails leaves partial output, only copy success */
+            int len = utf8_fold(words[i], buf, sizeof buf);
+            if (len < 0)
+                continue;
+            key = memcpy(k, buf, len + 1);
+            k += len + 1;
+        }
+        if (strlen(key) + 1 > STKMAX / 2)
+            continue;
+        w[(*m)++] = (tst_bword){.key = key, .s = words[i], .pos = i};
+    }
+    return w;
+}
+
+/** sort 'm' words in tree order and fold duplicates into a refcnt, returns
+ *  the number of distinct words left at the front of 'w'.
+ */
+static size_t tst_build_sort(tst_bword *w, size_t m)
+{
+    size_t nw = 0;
+
+    qsort(w, m, sizeof *w, tst_cmp_words);
+    for (size_t i = 0; i < m; i++) {
+        if (nw && !strcmp(w[nw - 1].key, w[i].key))
+            w[nw - 1].refcnt++;
+        else {
+            w[nw] = w[i];
+            w[nw++].refcnt = 1;
+        }
+    }
+    return nw;
+}
+
+/** tst_build() bulk load 'n' words into 't', see tst.h. */
+int tst_build(tst_tree *t, const char *const *words, size_t n)
+{
+    size_t m, nw;
+    char *keys;
+    tst_bword *w = tst_build_words(t, words, n, &m, &keys);
+    int err = 0;
+
+    if (!w)
+        return -1;
+
+    tst_cache_clear(t->cache);
+    nw = tst_build_sort(w, m);
+    if (t->root)
+        err = tst_build_ins(t, w, 0, nw);
+    else /* published once built, for concurrent readers */
+        STORE(t->root, tst_build_range(&t->pool, t->cpy, w, 0, nw, 0, &err));
+
+    free(keys);
+    free(w);
+    return err ? -1 : 0;
+}
+
+/** most threads of tst_build_parallel(), more workers than that would
+ *  mostly wait for one of at most 256 partitions.
+ */
+#define BUILDTHREADS 64
+
+/** partition of tst_build_parallel(), the words sharing a leading byte. */
+typedef struct tst_part {
+    tst_bword *w;   /* words of the partition, distinct once sorted */
+    size_t n;
+    tst_node *root; /* subtree built from the partition */
+} tst_part;
+
+/** state shared by the workers of tst_build_parallel(). */
+typedef struct tst_builder {
+    tst_part *parts;
+    size_t *order;  /* partitions largest first, claimed in that order */
+    size_t nparts;
+    size_t next;    /* index in 'order' of the next partition to claim */
+    int cpy;
+} tst_builder;
+
+/** worker of tst_build_parallel() building into a pool of its own. */
+typedef struct tst_worker {
+    tst_builder *b;
+    tst_pool pool;
+    int err;
+} tst_worker;
+
+static void *tst_build_worker(void *arg)
+{
+    tst_worker *wk = arg;
+    tst_builder *b = wk->b;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) <
+           b->nparts) {
+        tst_part *p = &b->parts[b->order[i]];
+        p->n = tst_build_sort(p->w, p->n);
+        p->root =
+            tst_build_range(&wk->pool, b->cpy, p->w, 0, p->n, 0, &wk->err);
+    }
+    return NULL;
+}
+
+/** tst_build_stitch() link the roots of partitions [lo, hi) into a lo/hi
+ *  spine. the partition holding the median word is the root, as the
+ *  group of the median would be in tst_build_range().
+ */
+static tst_node *tst_build_stitch(tst_part *p, size_t lo, size_t hi)
+{
+    size_t total = 0, half, b;
+
+    if (lo >= hi)
+        return NULL;
+    for (b = lo; b < hi; b++)
+        total += p[b].n;
+    half = total / 2;
+    for (b = lo; half >= p[b].n; b++)
+        half -= p[b].n;
+
+    p[b].root->lokid = tst_build_stitch(p, lo, b);
+    p[b].root->hikid = tst_build_stitch(p, b + 1, hi);
+    return p[b].root;
+}
+
+/** append the string chunks of 'src' to 'dst'. */
+static void tst_heap_merge(tst_heap *dst, const tst_heap *src)
+{
+    tst_strchunk *last;
+
+    if (!src->chunks)
+        return;
+    dst->live += src->live;
+    dst->dead += src->dead;
+    if (!dst->chunks) {
+        dst->chunks = src->chunks;
+        return;
+    }
+    for (last = src->chunks; last->next; last = last->next)
+        ;
+    last->next = dst->chunks->next; /* keep filling the newest chunk */
+    dst->chunks->next = src->chunks;
+}
+
+/** append the chunks of 'src' to 'dst', 'src' holds no free nodes since
+ *  building never releases any.
+ */
+static void tst_pool_merge(tst_pool *dst, const tst_pool *src)
+{
+    tst_chunk *last;
+
+    tst_heap_merge(&dst->heap, &src->heap);
+    if (!src->chunks)
+        return;
+    if (!dst->chunks) {
+        dst->chunks = src->chunks;
+        dst->used = src->used;
+        return;
+    }
+    for (last = src->chunks; last->next; last = last->next)
+        ;
+    last->next = dst->chunks->next; /* keep carving the newest chunk */
+    dst->chunks->next = src->chunks;
+}
+
+/** tst_build_parallel() tst_build() on 'nthreads' threads, see tst.h. */
+int tst_build_parallel(tst_tree *t,
+                       const char *const *words,
+                       size_t n,
+                       int nthreads)
+{
+    size_t m, count[256] = {0}, off[256], nparts = 0, order[256];
+    tst_part parts[256];
+    tst_bword *w, *pw;
+    char *keys;
+    int err = 0;
+
+    if (t->root) /* only an empty tree is built from partitions */
+        return tst_build(t, words, n);
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > BUILDTHREADS)
+        nthreads = BUILDTHREADS;
+    if (!(w = tst_build_words(t, words, n, &m, &keys)))
+        return -1;
+    if (!(pw = malloc((m ? m : 1) * sizeof *pw))) {
+        free(keys);
+        free(w);
+        return -1;
+    }
+
+    /* partition by leading byte in tree order (signed), keeping input order
+     * within a partition so the first spelling of a key still leads.
+     */
+    for (size_t i = 0; i < m; i++)
+        count[(unsigned char) w[i].key[0]]++;
+    for (int c = CHAR_MIN, sum = 0; c <= CHAR_MAX; c++) {
+        unsigned char u = c;
+        off[u] = sum;
+        sum += count[u];
+        if (count[u])
+            parts[nparts++] = (tst_part){.w = pw + off[u], .n = count[u]};
+    }
+    for (size_t i = 0; i < m; i++)
+        pw[off[(unsigned char) w[i].key[0]]++] = w[i];
+
+    /* largest partitions first, so no worker is left with a big one last */
+    for (size_t i = 0; i < nparts; i++) {
+        size_t j = i;
+        for (; j && parts[order[j - 1]].n < parts[i].n; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    tst_builder b = {.parts = parts, .order = order, .nparts = nparts,
+                     .next = 0, .cpy = t->cpy};
+    tst_worker wk[BUILDTHREADS];
+    pthread_t tid[BUILDTHREADS];
+    int started = 1;
+
+    for (int i = 0; i < nthreads; i++)
+        wk[i] = (tst_worker){
+            .b = &b, .pool = {.epoch = t->pool.epoch}, .err = 0};
+    for (; started < nthreads; started++)
+        if (pthread_create(&tid[started], NULL, tst_build_worker,
+                           &wk[started]))
+            break;
+    tst_build_worker(&wk[0]); /* the caller is worker 0 */
+    for (int i = 0; i < nthreads; i++) {
+        if (i && i < started)
+            pthread_join(tid[i], NULL);
+        tst_pool_merge(&t->pool, &wk[i].pool);
+        err |= wk[i].err;
+    }
+
+    /* a failed partition is left out of the spine */
+    size_t built = 0;
+    for (size_t i = 0; i < nparts; i++)
+        if (parts[i].root)
+            parts[built++] = parts[i];
+    STORE(t->root, tst_build_stitch(parts, 0, built));
+    tst_cache_clear(t->cache);
+
+    free(pw);
+    free(keys);
+    free(w);
+    return err ? -1 : 0;
+}
+
+/** tst_tree_root() returns the root node of 't' for the search functions. */
+const tst_node *tst_tree_root(const tst_tree *t)
+{
+    return LOAD(t->root);
+}
+
+/** tst_tree_free() release 't', dropping every pool chunk at once. Strings
+ *  are only visited in copy mode.
+ */
+void tst_tree_free(tst_tree *t)
+{
+    if (!t)
+        return;
+    tst_epoch_free(t->pool.epoch); /* recycles nodes, frees retired words */
+    if (t->cpy && t->pool.epoch)
+        tst_free_strings(t->root);
+    tst_heap_free(&t->pool.heap);
+    tst_tree_cache(t, 0);
+    while (t->pool.chunks) {
+        tst_chunk *chunk = t->pool.chunks;
+        t->pool.chunks = chunk->next;
+        free(chunk);
+    }
+    free(t);
+}
+
+/** count the nodes below 'p', adding the bytes of copied strings to 'bytes'
+ *  if non-NULL.
+ */
+static size_t tst_count(const tst_node *p, size_t *bytes)
+{
+    size_t n;
+
+    if (!p)
+        return 0;
+    n = 1 + tst_count(p->lokid, bytes) + tst_count(p->hikid, bytes);
+    if (p->key)
+        n += tst_count(p->eqkid, bytes);
+    else if (bytes && p->eqkid)
+        *bytes += strlen((char *) p->eqkid) + 1;
+    return n;
+}
+
+/** tst_memory_usage() returns the bytes held by node and string storage of
+ *  't', storing the number of live nodes in 'nodes' if non-NULL.
+ */
+size_t tst_memory_usage(const tst_tree *t, size_t *nodes)
+{
+    size_t bytes = sizeof *t, n;
+
+    n = tst_count(t->root, t->cpy && t->pool.epoch ? &bytes : NULL);
+    for (const tst_chunk *c = t->pool.chunks; c; c = c->next)
+        bytes += sizeof *c;
+    for (const tst_strchunk *c = t->pool.heap.chunks; c; c = c->next)
+        bytes += sizeof *c;
+    for (const tst_strchunk *c = t->pool.heap.spare; c; c = c->next)
+        bytes += sizeof *c;
+    if (t->cache)
+        bytes += sizeof *t->cache + t->cache->bytes +
+                 t->cache->cap * sizeof *t->cache->ent +
+                 (t->cache->mask + 1) * sizeof *t->cache->bucket;
+    if (nodes)
+        *nodes = n;
+    return bytes;
+}
+
+/** tst_shape() add the nodes below 'p', 'depth' nodes down, to 'st' and
+ *  the depth of each word to 'sum'.
+ */
+static void tst_shape(const tst_node *p,
+                      size_t depth,
+                      tst_stats *st,
+                      double *sum)
+{
+    if (!p)
+        return;
+    st->nodes++;
+    depth++;
+    tst_shape(p->lokid, depth, st, sum);
+    if (!p->eqkid)
+        st->dead++;
+    else if (p->key)
+        tst_shape(p->eqkid, depth, st, sum);
+    else {
+        st->words++;
+        *sum += depth;
+        if (depth > st->maxdepth)
+            st->maxdepth = depth;
+    }
+    tst_shape(p->hikid, depth, st, sum);
+}
+
+/** tst_tree_stats() fill 'st' with the shape and memory of 't'. */
+void tst_tree_stats(const tst_tree *t, tst_stats *st)
+{
+    double sum = 0;
+
+    *st = (tst_stats){0};
+    tst_shape(t->root, 0, st, &sum);
+    st->avgdepth = st->words ? sum / st->words : 0;
+    st->bytes = tst_memory_usage(t, NULL);
+}
+
+/** live node of a sibling group being rebalanced, the words below it. */
+typedef struct tst_rnode {
+    tst_node *node;
+    size_t words;
+} tst_rnode;
+
+/** nodes of the sibling group, the lo/hi tree, rooted at 'p'. */
+static size_t tst_group_size(const tst_node *p)
+{
+    return p ? 1 + tst_group_size(p->lokid) + tst_group_size(p->hikid) : 0;
+}
+
+/** append the nodes of the sibling group at 'p' to 'a' in key order. */
+static void tst_group_fill(tst_node *p, tst_rnode *a, size_t *n)
+{
+    if (!p)
+        return;
+    tst_group_fill(p->lokid, a, n);
+    a[(*n)++].node = p;
+    tst_group_fill(p->hikid, a, n);
+}
+
+/** tst_group_build() link the 'n' nodes of 'a' into a lo/hi tree rooted
+ *  at the node holding the median word, as tst_build() lays out a group.
+ *  returns the root.
+ */
+static tst_node *tst_group_build(tst_rnode *a, size_t n)
+{
+    size_t total = 0, sum = 0, mid = 0;
+    tst_node *p;
+
+    if (!n)
+        return NULL;
+    for (size_t i = 0; i < n; i++)
+        total += a[i].words;
+    for (; mid < n - 1; mid++) {
+        sum += a[mid].words;
+        if (2 * sum > total)
+            break;
+    }
+    p = a[mid].node;
+    p->lokid = tst_group_build(a, mid);
+    p->hikid = tst_group_build(a + mid + 1, n - mid - 1);
+    p->maxscore = tst_maxscore(p);
+    return p;
+}
+
+/** tst_rebalance_group() rebuild the sibling group at 'p' and every group
+ *  below it balanced by word count, releasing the nodes a delete left
+ *  without an eq kid to 'pool'. The number of words below is stored in
+ *  'words'. A group that can not be rebuilt for lack of memory is kept as
+ *  is, with 'err' set. returns the new root of the group.
+ */
+static tst_node *tst_rebalance_group(tst_node *p,
+                                     tst_pool *pool,
+                                     size_t *words,
+                                     int *err)
+{
+    size_t n = tst_group_size(p), m = 0;
+    tst_rnode *a;
+
+    *words = 0;
+    if (!p)
+        return NULL;
+    if (!(a = malloc(n * sizeof *a))) {
+        *err = 1;
+        *words = n;
+        return p;
+    }
+    n = 0;
+    tst_group_fill(p, a, &n);
+    for (size_t i = 0; i < n; i++) {
+        tst_node *q = a[i].node;
+        size_t w = 1;
+
+        if (q->key && q->eqkid)
+            q->eqkid = tst_rebalance_group(q->eqkid, pool, &w, err);
+        if (!q->eqkid) { /* dead, or nothing left below it */
+            tst_node_release(pool, q);
+            continue;
+        }
+        a[m++] = (tst_rnode){.node = q, .words = w};
+        *words += w;
+    }
+    p = tst_group_build(a, m);
+    free(a);
+    return p;
+}
+
+/** count the words below 'p'. */
+static size_t tst_words_below(const tst_node *p)
+{
+    size_t n;
+
+    if (!p)
+        return 0;
+    n = tst_words_below(p->lokid) + tst_words_below(p->hikid);
+    return n + (p->key ? tst_words_below(p->eqkid) : p->eqkid != NULL);
+}
+
+/** tst_rebalance_top() rebuild the sibling group of the leading bytes of
+ *  't' once it holds a dead node, releasing it and leaving the groups below
+ *  as they are. Weighing the siblings walks the whole tree, so a group
+ *  without dead nodes is left alone.
+ */
+static void tst_rebalance_top(tst_tree *t, int *err)
+{
+    size_t n = tst_group_size(t->root), m = 0, i;
+    tst_rnode *a;
+
+    if (!n)
+        return;
+    if (!(a = malloc(n * sizeof *a))) {
+        *err = 1;
+        return;
+    }
+    n = 0;
+    tst_group_fill(t->root, a, &n);
+    for (i = 0; i < n && a[i].node->eqkid; i++)
+        ;
+    if (i < n) {
+        for (i = 0; i < n; i++) {
+            tst_node *q = a[i].node;
+            if (!q->eqkid) {
+                tst_node_release(&t->pool, q);
+                continue;
+            }
+            a[m++] = (tst_rnode){
+                .node = q, .words = q->key ? tst_words_below(q->eqkid) : 1};
+        }
+        t->root = tst_group_build(a, m);
+    }
+    free(a);
+}
+
+/** tst_rebalance() rebuild the whole tree, or the subtrees of the 'parts'
+ *  leading bytes with the most deletes, see tst.h.
+ */
+int tst_rebalance(tst_tree *t, int parts)
+{
+    size_t words;
+    int err = 0;
+
+    if (t->pool.epoch)
+        return -1;
+    tst_cache_clear(t->cache); /* cached nodes may be released */
+    if (parts <= 0) {
+        t->root = tst_rebalance_group(t->root, &t->pool, &words, &err);
+        memset(t->churn, 0, sizeof t->churn);
+        return err ? -1 : 0;
+    }
+    while (parts--) {
+        int c = 1;
+        tst_node **slot = &t->root;
+
+        for (int i = 1; i < 256; i++)
+            if (t->churn[i] > t->churn[c])
+                c = i;
+        if (!t->churn[c])
+            break;
+        t->churn[c] = 0;
+
+        /* the subtree of the words led by 'c' is the eq kid of its node */
+        while (*slot && (*slot)->key != (char) c)
+            slot = (char) c < (*slot)->key ? &(*slot)->lokid : &(*slot)->hikid;
+        if (*slot && (*slot)->eqkid)
+            (*slot)->eqkid = tst_rebalance_group((*slot)->eqkid, &t->pool,
+                                                 &words, &err);
+    }
+    tst_rebalance_top(t, &err);
+    return err ? -1 : 0;
+}
+
+/** tst_relocate() copy the nodes below 'p' to 'pool' depth first, each
+ *  node followed by its lo, eq and hi subtrees, the order a walk of the
+ *  words visits them. returns the copy of 'p', NULL with 'err' set on
+ *  allocation failure.
+ */
+static tst_node *tst_relocate(const tst_node *p, tst_pool *pool, int *err)
+{
+    tst_node *n;
+
+    if (!p || *err)
+        return NULL;
+    if (!(n = tst_node_alloc(pool))) {
+        *err = 1;
+        return NULL;
+    }
+    *n = *p;
+    n->lokid = tst_relocate(p->lokid, pool, err);
+    if (p->key)
+        n->eqkid = tst_relocate(p->eqkid, pool, err);
+    n->hikid = tst_relocate(p->hikid, pool, err);
+    return n;
+}
+
+/** tst_compact() rebalance 't', then move its nodes to fresh chunks in
+ *  depth first order and repack its string heap, see tst.h.
+ */
+int tst_compact(tst_tree *t)
+{
+    tst_pool fresh = {NULL};
+    tst_chunk *old;
+    tst_node *root;
+    int err = 0;
+
+    if (tst_rebalance(t, 0))
+        return -1;
+    root = tst_relocate(t->root, &fresh, &err);
+    old = err ? fresh.chunks : t->pool.chunks;
+    while (old) {
+        tst_chunk *next = old->next;
+        free(old);
+        old = next;
+    }
+    if (err)
+        return -1;
+    t->root = root;
+    t->pool.chunks = fresh.chunks;
+    t->pool.used = fresh.used;
+    t->pool.free = NULL;
+    if (t->pool.heap.dead && tst_heap_compact(&t->pool.heap, t->root))
+        return -1;
+    return 0;
+}
+
+/** access functions tst_get_key(), tst_get_refcnt, tst_get_score() &
+ *  tst_get_string(). provide access to struct members through opaque
+ *  pointers availale to program.
+ */
+char tst_get_key(const tst_node *node)
+{
+    return node->key;
+}
+
+unsigned tst_get_refcnt(const tst_node *node)
+{
+    return node->refcnt;
+}
+
+unsigned tst_get_score(const tst_node *node)
+{
+    return node->score;
 }
 
 char *tst_get_string(const tst_node *node)
@@ -5,15 +5,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "tst_epoch.h"
+
 /* forward declaration of ternary search tree */
 typedef struct tst_node tst_node;
 
+/* forward declaration of tree handle owning the root and a node pool */
+typedef struct tst_tree tst_tree;
+
 /** tst_del() del copy or reference of 's' from ternary search tree.
  *  If 's' already exists in tree, decrement node->refcnt.
  *  If node->refcnt is zero after decrement, remove assoshiated nodes.
  *  If 'cpy' is non-zero, free the allocated space of string.
  *  Returns the address of 's' in tree on delete if refcnt non-zero,
- *  -1 on 's' not found in ternary search tree,
+ *  -1 on 's' not found in ternary search tree (a word too long to insert
+ *  never is),
  *  otherwise returns NULL.
  */
 void *tst_del(tst_node **root, const char *s, const int cpy);
@@ -29,6 +35,16 @@ void *tst_del(tst_node **root, const char *s, const int cpy);
  */
 void *tst_ins(tst_node **root, const char *s, const int cpy);
 
+/** tst_ins_score() as tst_ins(), attaching 'score' to 's'. A word inserted
+ *  again keeps the highest score it was given, and every node tracks the
+ *  highest score in its subtree for tst_search_prefix_topk(). tst_ins()
+ *  inserts with a score of 0.
+ */
+void *tst_ins_score(tst_node **root,
+                    const char *s,
+                    const int cpy,
+                    const unsigned score);
+
 /** tst_search(), non-recursive find of a string in ternary tree.
  *  returns pointer to 's' on success, NULL otherwise.
  */
@@ -48,6 +64,116 @@ void *tst_search_prefix(const tst_node *root,
                         int *n,
                         const int max);
 
+/** tst_search_batch() look up the 'n' strings of 'keys', storing in
+ *  res[i] what tst_search() returns for keys[i]. Up to 16 lookups advance
+ *  in turn one node at a time, each prefetching its next node before the
+ *  batch moves on, so the cache misses of independent lookups overlap
+ *  instead of each lookup waiting on its own pointer chase.
+ */
+void tst_search_batch(const tst_node *root,
+                      const char *const *keys,
+                      size_t n,
+                      void **res);
+
+/** tst_search_prefix_batch() tst_search_prefix() for the 'n' prefixes of
+ *  'keys' with the descents interleaved as in tst_search_batch(). The
+ *  words prefixed with keys[i] are stored in a[i * max] onwards, up to
+ *  'max' of them, their count in cnt[i] and the return value of
+ *  tst_search_prefix() in res[i].
+ */
+void tst_search_prefix_batch(const tst_node *root,
+                             const char *const *keys,
+                             size_t n,
+                             char **a,
+                             int *cnt,
+                             const int max,
+                             void **res);
+
+/** tst_search_fuzzy() fills ptr array 'a' with up to 'max' words within
+ *  'maxdist' edits (byte insert, delete or substitute) of 's', in order,
+ *  updating 'n' with the number of words in 'a'. The tree is walked with
+ *  one Levenshtein row per depth and a branch is cut once no entry of its
+ *  row is within 'maxdist'. returns non-NULL if a word is found, NULL
+ *  otherwise.
+ */
+void *tst_search_fuzzy(const tst_node *root,
+                       const char *s,
+                       const int maxdist,
+                       char **a,
+                       int *n,
+                       const int max);
+
+/** tst_search_prefix_fuzzy() as tst_search_fuzzy(), for autocomplete:
+ *  fills 'a' with the words having a prefix within 'maxdist' edits of 's'.
+ */
+void *tst_search_prefix_fuzzy(const tst_node *root,
+                              const char *s,
+                              const int maxdist,
+                              char **a,
+                              int *n,
+                              const int max);
+
+/** tst_search_prefix_topk() fills ptr array 'a' with the 'k' highest
+ *  scored words prefixed with 's', highest first, updating 'n' with the
+ *  number of words in 'a'. An empty 's' ranks the whole tree. The search
+ *  is best first on the subtree maximum scores, so subtrees that can not
+ *  beat the k-th word are never visited. a pointer to the first node is
+ *  returned on success NULL otherwise.
+ */
+void *tst_search_prefix_topk(const tst_node *root,
+                             const char *s,
+                             char **a,
+                             int *n,
+                             const int k);
+
+/* forward declaration of prefix search cursor */
+typedef struct tst_prefix_iter tst_prefix_iter;
+
+/** tst_prefix_iter_begin() start a cursor over the words prefixed with 's'
+ *  in order, an empty 's' walks the whole tree. The cursor keeps its own
+ *  traversal stack so each call to tst_prefix_iter_next() resumes where
+ *  the previous one stopped, a page of 'k' words costs O(k) whatever the
+ *  offset. The tree must not be modified while a cursor is in use.
+ *  returns NULL on allocation failure.
+ */
+tst_prefix_iter *tst_prefix_iter_begin(const tst_node *root, const char *s);
+
+/** tst_prefix_iter_next() returns the next word, NULL when exhausted. */
+char *tst_prefix_iter_next(tst_prefix_iter *it);
+
+/** tst_prefix_iter_end() release a cursor. */
+void tst_prefix_iter_end(tst_prefix_iter *it);
+
+/* forward declaration of ordered iterator */
+typedef struct tst_iter tst_iter;
+
+/** tst_seek() start an iterator just before the first word not below
+ *  'key' in tree order, chars comparing as signed. The iterator descends
+ *  straight to that point and then walks in order with its own stack, so
+ *  it costs O(depth) to place and O(1) amortized per word, recursion free
+ *  however skewed the tree. Moving back with tst_iter_prev() from there
+ *  reaches the words below 'key'. The tree must not be modified while an
+ *  iterator is in use. returns NULL on allocation failure.
+ */
+tst_iter *tst_seek(const tst_node *root, const char *key);
+
+/** tst_range() start an iterator over the words in [lo, hi), a NULL bound
+ *  leaves that side open. The iterator stays inside the range in both
+ *  directions. returns NULL on allocation failure.
+ */
+tst_iter *tst_range(const tst_node *root, const char *lo, const char *hi);
+
+/** tst_iter_next() returns the next word in order, tst_iter_prev() the
+ *  previous one, NULL past either end. The iterator stands on the word
+ *  last returned: next() then prev() returns the word before it. Having
+ *  run off an end, the opposite call returns the word at that end again.
+ */
+char *tst_iter_next(tst_iter *it);
+char *tst_iter_prev(tst_iter *it);
+
+/** tst_iter_end() release an iterator. */
+void tst_iter_end(tst_iter *it);
+
 /** tst_traverse_fn(), traverse tree calling 'fn' on each word.
  *  prototype for 'fn' is void fn(const void *, void *). data can
  *  be NULL if unused.
@@ -65,18 +191,196 @@ void tst_traverse_fn(const tst_node *p,
                      void(fn)(const void *, void *),
                      void *data);
 
+/** tst_traverse_key_fn() behaves as tst_traverse_fn(), also passing 'fn'
+ *  the key of each word: the chars on its path, which in a normalized tree
+ *  are the folded form rather than the spelling tst_get_string() returns.
+ *  The key is only valid during the call.
+ */
+void tst_traverse_key_fn(const tst_node *p,
+                         void(fn)(const void *, const char *, void *),
+                         void *data);
+
 /** free the ternary search tree rooted at p, data storage internal. */
 void tst_free_all(tst_node *p);
 
 /** free the ternary search tree rooted at p, data storage external. */
 void tst_free(tst_node *p);
 
-/** access functions tst_get_key(), tst_get_refcnt, & tst_get_string().
+/** tst_tree_create() allocate an empty tree handle. Nodes of the tree are
+ *  carved from large chunks of a pool owned by the handle and recycled on
+ *  delete through a free list. If 'cpy' is non-zero the tree stores copies
+ *  of the strings, otherwise references. Copies are packed back to back in
+ *  an append-only string heap of the handle, deletes leave holes in it
+ *  and once the holes outweigh the live strings tst_tree_del() repacks
+ *  them in tree order: strings returned by the tree may move on a delete.
+ *  returns NULL on allocation failure.
+ */
+tst_tree *tst_tree_create(const int cpy);
+
+/** tst_tree_create_norm() allocate an empty normalized tree: words are
+ *  keyed by their utf8_fold() form, lower case without accents, and the
+ *  tree stores the spelling a key was first inserted with, so "Köln" is
+ *  found and returned for "koln", "KOLN" or "Koln". Inserting another
+ *  spelling of a stored key only bumps its refcnt. Queries must go through
+ *  tst_tree_search() and tst_tree_search_prefix() to be folded the same
+ *  way. returns NULL on allocation failure.
+ */
+tst_tree *tst_tree_create_norm(const int cpy);
+
+/** tst_tree_create_concurrent() allocate an empty tree for one writer
+ *  thread and any number of reader threads. Readers take no locks: the
+ *  writer builds new nodes before publishing them with a release store,
+ *  and nodes and copied strings unlinked by tst_tree_del() are only
+ *  reused or freed once every read section that could reach them has
+ *  ended. A reader registers once with tst_tree_reader() and wraps each
+ *  lookup and its use of the results in tst_read_lock()/tst_read_unlock():
+ *
+ *      tst_read_lock(r);
+ *      res = tst_tree_search_prefix(t, s, a, &n, max);
+ *      ... use a[0 .. n - 1] ...
+ *      tst_read_unlock(r);
+ *
+ *  tst_tree_search(), tst_tree_search_prefix(), tst_search() and
+ *  tst_search_prefix() are safe in readers; updates, tst_build() and the
+ *  other searches stay with the writer. returns NULL on allocation failure.
+ */
+tst_tree *tst_tree_create_concurrent(const int cpy);
+
+/** tst_tree_reader() register the calling thread as a reader of the
+ *  concurrent tree 't', release it with tst_reader_leave(). returns NULL
+ *  if 't' is not concurrent or the reader slots are exhausted.
+ */
+tst_reader *tst_tree_reader(tst_tree *t);
+
+/** tst_tree_ins() and tst_tree_del() behave as tst_ins() and tst_del() on
+ *  the tree held by 't'.
+ */
+void *tst_tree_ins(tst_tree *t, const char *s);
+void *tst_tree_del(tst_tree *t, const char *s);
+
+/** tst_tree_ins_score() behaves as tst_ins_score() on the tree of 't'. */
+void *tst_tree_ins_score(tst_tree *t, const char *s, const unsigned score);
+
+/** tst_tree_search() and tst_tree_search_prefix() behave as tst_search()
+ *  and tst_search_prefix() on the tree of 't', normalizing 's' first if
+ *  the tree is normalized. A folded prefix never ends inside a code point.
+ */
+void *tst_tree_search(const tst_tree *t, const char *s);
+void *tst_tree_search_prefix(const tst_tree *t,
+                             const char *s,
+                             char **a,
+                             int *n,
+                             const int max);
+
+/** counters of the prefix result cache of a tree. */
+typedef struct tst_cache_stats {
+    size_t hits, misses; /* searches answered from the cache or the tree */
+    size_t invalidated;  /* entries dropped by an update of the tree */
+    size_t evicted;      /* entries dropped to make room */
+    size_t entries;      /* entries held now */
+} tst_cache_stats;
+
+/** tst_tree_cache() keep the results of up to 'entries' distinct prefix and
+ *  'max' pairs searched with tst_tree_search_prefix() on 't', evicting the
+ *  least recently hit one in CLOCK order when full. Each search then costs
+ *  a hash lookup and a copy of its result until an insert or delete of a
+ *  word the prefix begins drops the entry, updates to other words leave it
+ *  alone. 'entries' 0 drops the cache, resizing it empties it and zeroes
+ *  its counters. Concurrent trees can not be cached. returns 0 on success,
+ *  -1 on allocation failure or a concurrent tree.
+ */
+int tst_tree_cache(tst_tree *t, int entries);
+
+/** tst_tree_cache_stats() fill 'st' with the counters of the cache of 't',
+ *  all zero if it has none.
+ */
+void tst_tree_cache_stats(const tst_tree *t, tst_cache_stats *st);
+
+/** tst_build() bulk load 'n' words into 't'. The words are sorted and
+ *  duplicates folded into the refcnt of a single entry (words with the same
+ *  key in a normalized tree, the first of them stored). An empty tree is
+ *  built directly with the median of each group as subtree root, so every
+ *  lo/hi subtree is balanced whatever the input order; otherwise the words
+ *  are inserted median first. 'words' is left untouched and, in reference
+ *  mode, must outlive the tree. returns 0 on success, -1 on allocation
+ *  failure.
+ */
+int tst_build(tst_tree *t, const char *const *words, size_t n);
+
+/** tst_build_parallel() tst_build() on 'nthreads' threads (1 to 64) for
+ *  an empty tree. The words are partitioned by leading byte, each partition
+ *  is sorted and built into its own subtree by whichever worker claims it,
+ *  largest first, and the subtrees are linked under a lo/hi spine rooted
+ *  at the median word, so the tree is the one tst_build() makes. A tree
+ *  that is not empty falls back to tst_build(). returns 0 on success, -1
+ *  on allocation failure.
+ */
+int tst_build_parallel(tst_tree *t,
+                       const char *const *words,
+                       size_t n,
+                       int nthreads);
+
+/** tst_tree_root() returns the root of 't', to be passed to tst_search(),
+ *  tst_search_prefix() and tst_traverse_fn().
+ */
+const tst_node *tst_tree_root(const tst_tree *t);
+
+/** tst_tree_free() release all nodes of 't' in one step by dropping the
+ *  pool chunks, strings are freed first in copy mode. No reader of a
+ *  concurrent tree may be left in a read section.
+ */
+void tst_tree_free(tst_tree *t);
+
+/** tst_memory_usage() returns the bytes held by node and string storage of
+ *  't', storing the number of live nodes in 'nodes' if non-NULL. Compare
+ *  with tst_idx_memory_usage() for the compact node layout.
+ */
+size_t tst_memory_usage(const tst_tree *t, size_t *nodes);
+
+/** shape and memory of a tree, see tst_tree_stats(). */
+typedef struct tst_stats {
+    size_t words;    /* distinct words */
+    size_t nodes;    /* nodes reachable from the root */
+    size_t dead;     /* nodes a delete left without an eq kid */
+    size_t maxdepth; /* most nodes visited to reach a word */
+    double avgdepth; /* nodes visited to reach a word on average */
+    size_t bytes;    /* tst_memory_usage() */
+} tst_stats;
+
+/** tst_tree_stats() fill 'st' with the shape and memory of 't', walking
+ *  the whole tree.
+ */
+void tst_tree_stats(const tst_tree *t, tst_stats *st);
+
+/** tst_rebalance() rebuild the lo/hi trees of siblings of 't' balanced by
+ *  word count, as tst_build() lays them out, releasing the nodes deletes
+ *  left behind when they could not rotate them out. 'parts' 0 rebuilds
+ *  the whole tree; otherwise only the subtrees of the 'parts' leading
+ *  bytes with the most deletes since they were last rebuilt, so churn can
+ *  be repaired a little at a time, and the group of leading bytes itself
+ *  once it holds a dead node. Released nodes go back to the pool of the
+ *  tree. Not for concurrent trees. returns 0 on success, -1 if some
+ *  group was kept as is for lack of memory or 't' is concurrent.
+ */
+int tst_rebalance(tst_tree *t, int parts);
+
+/** tst_compact() tst_rebalance() the whole of 't', then copy its nodes to
+ *  new pool chunks in depth first order, dropping the old chunks and the
+ *  free list, and repack the string heap of a copying tree. Nodes reached
+ *  one after the other by a search or a prefix walk end up side by side.
+ *  Strings may move. Not for concurrent trees. returns 0 on success, -1 on
+ *  allocation failure, the tree then left as it was or only rebalanced.
+ */
+int tst_compact(tst_tree *t);
+
+/** access functions tst_get_key(), tst_get_refcnt, tst_get_score() &
+ *  tst_get_string().
  *  provide access to struct members through opague pointers availale
  *  to program.
  */
 char tst_get_key(const tst_node *node);
 unsigned tst_get_refcnt(const tst_node *node);
+unsigned tst_get_score(const tst_node *node);
 char *tst_get_string(const tst_node *node);
 
 #endif
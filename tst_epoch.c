@@ -0,0 +1,146 @@
+#include <sched.h>
+#include <stdlib.h>
+
+#include "tst_epoch.h"
+
+/** reader slots of a domain, readers beyond that fail to join. */
+#define RDMAX 64
+
+/** reader slot on its own cache line, written by its reader only. */
+struct tst_reader {
+    unsigned long epoch; /* epoch of the current read section, 0 if none */
+    int used;
+    tst_epoch *ep;
+} __attribute__((aligned(64)));
+
+/** memory waiting for the readers of its epoch. */
+typedef struct tst_retired {
+    void *p;
+    void (*fn)(void *, void *);
+    void *arg;
+} tst_retired;
+
+typedef struct tst_limbo {
+    tst_retired *r;
+    size_t n, cap;
+} tst_limbo;
+
+/** the global epoch starts at 1, memory retired during epoch e sits in
+ *  limbo[e % 3] and is freed when the epoch becomes e + 2.
+ */
+struct tst_epoch {
+    struct tst_reader readers[RDMAX];
+    unsigned long epoch;
+    tst_limbo limbo[3];
+};
+
+tst_epoch *tst_epoch_create(void)
+{
+    tst_epoch *ep;
+
+    if (posix_memalign((void **) &ep, 64, sizeof *ep))
+        return NULL;
+    *ep = (tst_epoch){.epoch = 1};
+    for (int i = 0; i < RDMAX; i++)
+        ep->readers[i].ep = ep;
+    return ep;
+}
+
+static void tst_limbo_run(tst_limbo *l)
+{
+    for (size_t i = 0; i < l->n; i++)
+        l->r[i].fn(l->r[i].p, l->r[i].arg);
+    l->n = 0;
+}
+
+void tst_epoch_free(tst_epoch *ep)
+{
+    if (!ep)
+        return;
+    for (int i = 0; i < 3; i++) {
+        tst_limbo_run(&ep->limbo[i]);
+        free(ep->limbo[i].r);
+    }
+    free(ep);
+}
+
+tst_reader *tst_reader_join(tst_epoch *ep)
+{
+    for (int i = 0; i < RDMAX; i++) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&ep->readers[i].used, &unused, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return &ep->readers[i];
+    }
+    return NULL;
+}
+
+void tst_reader_leave(tst_reader *r)
+{
+    if (r)
+        __atomic_store_n(&r->used, 0, __ATOMIC_RELEASE);
+}
+
+void tst_read_lock(tst_reader *r)
+{
+    unsigned long e = __atomic_load_n(&r->ep->epoch, __ATOMIC_RELAXED);
+
+    /* the announce must be visible before any load of the structure */
+    __atomic_store_n(&r->epoch, e, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void tst_read_unlock(tst_reader *r)
+{
+    __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/** tst_epoch_advance() move to the next epoch if no reader is in a section
+ *  of an older one, returns non-zero if the epoch moved.
+ */
+static int tst_epoch_advance(tst_epoch *ep)
+{
+    unsigned long e = ep->epoch;
+
+    /* pairs with the fence of tst_read_lock(), unlinks happen before */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < RDMAX; i++) {
+        unsigned long re =
+            __atomic_load_n(&ep->readers[i].epoch, __ATOMIC_ACQUIRE);
+        if (re && re != e)
+            return 0;
+    }
+    __atomic_store_n(&ep->epoch, e + 1, __ATOMIC_RELEASE);
+    tst_limbo_run(&ep->limbo[(e + 2) % 3]); /* retired during e - 1 */
+    return 1;
+}
+
+void tst_epoch_poll(tst_epoch *ep)
+{
+    tst_epoch_advance(ep);
+}
+
+void tst_epoch_retire(tst_epoch *ep,
+                      void *p,
+                      void (*fn)(void *, void *),
+                      void *arg)
+{
+    tst_limbo *l = &ep->limbo[ep->epoch % 3];
+
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        tst_retired *r = realloc(l->r, cap * sizeof *r);
+        if (!r) { /* wait two epochs, no reader can reach 'p' after that */
+            for (int moved = 0; moved < 2;)
+                if (tst_epoch_advance(ep))
+                    moved++;
+                else
+                    sched_yield();
+            fn(p, arg);
+            return;
+        }
+        l->r = r;
+        l->cap = cap;
+    }
+    l->r[l->n++] = (tst_retired){.p = p, .fn = fn, .arg = arg};
+}
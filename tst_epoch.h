@@ -0,0 +1,52 @@
+#ifndef TST_EPOCH_H
+#define TST_EPOCH_H
+
+/* forward declaration of epoch based reclamation domain. One writer
+ * unlinks memory from a shared structure and retires it, readers take no
+ * locks but announce the epoch they read in, and retired memory is only
+ * freed two epochs later, once no reader can still hold a pointer to it.
+ */
+typedef struct tst_epoch tst_epoch;
+
+/* forward declaration of a registered reader thread */
+typedef struct tst_reader tst_reader;
+
+/** tst_epoch_create() returns a new domain, NULL on allocation failure. */
+tst_epoch *tst_epoch_create(void);
+
+/** tst_epoch_free() run every pending free and release the domain, no
+ *  reader may be inside a read section.
+ */
+void tst_epoch_free(tst_epoch *ep);
+
+/** tst_reader_join() register the calling thread as a reader of 'ep'.
+ *  returns NULL if every reader slot is taken.
+ */
+tst_reader *tst_reader_join(tst_epoch *ep);
+
+/** tst_reader_leave() release the reader slot of 'r'. */
+void tst_reader_leave(tst_reader *r);
+
+/** tst_read_lock() and tst_read_unlock() delimit a read section, memory
+ *  reached inside it stays valid until tst_read_unlock(). Sections do not
+ *  nest and neither call blocks.
+ */
+void tst_read_lock(tst_reader *r);
+void tst_read_unlock(tst_reader *r);
+
+/** tst_epoch_retire() defer 'fn(p, arg)' until no reader can reach 'p',
+ *  writer side only. 'p' must already be unlinked from the structure.
+ *  When the pending list can not grow the writer waits for the readers
+ *  and frees 'p' in place.
+ */
+void tst_epoch_retire(tst_epoch *ep,
+                      void *p,
+                      void (*fn)(void *, void *),
+                      void *arg);
+
+/** tst_epoch_poll() advance the epoch if every reader has caught up with
+ *  it and free what was retired two epochs before, writer side only.
+ */
+void tst_epoch_poll(tst_epoch *ep);
+
+#endif
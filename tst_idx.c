@@ -0,0 +1,537 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tst_idx.h"
+
+/** max word length to store in ternary search tree, stack size */
+#define WRDMAX 128
+#define STKMAX (WRDMAX * 2)
+
+/** bytes per block of the string heap, strings never straddle blocks so
+ *  the address returned for a string stays valid until the heap is
+ *  repacked.
+ */
+#define HEAPBLOCK (1 << 16)
+
+/** the refcnt shares a 32-bit word with the key. */
+#define REFMAX 0xffffffU
+
+/** compact ternary search tree node, 16 bytes. index 0 is the nil node.
+ *  string refs start at 1 as well, a final node with ref 0 is a word left
+ *  behind by a delete whose siblings could not be rotated.
+ */
+typedef struct tst_inode {
+    uint32_t lokid;  /* ternary low child index */
+    uint32_t eqkid;  /* ternary equal child index, string ref if key nul */
+    uint32_t hikid;  /* ternary high child index */
+    uint32_t keyref; /* key in the low byte, refcnt in the upper 24 bits */
+} tst_inode;
+
+#define IKEY(n) ((char) ((n)->keyref & 0xff))
+#define IREF(n) ((n)->keyref >> 8)
+#define IONE (1U << 8)
+
+/** string heap of a copying tree, blocks past 'nblocks' are spares taken
+ *  before a new one is allocated. deleted strings are holes counted in
+ *  'dead' until tst_idx_compact() repacks the live ones.
+ */
+typedef struct tst_iheap {
+    char **blocks;
+    uint32_t nblocks; /* blocks in use */
+    uint32_t nalloc;  /* blocks allocated, spares included */
+    uint32_t top;     /* offset of the next free byte */
+    size_t live, dead;
+} tst_iheap;
+
+/** slot of the reference table, a free slot chains the next one. */
+typedef union tst_iref {
+    const char *s;
+    uint32_t next;
+} tst_iref;
+
+struct tst_idx {
+    tst_inode *nodes; /* node array, slot 0 unused */
+    uint32_t nnodes;  /* slots handed out, including slot 0 */
+    uint32_t cap;     /* slots allocated */
+    uint32_t free;    /* released nodes, chained through eqkid */
+    uint32_t root;
+    size_t live; /* nodes in the tree */
+    int cpy;
+
+    /* copy mode: string refs are byte offsets into the block heap */
+    tst_iheap heap;
+
+    /* reference mode: string refs are slots of 'refs' */
+    tst_iref *refs;
+    uint32_t nrefs;
+    uint32_t refcap;
+    uint32_t rfree; /* released slots, chained through 'next' */
+};
+
+/** return the string of 'h' at offset 'ref'. */
+static char *tst_iheap_string(const tst_iheap *h, uint32_t ref)
+{
+    return h->blocks[ref / HEAPBLOCK] + ref % HEAPBLOCK;
+}
+
+/** return the string stored under 'ref'. */
+static char *tst_idx_string(const tst_idx *t, uint32_t ref)
+{
+    if (t->cpy)
+        return tst_iheap_string(&t->heap, ref);
+    return (char *) t->refs[ref].s;
+}
+
+/** tst_iheap_grow() make block 'nblocks' of 'h' available, a spare if
+ *  there is one. returns 0 on success, -1 on allocation failure.
+ */
+static int tst_iheap_grow(tst_iheap *h)
+{
+    if ((uint64_t) h->nblocks * HEAPBLOCK + HEAPBLOCK > UINT32_MAX)
+        return -1;
+    if (h->nblocks == h->nalloc) {
+        char **blocks = realloc(h->blocks, (h->nalloc + 1) * sizeof *blocks);
+        if (!blocks)
+            return -1;
+        h->blocks = blocks;
+        if (!(h->blocks[h->nalloc] = malloc(HEAPBLOCK)))
+            return -1;
+        h->nalloc++;
+    }
+    h->top = h->nblocks++ * HEAPBLOCK;
+    if (!h->top) /* ref 0 is the nil string */
+        h->top = 1;
+    return 0;
+}
+
+/** tst_iheap_dup() append a copy of 's' to 'h', storing its offset in
+ *  'ref'. returns 0 on success, -1 on allocation failure.
+ */
+static int tst_iheap_dup(tst_iheap *h, const char *s, uint32_t *ref)
+{
+    size_t len = strlen(s) + 1;
+
+    if (h->top + len > (uint64_t) h->nblocks * HEAPBLOCK && tst_iheap_grow(h))
+        return -1;
+    memcpy(tst_iheap_string(h, h->top), s, len);
+    *ref = h->top;
+    h->top += len;
+    h->live += len;
+    return 0;
+}
+
+static void tst_iheap_free(tst_iheap *h)
+{
+    for (uint32_t i = 0; i < h->nalloc; i++)
+        free(h->blocks[i]);
+    free(h->blocks);
+    *h = (tst_iheap){NULL};
+}
+
+/** tst_idx_store() save a copy or a reference of 's', storing its ref in
+ *  'ref'. returns 0 on success, -1 on allocation failure.
+ */
+static int tst_idx_store(tst_idx *t, const char *s, uint32_t *ref)
+{
+    if (t->cpy)
+        return tst_iheap_dup(&t->heap, s, ref);
+
+    if (t->rfree) {
+        *ref = t->rfree;
+        t->rfree = t->refs[*ref].next;
+        t->refs[*ref].s = s;
+        return 0;
+    }
+    if (!t->nrefs)
+        t->nrefs = 1;
+    if (t->nrefs >= t->refcap) {
+        uint32_t cap = t->refcap ? t->refcap + t->refcap / 2 : 1024;
+        tst_iref *refs = realloc(t->refs, cap * sizeof *refs);
+        if (!refs)
+            return -1;
+        t->refs = refs;
+        t->refcap = cap;
+    }
+    t->refs[t->nrefs].s = s;
+    *ref = t->nrefs++;
+    return 0;
+}
+
+/** tst_idx_unstore() release the string under 'ref': a reference slot goes
+ *  back on its free list, the bytes of a copy are counted dead until the
+ *  heap is repacked.
+ */
+static void tst_idx_unstore(tst_idx *t, uint32_t ref)
+{
+    if (t->cpy) {
+        size_t len = strlen(tst_iheap_string(&t->heap, ref)) + 1;
+        t->heap.live -= len;
+        t->heap.dead += len;
+        return;
+    }
+    t->refs[ref].next = t->rfree;
+    t->rfree = ref;
+}
+
+/** copy the string of every terminal node below 'i' to 'h' in tree order,
+ *  the blocks it needs are reserved beforehand so this can not fail.
+ */
+static void tst_idx_move(tst_idx *t, uint32_t i, tst_iheap *h)
+{
+    if (!i)
+        return;
+
+    tst_inode *p = &t->nodes[i];
+    tst_idx_move(t, p->lokid, h);
+    if (IKEY(p))
+        tst_idx_move(t, p->eqkid, h);
+    else if (p->eqkid)
+        tst_iheap_dup(h, tst_iheap_string(&t->heap, p->eqkid), &p->eqkid);
+    tst_idx_move(t, p->hikid, h);
+}
+
+/** tst_idx_compact() repack the live strings of a copying tree into fresh
+ *  blocks and drop the old ones. Every block is reserved before a string
+ *  moves, the heap is left as is on allocation failure. returns 0 on
+ *  success, -1 otherwise.
+ */
+static int tst_idx_compact(tst_idx *t)
+{
+    /* a block wastes less than the longest word at its end */
+    uint32_t n = t->heap.live / (HEAPBLOCK - WRDMAX) + 1;
+    tst_iheap fresh = {NULL};
+
+    if (!(fresh.blocks = malloc(n * sizeof *fresh.blocks)))
+        return -1;
+    for (; fresh.nalloc < n; fresh.nalloc++)
+        if (!(fresh.blocks[fresh.nalloc] = malloc(HEAPBLOCK))) {
+            tst_iheap_free(&fresh);
+            return -1;
+        }
+    tst_idx_move(t, t->root, &fresh);
+    tst_iheap_free(&t->heap);
+    t->heap = fresh;
+    return 0;
+}
+
+/** tst_idx_reserve() make room for 'n' more nodes so that indices taken
+ *  as 'uint32_t *' into the node array stay valid during an insert.
+ *  returns 0 on success, -1 on allocation failure.
+ */
+static int tst_idx_reserve(tst_idx *t, size_t n)
+{
+    if (t->cap - t->nnodes >= n)
+        return 0;
+
+    size_t cap = t->cap ? t->cap : 1024;
+    while (cap - t->nnodes < n) /* grow by half to bound the slack */
+        cap += cap / 2;
+    if (cap > UINT32_MAX)
+        return -1;
+    tst_inode *nodes = realloc(t->nodes, cap * sizeof *nodes);
+    if (!nodes)
+        return -1;
+    if (!t->cap) /* slot 0 is the nil node */
+        t->nnodes = 1;
+    t->nodes = nodes;
+    t->cap = cap;
+    return 0;
+}
+
+/** take a node from the free list, or from the reserved slots. */
+static uint32_t tst_idx_alloc(tst_idx *t)
+{
+    uint32_t i = t->free;
+
+    if (i)
+        t->free = t->nodes[i].eqkid;
+    else
+        i = t->nnodes++;
+    t->live++;
+    return i;
+}
+
+/** put node 'i' on the free list. */
+static void tst_idx_release(tst_idx *t, uint32_t i)
+{
+    t->nodes[i].eqkid = t->free;
+    t->free = i;
+    t->live--;
+}
+
+/** next_node() for the compact tree, see tst.c. */
+static uint32_t *tst_idx_next(tst_idx *t, uint32_t *pcurr, const char **s)
+{
+    tst_inode *n = &t->nodes[*pcurr];
+    int diff = **s - IKEY(n);
+
+    if (diff == 0) {
+        (*s)++;
+        return &n->eqkid;
+    }
+    return diff < 0 ? &n->lokid : &n->hikid;
+}
+
+tst_idx *tst_idx_create(const int cpy)
+{
+    tst_idx *t = calloc(1, sizeof *t);
+    if (t)
+        t->cpy = cpy;
+    return t;
+}
+
+void *tst_idx_ins(tst_idx *t, const char *s)
+{
+    const char *p = s;
+    uint32_t curr, *pcurr, ref;
+    size_t len;
+
+    if (!t || !s)
+        return NULL;                       /* validate parameters */
+    if ((len = strlen(s)) + 1 > STKMAX / 2) /* limit length to 1/2 STKMAX */
+        return NULL;
+    if (tst_idx_reserve(t, len + 1))
+        return NULL;
+
+    pcurr = &t->root;
+    while ((curr = *pcurr)) {
+        tst_inode *n = &t->nodes[curr];
+        if (*p == 0 && IKEY(n) == 0) {
+            if (!n->eqkid) { /* revive node left behind by a delete */
+                if (tst_idx_store(t, s, &n->eqkid))
+                    return NULL;
+                n->keyref = IONE;
+                return tst_idx_string(t, n->eqkid);
+            }
+            if (IREF(n) == REFMAX)
+                return NULL;
+            n->keyref += IONE;
+            return tst_idx_string(t, n->eqkid);
+        }
+        pcurr = tst_idx_next(t, pcurr, &p);
+    }
+
+    /* store the string before linking any node, so a failure leaves the
+     * tree untouched.
+     */
+    if (tst_idx_store(t, s, &ref)) {
+        fprintf(stderr, "error: tst_idx_ins(), memory exhausted.\n");
+        return NULL;
+    }
+
+    for (;;) {
+        uint32_t i = tst_idx_alloc(t);
+        tst_inode *n = &t->nodes[i];
+
+        *pcurr = i;
+        n->lokid = n->eqkid = n->hikid = 0;
+        n->keyref = (unsigned char) *p | IONE;
+        if (*p++ == 0) {
+            n->eqkid = ref;
+            return tst_idx_string(t, ref);
+        }
+        pcurr = &n->eqkid;
+    }
+}
+
+/** delete non-referenced nodes on the stack, see tst_del_word() in tst.c. */
+static void *tst_idx_del_word(tst_idx *t, uint32_t **stk, size_t idx)
+{
+    uint32_t *pvictim = stk[--idx];
+    tst_inode *victim = &t->nodes[*pvictim];
+    uint32_t v;
+
+    if (IREF(victim) > 0) {
+        char *word = tst_idx_string(t, victim->eqkid);
+        printf("  %s  (refcnt: %u) not removed.\n", word, IREF(victim));
+        return word;
+    }
+
+    tst_idx_unstore(t, victim->eqkid);
+    victim->eqkid = 0;
+
+    /* Remove unique suffix chain until the first node found with children */
+    while (!victim->lokid && !victim->hikid && !victim->eqkid) {
+        tst_idx_release(t, *pvictim);
+        *pvictim = 0;
+        if (!idx)
+            return NULL;
+        pvictim = stk[--idx];
+        victim = &t->nodes[*pvictim];
+    }
+
+    if (victim->eqkid)
+        return NULL;
+
+    /* rotate the subtrees of the prefix node, as in tst.c */
+    v = *pvictim;
+    if (victim->lokid && victim->hikid) {
+        tst_inode *lo = &t->nodes[victim->lokid];
+        tst_inode *hi = &t->nodes[victim->hikid];
+        if (!lo->hikid) {
+            lo->hikid = victim->hikid;
+            *pvictim = victim->lokid;
+        } else if (!hi->lokid) {
+            hi->lokid = victim->lokid;
+            *pvictim = victim->hikid;
+        } else /* The subtrees are non-rotatable. */
+            return NULL;
+    } else if (victim->lokid) {
+        *pvictim = victim->lokid;
+    } else if (victim->hikid) {
+        *pvictim = victim->hikid;
+    }
+
+    tst_idx_release(t, v);
+    return NULL;
+}
+
+void *tst_idx_del(tst_idx *t, const char *s)
+{
+    const char *p = s;
+    uint32_t *stk[STKMAX];
+    uint32_t curr, *pcurr;
+    size_t idx = 0;
+
+    if (!t || !s)
+        return NULL;
+    if (strlen(s) + 1 > STKMAX / 2) /* never inserted, so not found */
+        return (void *) -1;
+
+    pcurr = &t->root;
+    while ((curr = *pcurr)) {
+        tst_inode *n = &t->nodes[curr];
+        if (idx < STKMAX)
+            stk[idx++] = pcurr;
+        if (*p == 0 && IKEY(n) == 0) {
+            if (!n->eqkid) /* word left behind by a previous delete */
+                return (void *) -1;
+            n->keyref -= IONE;
+            void *res = tst_idx_del_word(t, stk, idx);
+            /* repack once the holes outweigh the live strings */
+            if (t->heap.dead > t->heap.live && t->heap.dead >= HEAPBLOCK)
+                tst_idx_compact(t);
+            return res;
+        }
+        pcurr = tst_idx_next(t, pcurr, &p);
+    }
+    return (void *) -1;
+}
+
+void *tst_idx_search(const tst_idx *t, const char *s)
+{
+    uint32_t curr = t->root;
+
+    while (curr) {
+        const tst_inode *n = &t->nodes[curr];
+        int diff = *s - IKEY(n);
+        if (diff == 0) {
+            if (*s == 0)
+                return n->eqkid ? tst_idx_string(t, n->eqkid) : NULL;
+            s++;
+            curr = n->eqkid;
+        } else if (diff < 0)
+            curr = n->lokid;
+        else
+            curr = n->hikid;
+    }
+    return NULL;
+}
+
+/** fill 'a' with the words in the subtree rooted at 'i', in order. */
+static void tst_idx_suggest(const tst_idx *t,
+                            uint32_t i,
+                            char **a,
+                            int *n,
+                            const int max)
+{
+    if (!i || *n >= max)
+        return;
+
+    const tst_inode *p = &t->nodes[i];
+    tst_idx_suggest(t, p->lokid, a, n, max);
+    if (IKEY(p))
+        tst_idx_suggest(t, p->eqkid, a, n, max);
+    else if (p->eqkid && *n < max)
+        a[(*n)++] = tst_idx_string(t, p->eqkid);
+    tst_idx_suggest(t, p->hikid, a, n, max);
+}
+
+void *tst_idx_search_prefix(const tst_idx *t,
+                            const char *s,
+                            char **a,
+                            int *n,
+                            const int max)
+{
+    uint32_t curr = t->root;
+
+    *n = 0;
+    if (!*s)
+        return NULL;
+
+    while (curr) {
+        const tst_inode *p = &t->nodes[curr];
+        int diff = *s - IKEY(p);
+        if (diff == 0) {
+            if (!s[1]) { /* last char of the prefix matched */
+                tst_idx_suggest(t, p->eqkid, a, n, max);
+                return (void *) p;
+            }
+            s++;
+            curr = p->eqkid;
+        } else if (diff < 0)
+            curr = p->lokid;
+        else
+            curr = p->hikid;
+    }
+    return NULL;
+}
+
+static void tst_idx_traverse(const tst_idx *t,
+                             uint32_t i,
+                             void(fn)(const void *, void *),
+                             void *data)
+{
+    if (!i)
+        return;
+
+    const tst_inode *p = &t->nodes[i];
+    tst_idx_traverse(t, p->lokid, fn, data);
+    if (IKEY(p))
+        tst_idx_traverse(t, p->eqkid, fn, data);
+    else if (p->eqkid)
+        fn(tst_idx_string(t, p->eqkid), data);
+    tst_idx_traverse(t, p->hikid, fn, data);
+}
+
+void tst_idx_traverse_fn(const tst_idx *t,
+                         void(fn)(const void *, void *),
+                         void *data)
+{
+    tst_idx_traverse(t, t->root, fn, data);
+}
+
+size_t tst_idx_memory_usage(const tst_idx *t, size_t *nodes)
+{
+    size_t bytes = sizeof *t + (size_t) t->cap * sizeof(tst_inode);
+
+    if (t->cpy)
+        bytes += t->heap.nalloc * (sizeof(char *) + HEAPBLOCK);
+    else
+        bytes += t->refcap * sizeof *t->refs;
+    if (nodes)
+        *nodes = t->live;
+    return bytes;
+}
+
+void tst_idx_free(tst_idx *t)
+{
+    if (!t)
+        return;
+    tst_iheap_free(&t->heap);
+    free(t->refs);
+    free(t->nodes);
+    free(t);
+}
@@ -0,0 +1,60 @@
+#ifndef TST_IDX_H
+#define TST_IDX_H
+
+#include <stddef.h>
+
+/* forward declaration of compact ternary search tree. Nodes live in one
+ * array and refer to each other by 32-bit index, the key and refcnt share
+ * a word and terminal nodes store an offset to their string, so each node
+ * takes 16 bytes instead of the 40 bytes of tst_node on 64-bit hosts.
+ */
+typedef struct tst_idx tst_idx;
+
+/** tst_idx_create() allocate an empty compact tree. If 'cpy' is non-zero
+ *  the strings are copied into a string heap owned by the tree, otherwise
+ *  references are kept. Deletes recycle reference slots and leave holes in
+ *  the heap, once the holes outweigh the live strings tst_idx_del()
+ *  repacks them in tree order: strings returned by the tree may move on a
+ *  delete. returns NULL on allocation failure.
+ */
+tst_idx *tst_idx_create(const int cpy);
+
+/** tst_idx_ins() insert 's', see tst_ins(). returns address of 's' in tree
+ *  on successful insert, NULL on allocation failure.
+ */
+void *tst_idx_ins(tst_idx *t, const char *s);
+
+/** tst_idx_del() delete 's', see tst_del(). returns the address of 's' in
+ *  tree if refcnt non-zero, -1 on 's' not found, otherwise NULL.
+ */
+void *tst_idx_del(tst_idx *t, const char *s);
+
+/** tst_idx_search() returns pointer to 's' on success, NULL otherwise. */
+void *tst_idx_search(const tst_idx *t, const char *s);
+
+/** tst_idx_search_prefix() fills 'a' with up to 'max' words prefixed with
+ *  's' and their count in 'n', see tst_search_prefix(). returns non-NULL
+ *  if the prefix is in the tree, NULL otherwise.
+ */
+void *tst_idx_search_prefix(const tst_idx *t,
+                            const char *s,
+                            char **a,
+                            int *n,
+                            const int max);
+
+/** tst_idx_traverse_fn() call 'fn' on each word in order, the first
+ *  argument of 'fn' is the word itself.
+ */
+void tst_idx_traverse_fn(const tst_idx *t,
+                         void(fn)(const void *, void *),
+                         void *data);
+
+/** tst_idx_memory_usage() returns the bytes held by node and string
+ *  storage of 't', storing the number of live nodes in 'nodes' if non-NULL.
+ */
+size_t tst_idx_memory_usage(const tst_idx *t, size_t *nodes);
+
+/** free the compact tree and all storage it owns. */
+void tst_idx_free(tst_idx *t);
+
+#endif
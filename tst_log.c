@@ -0,0 +1,494 @@
+#include <fcntl.h>
+#include <glob.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tst_log.h"
+
+#define SNAP_MAGIC "TSTSNAP1"
+#define PATHMAX 4096
+#define BASEMAX (PATHMAX - 32) /* leaves room for the longest suffix */
+
+/** operations of a log record. */
+enum { LOG_INS = 1, LOG_DEL = 2 };
+
+/** log record, followed by the word and its nul-character. Values are in
+ *  host byte order as in a frozen image.
+ */
+typedef struct tst_logrec {
+    uint32_t crc; /* crc32 of the rest of the record and of the word */
+    uint32_t op;  /* LOG_INS or LOG_DEL */
+    uint64_t lsn;
+    uint32_t score;
+    uint32_t len; /* bytes of the word with its nul */
+} tst_logrec;
+
+/** snapshot header, followed by 'nwords' words in tree order, each a
+ *  refcnt, a score and a length as 32-bit values, then the word and its
+ *  nul-character.
+ */
+typedef struct tst_snaphdr {
+    char magic[8];
+    uint64_t lsn;    /* last record the snapshot holds */
+    uint64_t nwords;
+    uint32_t crc;    /* crc32 of the words, then of 'lsn' and 'nwords' */
+    uint32_t pad;
+} tst_snaphdr;
+
+#define SNAPWORD (3 * sizeof(uint32_t))
+
+struct tst_log {
+    tst_tree *t;
+    char base[BASEMAX];
+    unsigned every; /* records between snapshots, 0 for none */
+    int flags;
+    long loaded;    /* words loaded from the snapshot, -1 if none */
+
+    uint64_t lsn;      /* last record written or replayed */
+    uint64_t snap_lsn; /* last record held by the snapshot on disk */
+    unsigned since;    /* records since the last snapshot started */
+
+    int fd;             /* segment being appended, -1 before replay */
+    uint64_t seg_start; /* first lsn of that segment */
+    off_t off;          /* bytes of complete records in that segment */
+
+    pid_t child;       /* snapshot writer, 0 if none */
+    uint64_t child_lsn; /* last record held by that snapshot */
+
+    char **bufs; /* snapshot and segments read, referenced by the tree */
+    size_t nbufs;
+};
+
+/** crc32() IEEE 802.3 crc of 'n' bytes at 'p', continuing 'crc'. */
+static uint32_t crc32(uint32_t crc, const void *p, size_t n)
+{
+    static uint32_t table[256];
+    const unsigned char *b = p;
+
+    if (!table[1])
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320 ^ c >> 1 : c >> 1;
+            table[i] = c;
+        }
+    crc = ~crc;
+    while (n--)
+        crc = table[(crc ^ *b++) & 0xff] ^ crc >> 8;
+    return ~crc;
+}
+
+/** tst_log_read() returns the contents of 'path' in a buffer kept by 'l',
+ *  its size in 'size'. returns NULL if the file can not be read.
+ */
+static char *tst_log_read(tst_log *l, const char *path, size_t *size)
+{
+    struct stat st;
+    char *buf = NULL, **bufs;
+    size_t n = 0;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) || !(buf = malloc(st.st_size + 1)))
+        goto fail;
+    while (n < (size_t) st.st_size) {
+        ssize_t r = read(fd, buf + n, st.st_size - n);
+        if (r <= 0)
+            goto fail;
+        n += r;
+    }
+    if (!(bufs = realloc(l->bufs, (l->nbufs + 1) * sizeof *bufs)))
+        goto fail;
+    close(fd);
+    l->bufs = bufs;
+    l->bufs[l->nbufs++] = buf;
+    buf[n] = 0;
+    *size = n;
+    return buf;
+fail:
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+/** word of a snapshot being loaded. */
+typedef struct tst_snapword {
+    const char *s;
+    uint32_t refcnt, score;
+} tst_snapword;
+
+/** insert words [lo, hi) of 'w' median first, the words of a snapshot are
+ *  in tree order and would otherwise build degenerate lo/hi chains.
+ */
+static int tst_log_build(tst_tree *t,
+                         const tst_snapword *w,
+                         size_t lo,
+                         size_t hi)
+{
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (lo >= hi)
+        return 0;
+    for (uint32_t i = 0; i < w[mid].refcnt; i++)
+        if (!tst_tree_ins_score(t, w[mid].s, w[mid].score))
+            return -1;
+    if (tst_log_build(t, w, lo, mid))
+        return -1;
+    return tst_log_build(t, w, mid + 1, hi);
+}
+
+/** tst_log_load() load the snapshot of 'l' if there is one. returns 0 on
+ *  success or without a snapshot, -1 if it is corrupt or on allocation
+ *  failure.
+ */
+static int tst_log_load(tst_log *l)
+{
+    char path[PATHMAX];
+    tst_snapword *w;
+    tst_snaphdr hdr;
+    size_t size, off = sizeof hdr;
+    uint32_t crc = 0;
+    char *buf;
+    int err;
+
+    snprintf(path, sizeof path, "%s.snap", l->base);
+    if (access(path, F_OK))
+        return 0;
+    if (!(buf = tst_log_read(l, path, &size)) || size < sizeof hdr)
+        return -1;
+    memcpy(&hdr, buf, sizeof hdr);
+    if (memcmp(hdr.magic, SNAP_MAGIC, sizeof hdr.magic) ||
+        hdr.nwords > (size - sizeof hdr) / (SNAPWORD + 1) ||
+        !(w = malloc((hdr.nwords ? hdr.nwords : 1) * sizeof *w)))
+        return -1;
+
+    for (uint64_t i = 0; i < hdr.nwords; i++) {
+        uint32_t v[3];
+        if (size - off < SNAPWORD)
+            goto corrupt;
+        memcpy(v, buf + off, SNAPWORD);
+        off += SNAPWORD;
+        if (!v[2] || v[2] > size - off || buf[off + v[2] - 1])
+            goto corrupt;
+        w[i] = (tst_snapword){.s = buf + off, .refcnt = v[0], .score = v[1]};
+        off += v[2];
+    }
+    crc = crc32(crc, buf + sizeof hdr, off - sizeof hdr);
+    crc = crc32(crc, &hdr.lsn, sizeof hdr.lsn);
+    crc = crc32(crc, &hdr.nwords, sizeof hdr.nwords);
+    if (off != size || crc != hdr.crc)
+        goto corrupt;
+
+    err = tst_log_build(l->t, w, 0, hdr.nwords);
+    free(w);
+    if (err)
+        return -1;
+    l->loaded = hdr.nwords;
+    l->lsn = l->snap_lsn = hdr.lsn;
+    return 0;
+corrupt:
+    fprintf(stderr, "error: corrupt snapshot '%s'.\n", path);
+    free(w);
+    return -1;
+}
+
+tst_log *tst_log_open(const char *base,
+                      tst_tree *t,
+                      unsigned every,
+                      int flags)
+{
+    tst_log *l = calloc(1, sizeof *l);
+
+    if (!l)
+        return NULL;
+    l->t = t;
+    l->every = every;
+    l->flags = flags;
+    l->loaded = -1;
+    l->fd = -1;
+    if (snprintf(l->base, sizeof l->base, "%s", base) >= BASEMAX ||
+        tst_log_load(l)) {
+        tst_log_close(l);
+        return NULL;
+    }
+    return l;
+}
+
+long tst_log_loaded(const tst_log *l)
+{
+    return l->loaded;
+}
+
+/** tst_log_segments() list the segments of 'l' in 'g', oldest first as
+ *  their names hold the zero padded lsn of their first record.
+ */
+static int tst_log_segments(const tst_log *l, glob_t *g)
+{
+    char pattern[PATHMAX];
+
+    snprintf(pattern, sizeof pattern, "%s.log.*", l->base);
+    return glob(pattern, 0, NULL, g);
+}
+
+static uint64_t tst_log_seg_start(const char *path)
+{
+    return strtoull(strrchr(path, '.') + 1, NULL, 10);
+}
+
+/** tst_log_apply() apply the record 'r' of word 's' to the tree. */
+static void *tst_log_apply(tst_log *l, const tst_logrec *r, const char *s)
+{
+    if (r->op == LOG_INS)
+        return tst_tree_ins_score(l->t, s, r->score);
+    return tst_tree_del(l->t, s);
+}
+
+/** tst_log_replay_seg() apply the records of the segment 'path' newer than
+ *  the snapshot, up to its first torn or corrupt record. returns the
+ *  number applied.
+ */
+static long tst_log_replay_seg(tst_log *l, const char *path)
+{
+    size_t size, off = 0;
+    long n = 0;
+    char *buf;
+
+    if (!(buf = tst_log_read(l, path, &size)))
+        return 0;
+    while (size - off >= sizeof(tst_logrec)) {
+        tst_logrec r;
+        const char *s = buf + off + sizeof r;
+
+        memcpy(&r, buf + off, sizeof r);
+        if (!r.len || r.len > size - off - sizeof r || s[r.len - 1] ||
+            (r.op != LOG_INS && r.op != LOG_DEL) ||
+            crc32(crc32(0, (char *) &r + sizeof r.crc, sizeof r - sizeof r.crc),
+                  s, r.len) != r.crc)
+            break;
+        off += sizeof r + r.len;
+        if (r.lsn <= l->snap_lsn)
+            continue;
+        tst_log_apply(l, &r, s);
+        if (r.lsn > l->lsn)
+            l->lsn = r.lsn;
+        n++;
+    }
+    if (off != size)
+        fprintf(stderr, "warning: log '%s' cut at byte %zu of %zu.\n", path,
+                off, size);
+    return n;
+}
+
+/** tst_log_start() start the segment for the records after 'l->lsn'. */
+static int tst_log_start(tst_log *l)
+{
+    char path[PATHMAX];
+
+    if (l->fd >= 0)
+        close(l->fd);
+    l->seg_start = l->lsn + 1;
+    l->off = 0;
+    snprintf(path, sizeof path, "%s.log.%020llu", l->base,
+             (unsigned long long) l->seg_start);
+    l->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    return l->fd < 0 ? -1 : 0;
+}
+
+long tst_log_replay(tst_log *l)
+{
+    glob_t g;
+    long n = 0;
+
+    if (!tst_log_segments(l, &g)) {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+            n += tst_log_replay_seg(l, g.gl_pathv[i]);
+        globfree(&g);
+    }
+    return tst_log_start(l) ? -1 : n;
+}
+
+/** tst_log_append() write the record of 'op' on 's', a record cut short
+ *  is trimmed so the next one follows a complete record. returns 0 on
+ *  success, -1 on failure.
+ */
+static int tst_log_append(tst_log *l,
+                          int op,
+                          const char *s,
+                          const unsigned score)
+{
+    size_t len = strlen(s) + 1;
+    tst_logrec r = {.op = op, .lsn = l->lsn + 1, .score = score, .len = len};
+    struct iovec iov[2] = {{&r, sizeof r}, {(void *) s, len}};
+
+    if (l->fd < 0)
+        return -1;
+    r.crc = crc32(crc32(0, (char *) &r + sizeof r.crc, sizeof r - sizeof r.crc),
+                  s, len);
+    if (writev(l->fd, iov, 2) != (ssize_t)(sizeof r + len) ||
+        ((l->flags & TST_LOG_SYNC) && fdatasync(l->fd))) {
+        if (ftruncate(l->fd, l->off))
+            fprintf(stderr, "error: log record left torn.\n");
+        return -1;
+    }
+    l->off += sizeof r + len;
+    l->lsn++;
+    l->since++;
+    return 0;
+}
+
+/** tst_log_op() log then apply 'op' on 's', starting a snapshot when
+ *  'every' records went by since the last one.
+ */
+static void *tst_log_op(tst_log *l, int op, const char *s, unsigned score)
+{
+    tst_logrec r = {.op = op, .score = score};
+    void *res;
+
+    tst_log_poll(l);
+    if (tst_log_append(l, op, s, score))
+        return op == LOG_INS ? NULL : (void *) -1;
+    res = tst_log_apply(l, &r, s);
+    if (l->every && l->since >= l->every)
+        tst_log_snapshot(l);
+    return res;
+}
+
+void *tst_log_ins(tst_log *l, const char *s, const unsigned score)
+{
+    return tst_log_op(l, LOG_INS, s, score);
+}
+
+void *tst_log_del(tst_log *l, const char *s)
+{
+    return tst_log_op(l, LOG_DEL, s, 0);
+}
+
+/** snapshot being written by the child. */
+typedef struct tst_snapw {
+    FILE *fp;
+    uint64_t nwords;
+    uint32_t crc;
+    int err;
+} tst_snapw;
+
+static void tst_snap_word(const void *node, void *data)
+{
+    tst_snapw *sw = data;
+    const char *s = tst_get_string(node);
+    uint32_t v[3] = {tst_get_refcnt(node), tst_get_score(node),
+                     strlen(s) + 1};
+
+    if (fwrite(v, SNAPWORD, 1, sw->fp) != 1 || fwrite(s, v[2], 1, sw->fp) != 1)
+        sw->err = 1;
+    sw->crc = crc32(crc32(sw->crc, v, SNAPWORD), s, v[2]);
+    sw->nwords++;
+}
+
+/** tst_snap_write() write the snapshot of the tree at 'lsn' beside the old
+ *  one and rename it over it once on disk. returns 0 on success.
+ */
+static int tst_snap_write(const tst_log *l, uint64_t lsn)
+{
+    char tmp[PATHMAX], path[PATHMAX];
+    tst_snaphdr hdr = {.magic = SNAP_MAGIC, .lsn = lsn};
+    tst_snapw sw = {NULL};
+
+    snprintf(path, sizeof path, "%s.snap", l->base);
+    snprintf(tmp, sizeof tmp, "%s.snap.tmp", l->base);
+    if (!(sw.fp = fopen(tmp, "wb")))
+        return -1;
+    if (fwrite(&hdr, sizeof hdr, 1, sw.fp) != 1)
+        sw.err = 1;
+    tst_traverse_fn(tst_tree_root(l->t), tst_snap_word, &sw);
+
+    hdr.nwords = sw.nwords;
+    hdr.crc = crc32(crc32(sw.crc, &hdr.lsn, sizeof hdr.lsn), &hdr.nwords,
+                    sizeof hdr.nwords);
+    if (sw.err || fseek(sw.fp, 0, SEEK_SET) ||
+        fwrite(&hdr, sizeof hdr, 1, sw.fp) != 1 || fflush(sw.fp) ||
+        fsync(fileno(sw.fp))) {
+        fclose(sw.fp);
+        unlink(tmp);
+        return -1;
+    }
+    if (fclose(sw.fp) || rename(tmp, path)) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int tst_log_snapshot(tst_log *l)
+{
+    pid_t pid;
+
+    tst_log_poll(l);
+    if (l->child)
+        return -1;
+    if ((pid = fork()) < 0)
+        return -1;
+    if (!pid) /* the child sees the tree as of the fork, copy on write */
+        _exit(tst_snap_write(l, l->lsn) ? 1 : 0);
+
+    l->child = pid;
+    l->child_lsn = l->lsn;
+    l->since = 0;
+    /* records after the fork go to a segment the snapshot does not cover */
+    if (l->fd >= 0 && l->seg_start <= l->lsn && tst_log_start(l))
+        fprintf(stderr, "error: log segment not created, records lost.\n");
+    return 0;
+}
+
+/** tst_log_reaped() drop the segments covered by the snapshot of a child
+ *  that exited with 'status'. returns 1 if the snapshot completed.
+ */
+static int tst_log_reaped(tst_log *l, int status)
+{
+    glob_t g;
+
+    l->child = 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "error: snapshot of '%s' failed.\n", l->base);
+        return 0;
+    }
+    l->snap_lsn = l->child_lsn;
+    if (!tst_log_segments(l, &g)) {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+            if (tst_log_seg_start(g.gl_pathv[i]) <= l->snap_lsn)
+                unlink(g.gl_pathv[i]);
+        globfree(&g);
+    }
+    return 1;
+}
+
+int tst_log_poll(tst_log *l)
+{
+    int status;
+
+    if (!l->child || waitpid(l->child, &status, WNOHANG) != l->child)
+        return 0;
+    return tst_log_reaped(l, status);
+}
+
+void tst_log_close(tst_log *l)
+{
+    int status;
+
+    if (!l)
+        return;
+    if (l->child && waitpid(l->child, &status, 0) == l->child)
+        tst_log_reaped(l, status);
+    if (l->fd >= 0)
+        close(l->fd);
+    for (size_t i = 0; i < l->nbufs; i++)
+        free(l->bufs[i]);
+    free(l->bufs);
+    free(l);
+}
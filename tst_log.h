@@ -0,0 +1,76 @@
+#ifndef TST_LOG_H
+#define TST_LOG_H
+
+#include "tst.h"
+
+/* forward declaration of the durable log of a tree. Every insert and
+ * delete made through the log is appended to a checksummed operation log
+ * before it reaches the tree, and snapshots of the whole tree are written
+ * by a forked child while the writer goes on. The files of a log named
+ * 'base' are:
+ *
+ *     base.snap          words, refcnts and scores of the last snapshot
+ *     base.log.<lsn>     segments of records, <lsn> the first one held
+ *
+ * Each record carries a log sequence number (lsn) and the snapshot the
+ * lsn of the last record it holds, so recovery loads the snapshot and
+ * replays only the newer records. A segment is dropped once a snapshot
+ * covers all of its records.
+ */
+typedef struct tst_log tst_log;
+
+/** flags of tst_log_open(). */
+enum {
+    TST_LOG_SYNC = 1, /* fdatasync() each record before it is applied */
+};
+
+/** tst_log_open() open the log 'base' of 't' and load its snapshot into
+ *  't', which should be empty. A snapshot is started after every 'every'
+ *  records, never if 'every' is 0. Recovered words are referenced from
+ *  buffers owned by the log, a reference tree must be freed before
+ *  tst_log_close(). returns NULL on allocation failure or if the snapshot
+ *  is corrupt.
+ */
+tst_log *tst_log_open(const char *base,
+                      tst_tree *t,
+                      unsigned every,
+                      int flags);
+
+/** tst_log_loaded() returns the number of distinct words loaded from the
+ *  snapshot, -1 if there was none: the caller then loads its base data
+ *  before tst_log_replay() and takes a first snapshot.
+ */
+long tst_log_loaded(const tst_log *l);
+
+/** tst_log_replay() apply the records newer than the snapshot and start a
+ *  new segment for the records to come. A segment ends at its first torn
+ *  or corrupt record. returns the number of records applied, -1 if the
+ *  new segment can not be created.
+ */
+long tst_log_replay(tst_log *l);
+
+/** tst_log_ins() and tst_log_del() log then apply tst_tree_ins_score()
+ *  and tst_tree_del() on the tree of 'l', same return values. The tree
+ *  is left untouched if the record can not be written, tst_log_ins()
+ *  then returns NULL and tst_log_del() -1.
+ */
+void *tst_log_ins(tst_log *l, const char *s, const unsigned score);
+void *tst_log_del(tst_log *l, const char *s);
+
+/** tst_log_snapshot() fork a child writing the snapshot of the tree as it
+ *  is now. returns 0 if started, -1 if one is still running or the fork
+ *  failed.
+ */
+int tst_log_snapshot(tst_log *l);
+
+/** tst_log_poll() reap a finished snapshot and drop the segments it
+ *  covers. returns 1 if a snapshot completed, 0 otherwise.
+ */
+int tst_log_poll(tst_log *l);
+
+/** tst_log_close() wait for a running snapshot and release 'l', the tree
+ *  is not freed.
+ */
+void tst_log_close(tst_log *l);
+
+#endif
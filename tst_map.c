@@ -0,0 +1,702 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tst_map.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAP_MAGIC "TSTMAP2"
+
+/** frozen node, 16 bytes. index 0 is the nil node. */
+typedef struct tst_fnode {
+    uint32_t lokid;  /* ternary low child index */
+    uint32_t eqkid;  /* ternary equal child index, string offset if key nul */
+    uint32_t hikid;  /* ternary high child index */
+    uint32_t keyref; /* key in the low byte, refcnt in the upper 24 bits */
+} tst_fnode;
+
+#define FKEY(n) ((char) ((n)->keyref & 0xff))
+
+/** keys of a wide node, and the fewest distinct keys a sibling group needs
+ *  to be laid out as wide nodes rather than as a lo/hi tree of nodes.
+ */
+#define WIDE 16
+#define WIDEMIN 8
+
+/** wide node, 96 bytes: up to WIDE sibling keys sorted in tree order, so a
+ *  char is matched against all of them with one compare instead of walking
+ *  a chain of lo/hi nodes. Keys below the first and above the last one are
+ *  found through 'lokid' and 'hikid', a char between them and not among the
+ *  keys is absent. Child indices with WIDEBIT set refer to wide nodes.
+ */
+typedef struct tst_wnode {
+    char keys[WIDE];     /* sorted keys, unused slots repeat the last one */
+    uint32_t kid[WIDE];  /* eq child of each key, string offset if key nul */
+    uint32_t lokid;      /* siblings below keys[0] */
+    uint32_t hikid;      /* siblings above keys[nkeys - 1] */
+    uint32_t nkeys;      /* keys in use */
+    uint32_t refcnt;     /* refcnt of the word ending here, key nul */
+} tst_wnode;
+
+#define WIDEBIT 0x80000000U
+
+/** image header, all offsets are relative to the start of the image and
+ *  values are in host byte order.
+ */
+typedef struct tst_map_hdr {
+    char magic[8];
+    uint32_t node_size; /* sizeof(tst_fnode), guards against layout change */
+    uint32_t nnodes;    /* nodes including the nil node */
+    uint32_t wide_size; /* sizeof(tst_wnode) */
+    uint32_t nwide;     /* wide nodes */
+    uint32_t root;      /* index of the root, 0 if the image is empty */
+    uint32_t pad;
+    uint64_t nwords;
+    uint64_t nodes_off;
+    uint64_t wide_off; /* wide nodes, right after the nodes */
+    uint64_t strings_off;
+    uint64_t strings_size;
+} tst_map_hdr;
+
+struct tst_map {
+    void *base; /* start of the image */
+    size_t size;
+    int mapped; /* non-zero if 'base' is a mapping */
+    const tst_map_hdr *hdr;
+    const tst_fnode *nodes;
+    const tst_wnode *wide;
+    const char *strings;
+};
+
+/** word collected from the tree to be frozen, laid out by its key. */
+typedef struct tst_word {
+    const char *s;
+    const char *k;  /* key, 's' itself unless the tree is normalized */
+    size_t koff;    /* offset of 'k' in the key blob while collecting */
+    unsigned refcnt;
+    uint32_t off; /* offset in the string blob */
+} tst_word;
+
+#define KEY_IS_WORD ((size_t) -1)
+
+/** dynamic array of the words of a tree, in traversal order. */
+typedef struct tst_words {
+    tst_word *w;
+    size_t n, cap;
+    size_t bytes; /* size of the string blob */
+    char *keys;   /* keys differing from their word */
+    size_t kbytes, kcap;
+    int err;
+} tst_words;
+
+/** subtree still to be built, words [lo, hi) sharing 'depth' chars, into
+ *  the node or, with WIDEBIT, the wide node 'idx'.
+ */
+typedef struct tst_span {
+    size_t lo, hi, depth;
+    uint32_t idx;
+} tst_span;
+
+/** tst_collect_key() keep a copy of 'key' in the key blob of 'ws', storing
+ *  its offset in 'koff'. returns 0 on success, -1 on allocation failure.
+ */
+static int tst_collect_key(tst_words *ws, const char *key, size_t *koff)
+{
+    size_t len = strlen(key) + 1;
+
+    if (ws->kbytes + len > ws->kcap) {
+        size_t cap = ws->kcap ? ws->kcap * 2 : 65536;
+        char *keys = realloc(ws->keys, cap);
+        if (!keys)
+            return -1;
+        ws->keys = keys;
+        ws->kcap = cap;
+    }
+    memcpy(ws->keys + ws->kbytes, key, len);
+    *koff = ws->kbytes;
+    ws->kbytes += len;
+    return 0;
+}
+
+/** collect a word with its key, the path to it: a normalized tree is
+ *  ordered by the folded keys, not by the spellings it stores.
+ */
+static void tst_collect(const void *node, const char *key, void *data)
+{
+    tst_words *ws = data;
+
+    if (ws->err)
+        return;
+    if (ws->n == ws->cap) {
+        size_t cap = ws->cap ? ws->cap * 2 : 1024;
+        tst_word *w = realloc(ws->w, cap * sizeof *w);
+        if (!w) {
+            ws->err = 1;
+            return;
+        }
+        ws->w = w;
+        ws->cap = cap;
+    }
+    tst_word *w = &ws->w[ws->n];
+    w->s = tst_get_string(node);
+    w->koff = KEY_IS_WORD;
+    if (strcmp(key, w->s) && tst_collect_key(ws, key, &w->koff)) {
+        ws->err = 1;
+        return;
+    }
+    ws->n++;
+    w->refcnt = tst_get_refcnt(node);
+    w->off = ws->bytes;
+    ws->bytes += strlen(w->s) + 1;
+}
+
+/** tst_freeze_group() returns the end of the group of words from 'lo'
+ *  sharing their char at 'depth', before 'hi'. The words are sorted, so
+ *  the end is found by doubling then bisecting, O(log) of the group size.
+ */
+static size_t tst_freeze_group(const tst_words *ws,
+                               size_t lo,
+                               size_t hi,
+                               size_t depth)
+{
+    char c = ws->w[lo].k[depth];
+    size_t step = 1, end = lo + 1;
+
+    while (end < hi && ws->w[end].k[depth] == c) {
+        lo = end;
+        end = hi - end > step ? end + step : hi;
+        step *= 2;
+    }
+    while (lo + 1 < end) { /* w[lo] in the group, w[end] past it or 'hi' */
+        size_t mid = lo + (end - lo) / 2;
+        if (ws->w[mid].k[depth] == c)
+            lo = mid;
+        else
+            end = mid;
+    }
+    return end;
+}
+
+/** tst_freeze_groups() store in 'bound' the starts of the groups of words
+ *  [lo, hi) sharing a char at 'depth', followed by 'hi', stopping after
+ *  'max' groups. returns the number of groups stored.
+ */
+static int tst_freeze_groups(const tst_words *ws,
+                             size_t lo,
+                             size_t hi,
+                             size_t depth,
+                             size_t *bound,
+                             int max)
+{
+    int g = 0;
+
+    while (lo < hi && g < max) {
+        bound[g++] = lo;
+        lo = tst_freeze_group(ws, lo, hi, depth);
+    }
+    bound[g] = lo;
+    return g;
+}
+
+/** nodes and wide nodes being laid out, and the queue of their spans. */
+typedef struct tst_layout {
+    tst_fnode *nodes;
+    tst_wnode *wide;
+    tst_span *q;
+    size_t n, nw, nq;       /* nodes, wide nodes and spans queued */
+    size_t cap, wcap, qcap; /* slots allocated */
+    uint32_t root;
+} tst_layout;
+
+/** tst_freeze_queue() queue the span of words [lo, hi) at 'depth', taking
+ *  the next wide node for it if its words have at least WIDEMIN distinct
+ *  chars at 'depth', the next node otherwise. returns the index of the
+ *  span's node, 0 for an empty span or on allocation failure, with
+ *  'err' set.
+ */
+static uint32_t tst_freeze_queue(tst_layout *l,
+                                 const tst_words *ws,
+                                 size_t lo,
+                                 size_t hi,
+                                 size_t depth,
+                                 int *err)
+{
+    size_t bound[WIDEMIN + 1];
+    uint32_t idx;
+
+    if (lo == hi)
+        return 0;
+    if (l->nq == l->qcap) {
+        size_t cap = l->qcap ? l->qcap * 2 : 1024;
+        tst_span *q = realloc(l->q, cap * sizeof *q);
+        if (!q)
+            goto fail;
+        l->q = q;
+        l->qcap = cap;
+    }
+    if (tst_freeze_groups(ws, lo, hi, depth, bound, WIDEMIN) == WIDEMIN) {
+        if (l->nw == l->wcap) {
+            size_t cap = l->wcap ? l->wcap * 2 : 64;
+            tst_wnode *w = realloc(l->wide, cap * sizeof *w);
+            if (!w)
+                goto fail;
+            l->wide = w;
+            l->wcap = cap;
+        }
+        idx = WIDEBIT | l->nw++;
+    } else {
+        if (l->n == l->cap) {
+            size_t cap = l->cap ? l->cap * 2 : 1024;
+            tst_fnode *nodes = realloc(l->nodes, cap * sizeof *nodes);
+            if (!nodes)
+                goto fail;
+            l->nodes = nodes;
+            l->cap = cap;
+        }
+        idx = l->n++;
+    }
+    if (l->n >= WIDEBIT || l->nw >= WIDEBIT)
+        goto fail;
+    l->q[l->nq++] = (tst_span){.lo = lo, .hi = hi, .depth = depth, .idx = idx};
+    return idx;
+
+fail:
+    *err = 1;
+    return 0;
+}
+
+/** tst_freeze_refcnt() returns the refcnt of word 'i' as stored. */
+static unsigned tst_freeze_refcnt(const tst_words *ws, size_t i)
+{
+    unsigned refcnt = ws->w[i].refcnt;
+    return refcnt > 0xffffff ? 0xffffff : refcnt;
+}
+
+/** tst_freeze_wide() build wide node 'idx' from the words [lo, hi) at
+ *  'depth'. The node takes the WIDE middle groups, the groups before and
+ *  after them become its lo and hi spans.
+ */
+static void tst_freeze_wide(tst_layout *l,
+                            const tst_words *ws,
+                            const tst_span *r,
+                            int *err)
+{
+    size_t bound[256 + 1];
+    int g = tst_freeze_groups(ws, r->lo, r->hi, r->depth, bound, 256);
+    int first = g > WIDE ? (g - WIDE) / 2 : 0;
+    int k = g - first < WIDE ? g - first : WIDE;
+    tst_wnode w = {.nkeys = k};
+
+    for (int i = 0; i < WIDE; i++) {
+        size_t lo = bound[first + (i < k ? i : k - 1)];
+        char c = ws->w[lo].k[r->depth];
+
+        w.keys[i] = c;
+        if (i >= k)
+            continue;
+        if (c) {
+            w.kid[i] = tst_freeze_queue(l, ws, lo, bound[first + i + 1],
+                                        r->depth + 1, err);
+        } else { /* words are unique, the group is the word itself */
+            w.kid[i] = ws->w[lo].off;
+            w.refcnt = tst_freeze_refcnt(ws, lo);
+        }
+    }
+    w.lokid = tst_freeze_queue(l, ws, r->lo, bound[first], r->depth, err);
+    w.hikid = tst_freeze_queue(l, ws, bound[first + k], r->hi, r->depth, err);
+    l->wide[r->idx & ~WIDEBIT] = w;
+}
+
+/** tst_freeze_node() build node 'idx' from the words [lo, hi) at 'depth':
+ *  the median word picks the key at that depth, the words before and after
+ *  the group sharing it become the lo and hi spans and the group itself the
+ *  eq span.
+ */
+static void tst_freeze_node(tst_layout *l,
+                            const tst_words *ws,
+                            const tst_span *r,
+                            int *err)
+{
+    size_t mid = r->lo + (r->hi - r->lo) / 2, glo = mid, ghi;
+    char c = ws->w[mid].k[r->depth];
+    tst_fnode node;
+
+    while (glo > r->lo && ws->w[glo - 1].k[r->depth] == c)
+        glo--;
+    ghi = tst_freeze_group(ws, mid, r->hi, r->depth);
+
+    node.lokid = tst_freeze_queue(l, ws, r->lo, glo, r->depth, err);
+    if (c) {
+        node.keyref = (unsigned char) c | 1U << 8;
+        node.eqkid = tst_freeze_queue(l, ws, glo, ghi, r->depth + 1, err);
+    } else { /* words are unique, the group is the word itself */
+        node.keyref = tst_freeze_refcnt(ws, mid) << 8;
+        node.eqkid = ws->w[mid].off;
+    }
+    node.hikid = tst_freeze_queue(l, ws, ghi, r->hi, r->depth, err);
+    l->nodes[r->idx] = node;
+}
+
+/** tst_freeze_nodes() lay out the nodes for words 'ws' breadth first, the
+ *  spans are built in the order they are queued, which is the order of
+ *  the node and wide node arrays. Node 0 is the nil node. returns 0 on
+ *  success, -1 on allocation failure.
+ */
+static int tst_freeze_nodes(const tst_words *ws, tst_layout *l)
+{
+    int err = 0;
+
+    *l = (tst_layout){.n = 1};
+    if (!(l->nodes = malloc(sizeof *l->nodes)))
+        return -1;
+    l->cap = 1;
+    memset(l->nodes, 0, sizeof *l->nodes);
+    l->root = tst_freeze_queue(l, ws, 0, ws->n, 0, &err);
+    for (size_t i = 0; i < l->nq && !err; i++) {
+        const tst_span r = l->q[i];
+        if (r.idx & WIDEBIT)
+            tst_freeze_wide(l, ws, &r, &err);
+        else
+            tst_freeze_node(l, ws, &r, &err);
+    }
+    free(l->q);
+    l->q = NULL;
+    if (err) {
+        free(l->nodes);
+        free(l->wide);
+        return -1;
+    }
+    return 0;
+}
+
+tst_map *tst_freeze(const tst_node *root)
+{
+    tst_words ws = {.w = NULL, .n = 0, .cap = 0, .bytes = 0, .err = 0};
+    tst_layout l;
+    tst_map *m = NULL;
+    tst_map_hdr hdr;
+    char *base;
+
+    tst_traverse_key_fn(root, tst_collect, &ws);
+    if (ws.err || ws.bytes > UINT32_MAX)
+        goto out;
+    for (size_t i = 0; i < ws.n; i++) /* the key blob no longer moves */
+        ws.w[i].k = ws.w[i].koff == KEY_IS_WORD ? ws.w[i].s
+                                                 : ws.keys + ws.w[i].koff;
+    if (tst_freeze_nodes(&ws, &l))
+        goto out;
+
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, MAP_MAGIC, sizeof MAP_MAGIC);
+    hdr.node_size = sizeof(tst_fnode);
+    hdr.nnodes = l.n;
+    hdr.wide_size = sizeof(tst_wnode);
+    hdr.nwide = l.nw;
+    hdr.root = l.root;
+    hdr.nwords = ws.n;
+    hdr.nodes_off = sizeof hdr;
+    hdr.wide_off = hdr.nodes_off + (uint64_t) l.n * sizeof(tst_fnode);
+    hdr.strings_off = hdr.wide_off + (uint64_t) l.nw * sizeof(tst_wnode);
+    hdr.strings_size = ws.bytes;
+
+    if (!(m = calloc(1, sizeof *m)))
+        goto fail;
+    m->size = hdr.strings_off + hdr.strings_size;
+    if (!(base = m->base = malloc(m->size))) {
+        free(m);
+        m = NULL;
+        goto fail;
+    }
+    memcpy(base, &hdr, sizeof hdr);
+    memcpy(base + hdr.nodes_off, l.nodes, l.n * sizeof(tst_fnode));
+    if (l.nw)
+        memcpy(base + hdr.wide_off, l.wide, l.nw * sizeof(tst_wnode));
+    for (size_t i = 0; i < ws.n; i++)
+        strcpy(base + hdr.strings_off + ws.w[i].off, ws.w[i].s);
+
+    m->hdr = m->base;
+    m->nodes = (const tst_fnode *) (base + hdr.nodes_off);
+    m->wide = (const tst_wnode *) (base + hdr.wide_off);
+    m->strings = base + hdr.strings_off;
+
+fail:
+    free(l.nodes);
+    free(l.wide);
+out:
+    free(ws.keys);
+    free(ws.w);
+    return m;
+}
+
+int tst_save(const tst_map *m, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp)
+        return -1;
+    if (fwrite(m->base, 1, m->size, fp) != m->size) {
+        fclose(fp);
+        return -1;
+    }
+    return fclose(fp) ? -1 : 0;
+}
+
+/** tst_map_kid() returns non-zero if 'kid' of an image with the header
+ *  'hdr' is the nil node or a node or wide node the image holds.
+ */
+static int tst_map_kid(const tst_map_hdr *hdr, uint32_t kid)
+{
+    if (kid & WIDEBIT)
+        return (kid & ~WIDEBIT) < hdr->nwide;
+    return kid < hdr->nnodes;
+}
+
+/** tst_map_check() returns 0 if every child index of the image at 'base'
+ *  is in bounds and every string offset inside the string blob, -1
+ *  otherwise. A file taken from disk is only trusted once it passed.
+ */
+static int tst_map_check(const tst_map_hdr *hdr, const char *base)
+{
+    const tst_fnode *nodes = (const tst_fnode *) (base + hdr->nodes_off);
+    const tst_wnode *wide = (const tst_wnode *) (base + hdr->wide_off);
+
+    for (uint32_t i = 1; i < hdr->nnodes; i++) {
+        const tst_fnode *n = &nodes[i];
+        if (!tst_map_kid(hdr, n->lokid) || !tst_map_kid(hdr, n->hikid))
+            return -1;
+        if (FKEY(n) ? !tst_map_kid(hdr, n->eqkid)
+                    : n->eqkid >= hdr->strings_size)
+            return -1;
+    }
+    for (uint32_t i = 0; i < hdr->nwide; i++) {
+        const tst_wnode *w = &wide[i];
+        if (!w->nkeys || w->nkeys > WIDE || !tst_map_kid(hdr, w->lokid) ||
+            !tst_map_kid(hdr, w->hikid))
+            return -1;
+        for (uint32_t k = 0; k < WIDE; k++) /* a match may land past nkeys */
+            if (w->keys[k] ? !tst_map_kid(hdr, w->kid[k])
+                           : w->kid[k] >= hdr->strings_size)
+                return -1;
+    }
+    return 0;
+}
+
+tst_map *tst_open_mmap(const char *path)
+{
+    const tst_map_hdr *hdr;
+    struct stat st;
+    tst_map *m;
+    void *base;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof *hdr) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the file referenced */
+    if (base == MAP_FAILED)
+        return NULL;
+
+    /* check the header describes an image that fits in the file, then
+     * that no index of the image points outside of it
+     */
+    hdr = base;
+    if (memcmp(hdr->magic, MAP_MAGIC, sizeof MAP_MAGIC) ||
+        hdr->node_size != sizeof(tst_fnode) || !hdr->nnodes ||
+        hdr->wide_size != sizeof(tst_wnode) ||
+        hdr->nodes_off != sizeof *hdr ||
+        hdr->wide_off !=
+            hdr->nodes_off + (uint64_t) hdr->nnodes * sizeof(tst_fnode) ||
+        hdr->strings_off !=
+            hdr->wide_off + (uint64_t) hdr->nwide * sizeof(tst_wnode) ||
+        (hdr->root & WIDEBIT ? (hdr->root & ~WIDEBIT) >= hdr->nwide
+                             : hdr->root >= hdr->nnodes) ||
+        hdr->strings_off + hdr->strings_size != (uint64_t) st.st_size ||
+        (hdr->strings_size &&
+         ((const char *) base)[st.st_size - 1] != '\0') ||
+        tst_map_check(hdr, base) || !(m = calloc(1, sizeof *m))) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    m->base = base;
+    m->size = st.st_size;
+    m->mapped = 1;
+    m->hdr = hdr;
+    m->nodes = (const tst_fnode *) ((const char *) base + hdr->nodes_off);
+    m->wide = (const tst_wnode *) ((const char *) base + hdr->wide_off);
+    m->strings = (const char *) base + hdr->strings_off;
+    return m;
+}
+
+/** tst_map_wide() returns the child of wide node 'w' for 'c', 0 if 'c' is
+ *  not among its keys, and the index of the key in 'k'. A char outside the
+ *  keys goes on to 'lokid' or 'hikid' with 'k' set to -1.
+ */
+static uint32_t tst_map_wide(const tst_wnode *w, char c, int *k)
+{
+#ifdef __SSE2__
+    __m128i keys = _mm_loadu_si128((const __m128i *) w->keys);
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(c)));
+
+    if (mask) {
+        *k = __builtin_ctz(mask);
+        return w->kid[*k];
+    }
+#else
+    for (uint32_t i = 0; i < w->nkeys; i++)
+        if (w->keys[i] == c) {
+            *k = i;
+            return w->kid[i];
+        }
+#endif
+    *k = -1;
+    if (c < w->keys[0])
+        return w->lokid;
+    return c > w->keys[w->nkeys - 1] ? w->hikid : 0;
+}
+
+void *tst_map_search(const tst_map *m, const char *s)
+{
+    uint32_t curr = m->hdr->root;
+
+    while (curr) {
+        int k;
+
+        if (curr & WIDEBIT) {
+            const tst_wnode *w = &m->wide[curr & ~WIDEBIT];
+            curr = tst_map_wide(w, *s, &k);
+            if (k < 0)
+                continue;
+            if (*s == 0)
+                return (void *) (m->strings + curr);
+            s++;
+            continue;
+        }
+
+        const tst_fnode *n = &m->nodes[curr];
+        int diff = *s - FKEY(n);
+        if (diff == 0) {
+            if (*s == 0)
+                return (void *) (m->strings + n->eqkid);
+            s++;
+            curr = n->eqkid;
+        } else if (diff < 0)
+            curr = n->lokid;
+        else
+            curr = n->hikid;
+    }
+    return NULL;
+}
+
+/** fill 'a' with the words in the subtree rooted at 'i', in order. */
+static void tst_map_suggest(const tst_map *m,
+                            uint32_t i,
+                            char **a,
+                            int *n,
+                            const int max)
+{
+    if (!i || *n >= max)
+        return;
+
+    if (i & WIDEBIT) {
+        const tst_wnode *w = &m->wide[i & ~WIDEBIT];
+        tst_map_suggest(m, w->lokid, a, n, max);
+        for (uint32_t k = 0; k < WIDE; k++) /* a match may land past nkeys */ {
+            if (w->keys[k])
+                tst_map_suggest(m, w->kid[k], a, n, max);
+            else if (*n < max)
+                a[(*n)++] = (char *) m->strings + w->kid[k];
+        }
+        tst_map_suggest(m, w->hikid, a, n, max);
+        return;
+    }
+
+    const tst_fnode *p = &m->nodes[i];
+    tst_map_suggest(m, p->lokid, a, n, max);
+    if (FKEY(p))
+        tst_map_suggest(m, p->eqkid, a, n, max);
+    else if (*n < max)
+        a[(*n)++] = (char *) m->strings + p->eqkid;
+    tst_map_suggest(m, p->hikid, a, n, max);
+}
+
+void *tst_map_search_prefix(const tst_map *m,
+                            const char *s,
+                            char **a,
+                            int *n,
+                            const int max)
+{
+    uint32_t curr = m->hdr->root;
+
+    *n = 0;
+    if (!*s)
+        return NULL;
+
+    while (curr) {
+        int k;
+
+        if (curr & WIDEBIT) {
+            const tst_wnode *w = &m->wide[curr & ~WIDEBIT];
+            curr = tst_map_wide(w, *s, &k);
+            if (k < 0)
+                continue;
+            if (!s[1]) { /* last char of the prefix matched */
+                tst_map_suggest(m, curr, a, n, max);
+                return (void *) w;
+            }
+            s++;
+            continue;
+        }
+
+        const tst_fnode *p = &m->nodes[curr];
+        int diff = *s - FKEY(p);
+        if (diff == 0) {
+            if (!s[1]) { /* last char of the prefix matched */
+                tst_map_suggest(m, p->eqkid, a, n, max);
+                return (void *) p;
+            }
+            s++;
+            curr = p->eqkid;
+        } else if (diff < 0)
+            curr = p->lokid;
+        else
+            curr = p->hikid;
+    }
+    return NULL;
+}
+
+void tst_map_nodes(const tst_map *m, size_t *nodes, size_t *wide)
+{
+    if (nodes)
+        *nodes = m->hdr->nnodes - 1;
+    if (wide)
+        *wide = m->hdr->nwide;
+}
+
+void tst_map_size(const tst_map *m, size_t *words, size_t *bytes)
+{
+    if (words)
+        *words = m->hdr->nwords;
+    if (bytes)
+        *bytes = m->size;
+}
+
+void tst_map_close(tst_map *m)
+{
+    if (!m)
+        return;
+    if (m->mapped)
+        munmap(m->base, m->size);
+    else
+        free(m->base);
+    free(m);
+}
@@ -0,0 +1,63 @@
+#ifndef TST_MAP_H
+#define TST_MAP_H
+
+#include "tst.h"
+
+/* forward declaration of frozen ternary search tree. A frozen tree is one
+ * position-independent image: a header, the nodes in breadth-first order
+ * linked by 32-bit index and the words packed in order in a string blob.
+ * Sibling groups with many distinct keys, mostly near the root, are laid
+ * out as wide nodes holding up to 16 sorted keys matched with one SSE2
+ * compare, in place of a lo/hi tree of nodes taking a miss per level.
+ * The image can be written to a file and served straight from a read-only
+ * mapping of that file, so processes sharing the file share page cache.
+ */
+typedef struct tst_map tst_map;
+
+/** tst_freeze() compile the words of the tree rooted at 'root' into a
+ *  frozen image held in memory. Every lo/hi subtree of the image is
+ *  balanced by word count. Words are laid out by their key in the tree, so
+ *  the image of a normalized tree is searched with folded keys, see
+ *  utf8_fold(), and returns the spellings stored. returns NULL on
+ *  allocation failure.
+ */
+tst_map *tst_freeze(const tst_node *root);
+
+/** tst_save() write the image of 'm' to 'path'.
+ *  returns 0 on success, -1 on failure.
+ */
+int tst_save(const tst_map *m, const char *path);
+
+/** tst_open_mmap() map the image saved at 'path' read-only. Every index
+ *  of the image is checked to stay inside it before the image is used.
+ *  returns NULL if the file can not be mapped or is not a frozen tree.
+ */
+tst_map *tst_open_mmap(const char *path);
+
+/** tst_map_search() returns pointer to 's' in the image, NULL otherwise. */
+void *tst_map_search(const tst_map *m, const char *s);
+
+/** tst_map_search_prefix() fills 'a' with up to 'max' words prefixed with
+ *  's' and their count in 'n', see tst_search_prefix(). The words point
+ *  into the image. returns non-NULL if the prefix is found, NULL otherwise.
+ */
+void *tst_map_search_prefix(const tst_map *m,
+                            const char *s,
+                            char **a,
+                            int *n,
+                            const int max);
+
+/** tst_map_size() returns the number of words and the image size in bytes
+ *  in 'words' and 'bytes' if non-NULL.
+ */
+void tst_map_size(const tst_map *m, size_t *words, size_t *bytes);
+
+/** tst_map_nodes() returns the number of nodes and of wide nodes of the
+ *  image in 'nodes' and 'wide' if non-NULL.
+ */
+void tst_map_nodes(const tst_map *m, size_t *nodes, size_t *wide);
+
+/** release a frozen image, unmapping it if opened by tst_open_mmap(). */
+void tst_map_close(tst_map *m);
+
+#endif
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tst_rdx.h"
+
+/** max word length to store in ternary search tree, stack size */
+#define WRDMAX 128
+#define STKMAX (WRDMAX * 2)
+
+/** radix ternary search tree node, 'len' bytes of label follow it. */
+typedef struct tst_rnode {
+    struct tst_rnode *lokid; /* ternary low child, label[0] below */
+    struct tst_rnode *eqkid; /* child past the label, string if terminal */
+    struct tst_rnode *hikid; /* ternary high child, label[0] above */
+    unsigned refcnt;
+    unsigned len; /* label bytes, at least 1 */
+    char label[];
+} tst_rnode;
+
+/** a terminal label ends with the nul-character of its word. */
+#define TERM(n) (!(n)->label[(n)->len - 1])
+
+struct tst_rdx {
+    tst_rnode *root;
+    size_t nodes; /* nodes in the tree */
+    size_t bytes; /* bytes of nodes and copied strings */
+    int cpy;
+};
+
+static tst_rnode *tst_rdx_node(tst_rdx *t, const char *label, unsigned len)
+{
+    tst_rnode *n = malloc(sizeof *n + len);
+
+    if (!n)
+        return NULL;
+    n->lokid = n->eqkid = n->hikid = NULL;
+    n->refcnt = 0;
+    n->len = len;
+    memcpy(n->label, label, len);
+    t->nodes++;
+    t->bytes += sizeof *n + len;
+    return n;
+}
+
+static void tst_rdx_release(tst_rdx *t, tst_rnode *n)
+{
+    t->nodes--;
+    t->bytes -= sizeof *n + n->len;
+    free(n);
+}
+
+/** save a copy or a reference of 's', NULL on allocation failure. */
+static char *tst_rdx_store(tst_rdx *t, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *word;
+
+    if (!t->cpy)
+        return (char *) s;
+    if ((word = malloc(len))) {
+        memcpy(word, s, len);
+        t->bytes += len;
+    }
+    return word;
+}
+
+static void tst_rdx_word_free(tst_rdx *t, char *word)
+{
+    if (t->cpy && word) {
+        t->bytes -= strlen(word) + 1;
+        free(word);
+    }
+}
+
+/** tst_rdx_match() non-zero if the label of 'p' is a prefix of 's', whose
+ *  first 'rem' bytes are left. The nul-character of 's' takes part, so a
+ *  terminal label only matches the end of 's'.
+ */
+static int tst_rdx_match(const tst_rnode *p, const char *s, size_t rem)
+{
+    return p->len <= rem + 1 && !memcmp(s + 1, p->label + 1, p->len - 1);
+}
+
+tst_rdx *tst_rdx_create(const int cpy)
+{
+    tst_rdx *t = calloc(1, sizeof *t);
+    if (t)
+        t->cpy = cpy;
+    return t;
+}
+
+void *tst_rdx_ins(tst_rdx *t, const char *s)
+{
+    tst_rnode **pp, *p, *leaf, *tail = NULL;
+    const char *q = s;
+    unsigned split = 0;
+    char *word;
+
+    if (!t || !s)
+        return NULL;                  /* validate parameters */
+    if (strlen(s) + 1 > STKMAX / 2) /* limit length to 1/2 STKMAX */
+        return NULL;
+
+    pp = &t->root;
+    while ((p = *pp)) {
+        int diff = *q - p->label[0];
+        if (diff) {
+            pp = diff < 0 ? &p->lokid : &p->hikid;
+            continue;
+        }
+        /* the label holds a nul-character only at its end */
+        for (split = 1; split < p->len && q[split] == p->label[split];)
+            split++;
+        if (split < p->len) /* diverges inside the label */
+            break;
+        if (TERM(p)) {
+            if (!p->eqkid) { /* revive node left behind by a delete */
+                if (!(word = tst_rdx_store(t, s)))
+                    return NULL;
+                p->eqkid = (tst_rnode *) word;
+                p->refcnt = 1;
+                return word;
+            }
+            p->refcnt++;
+            return p->eqkid;
+        }
+        q += p->len;
+        split = 0;
+        pp = &p->eqkid;
+    }
+
+    /* allocate everything before linking any node, so a failure leaves
+     * the tree untouched.
+     */
+    word = tst_rdx_store(t, s);
+    leaf = tst_rdx_node(t, q + split, strlen(q + split) + 1);
+    if (p)
+        tail = tst_rdx_node(t, p->label + split, p->len - split);
+    if (!word || !leaf || (p && !tail)) {
+        if (word)
+            tst_rdx_word_free(t, word);
+        if (leaf)
+            tst_rdx_release(t, leaf);
+        if (tail)
+            tst_rdx_release(t, tail);
+        fprintf(stderr, "error: tst_rdx_ins(), memory exhausted.\n");
+        return NULL;
+    }
+    leaf->eqkid = (tst_rnode *) word;
+    leaf->refcnt = 1;
+    if (!p) {
+        *pp = leaf;
+        return word;
+    }
+
+    /* split 'p': the tail of its label moves to a node of its own, which
+     * takes the eqkid and refcnt of 'p' and gets the new word as sibling.
+     */
+    tail->eqkid = p->eqkid;
+    tail->refcnt = p->refcnt;
+    if (q[split] - tail->label[0] < 0)
+        tail->lokid = leaf;
+    else
+        tail->hikid = leaf;
+    t->bytes -= p->len - split;
+    p->len = split;
+    p->refcnt = 0;
+    p->eqkid = tail;
+    if ((p = realloc(p, sizeof *p + split)))
+        *pp = p;
+    return word;
+}
+
+/** tst_rdx_merge() merge the node at 'stk[idx]' into its parent if it is
+ *  the parent's eqkid and has no siblings, as if it had been inserted
+ *  that way.
+ */
+static void tst_rdx_merge(tst_rdx *t, tst_rnode ***stk, size_t idx)
+{
+    tst_rnode *c = *stk[idx], *p, *m;
+
+    if (!idx || !c || c->lokid || c->hikid)
+        return;
+    p = *stk[idx - 1];
+    if (stk[idx] != &p->eqkid)
+        return;
+    if (!(m = realloc(p, sizeof *m + p->len + c->len)))
+        return; /* left uncompressed */
+    memcpy(m->label + m->len, c->label, c->len);
+    m->len += c->len;
+    m->eqkid = c->eqkid;
+    m->refcnt = c->refcnt;
+    *stk[idx - 1] = m;
+    t->bytes += c->len;
+    tst_rdx_release(t, c);
+}
+
+/** delete non-referenced nodes on the stack, see tst_del_word() in tst.c,
+ *  then merge the node that lost a child with its parent if it can.
+ */
+static void *tst_rdx_del_word(tst_rdx *t, tst_rnode ***stk, size_t idx)
+{
+    tst_rnode **pvictim = stk[--idx], *victim = *pvictim;
+
+    tst_rdx_word_free(t, (char *) victim->eqkid);
+    victim->eqkid = NULL;
+
+    /* Remove unique suffix chain until the first node found with children */
+    while (!victim->lokid && !victim->hikid && !victim->eqkid) {
+        tst_rdx_release(t, victim);
+        *pvictim = NULL;
+        if (!idx)
+            return NULL;
+        pvictim = stk[--idx];
+        victim = *pvictim;
+    }
+
+    if (!victim->eqkid) { /* rotate the subtrees of the prefix node */
+        if (victim->lokid && victim->hikid) {
+            if (!victim->lokid->hikid) {
+                victim->lokid->hikid = victim->hikid;
+                *pvictim = victim->lokid;
+            } else if (!victim->hikid->lokid) {
+                victim->hikid->lokid = victim->lokid;
+                *pvictim = victim->hikid;
+            } else /* The subtrees are non-rotatable. */
+                return NULL;
+        } else
+            *pvictim = victim->lokid ? victim->lokid : victim->hikid;
+        tst_rdx_release(t, victim);
+    }
+
+    tst_rdx_merge(t, stk, idx);
+    return NULL;
+}
+
+void *tst_rdx_del(tst_rdx *t, const char *s)
+{
+    tst_rnode **stk[STKMAX], **pp, *p;
+    size_t idx = 0, rem;
+
+    if (!t || !s)
+        return NULL;
+    if ((rem = strlen(s)) + 1 > STKMAX / 2) /* never inserted, not found */
+        return (void *) -1;
+
+    pp = &t->root;
+    while ((p = *pp)) {
+        int diff = *s - p->label[0];
+        if (idx < STKMAX)
+            stk[idx++] = pp;
+        if (diff) {
+            pp = diff < 0 ? &p->lokid : &p->hikid;
+            continue;
+        }
+        if (!tst_rdx_match(p, s, rem))
+            break;
+        if (TERM(p)) {
+            if (!p->eqkid) /* word left behind by a previous delete */
+                break;
+            if (--p->refcnt) {
+                printf("  %s  (refcnt: %u) not removed.\n", (char *) p->eqkid,
+                       p->refcnt);
+                return p->eqkid;
+            }
+            return tst_rdx_del_word(t, stk, idx);
+        }
+        s += p->len;
+        rem -= p->len;
+        pp = &p->eqkid;
+    }
+    return (void *) -1;
+}
+
+void *tst_rdx_search(const tst_rdx *t, const char *s)
+{
+    const tst_rnode *p = t->root;
+    size_t rem = strlen(s);
+
+    while (p) {
+        int diff = *s - p->label[0];
+        if (diff) {
+            p = diff < 0 ? p->lokid : p->hikid;
+            continue;
+        }
+        if (!tst_rdx_match(p, s, rem))
+            return NULL;
+        if (TERM(p))
+            return p->eqkid;
+        s += p->len;
+        rem -= p->len;
+        p = p->eqkid;
+    }
+    return NULL;
+}
+
+static void tst_rdx_suggest(const tst_rnode *p,
+                            char **a,
+                            int *n,
+                            const int max);
+
+/** add the words past the label of 'p' to 'a', in order. */
+static void tst_rdx_suggest_eq(const tst_rnode *p,
+                               char **a,
+                               int *n,
+                               const int max)
+{
+    if (!TERM(p))
+        tst_rdx_suggest(p->eqkid, a, n, max);
+    else if (p->eqkid && *n < max)
+        a[(*n)++] = (char *) p->eqkid;
+}
+
+/** fill 'a' with the words in the subtree rooted at 'p', in order. */
+static void tst_rdx_suggest(const tst_rnode *p,
+                            char **a,
+                            int *n,
+                            const int max)
+{
+    if (!p || *n >= max)
+        return;
+
+    tst_rdx_suggest(p->lokid, a, n, max);
+    tst_rdx_suggest_eq(p, a, n, max);
+    tst_rdx_suggest(p->hikid, a, n, max);
+}
+
+void *tst_rdx_search_prefix(const tst_rdx *t,
+                            const char *s,
+                            char **a,
+                            int *n,
+                            const int max)
+{
+    const tst_rnode *p = t->root;
+    size_t rem = strlen(s);
+
+    *n = 0;
+    if (!*s)
+        return NULL;
+
+    while (p) {
+        int diff = *s - p->label[0];
+        if (diff) {
+            p = diff < 0 ? p->lokid : p->hikid;
+            continue;
+        }
+        if (rem <= p->len) { /* the prefix ends inside the label */
+            if (memcmp(s, p->label, rem))
+                return NULL;
+            tst_rdx_suggest_eq(p, a, n, max);
+            return (void *) p;
+        }
+        if (memcmp(s, p->label, p->len))
+            return NULL;
+        s += p->len;
+        rem -= p->len;
+        p = p->eqkid;
+    }
+    return NULL;
+}
+
+static void tst_rdx_traverse(const tst_rnode *p,
+                             void(fn)(const void *, void *),
+                             void *data)
+{
+    if (!p)
+        return;
+
+    tst_rdx_traverse(p->lokid, fn, data);
+    if (!TERM(p))
+        tst_rdx_traverse(p->eqkid, fn, data);
+    else if (p->eqkid)
+        fn(p->eqkid, data);
+    tst_rdx_traverse(p->hikid, fn, data);
+}
+
+void tst_rdx_traverse_fn(const tst_rdx *t,
+                         void(fn)(const void *, void *),
+                         void *data)
+{
+    tst_rdx_traverse(t->root, fn, data);
+}
+
+size_t tst_rdx_memory_usage(const tst_rdx *t, size_t *nodes)
+{
+    if (nodes)
+        *nodes = t->nodes;
+    return sizeof *t + t->bytes;
+}
+
+static void tst_rdx_free_all(tst_rdx *t, tst_rnode *p)
+{
+    if (!p)
+        return;
+    tst_rdx_free_all(t, p->lokid);
+    if (!TERM(p))
+        tst_rdx_free_all(t, p->eqkid);
+    else if (t->cpy)
+        free(p->eqkid);
+    tst_rdx_free_all(t, p->hikid);
+    free(p);
+}
+
+void tst_rdx_free(tst_rdx *t)
+{
+    if (!t)
+        return;
+    tst_rdx_free_all(t, t->root);
+    free(t);
+}
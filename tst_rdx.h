@@ -0,0 +1,60 @@
+#ifndef TST_RDX_H
+#define TST_RDX_H
+
+#include <stddef.h>
+
+/* forward declaration of path compressed (radix) ternary search tree. A
+ * run of bytes with no lo/hi siblings is held by one node as a label that
+ * is compared with memcmp(), instead of one tst_node per byte. The first
+ * byte of the label is the split key of the node. The nul-character ends
+ * the label of a terminal node, whose eqkid holds the string.
+ */
+typedef struct tst_rdx tst_rdx;
+
+/** tst_rdx_create() allocate an empty radix tree. If 'cpy' is non-zero the
+ *  strings are copied and owned by the tree, otherwise references are kept.
+ *  returns NULL on allocation failure.
+ */
+tst_rdx *tst_rdx_create(const int cpy);
+
+/** tst_rdx_ins() insert 's', see tst_ins(). A label diverging from 's' is
+ *  split where it does. returns address of 's' in tree on successful
+ *  insert, NULL on allocation failure.
+ */
+void *tst_rdx_ins(tst_rdx *t, const char *s);
+
+/** tst_rdx_del() delete 's', see tst_del(). A node left with a single
+ *  child run is merged back with it. returns the address of 's' in tree if
+ *  refcnt non-zero, -1 on 's' not found, otherwise NULL.
+ */
+void *tst_rdx_del(tst_rdx *t, const char *s);
+
+/** tst_rdx_search() returns pointer to 's' on success, NULL otherwise. */
+void *tst_rdx_search(const tst_rdx *t, const char *s);
+
+/** tst_rdx_search_prefix() fills 'a' with up to 'max' words prefixed with
+ *  's' and their count in 'n', see tst_search_prefix(). returns non-NULL
+ *  if the prefix is in the tree, NULL otherwise.
+ */
+void *tst_rdx_search_prefix(const tst_rdx *t,
+                            const char *s,
+                            char **a,
+                            int *n,
+                            const int max);
+
+/** tst_rdx_traverse_fn() call 'fn' on each word in order, the first
+ *  argument of 'fn' is the word itself.
+ */
+void tst_rdx_traverse_fn(const tst_rdx *t,
+                         void(fn)(const void *, void *),
+                         void *data);
+
+/** tst_rdx_memory_usage() returns the bytes held by nodes and copied
+ *  strings of 't', storing the number of nodes in 'nodes' if non-NULL.
+ */
+size_t tst_rdx_memory_usage(const tst_rdx *t, size_t *nodes);
+
+/** free the radix tree and all storage it owns. */
+void tst_rdx_free(tst_rdx *t);
+
+#endif
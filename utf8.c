@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "utf8.h"
+
+/** folded form of U+00C0 - U+017F, NULL if the code point is kept. */
+static const char *const latin[0x180 - 0xc0] = {
+    /* U+00C0 */ "a", "a", "a", "a", "a", "a", "ae", "c",
+    /* U+00C8 */ "e", "e", "e", "e", "i", "i", "i", "i",
+    /* U+00D0 */ "d", "n", "o", "o", "o", "o", "o", NULL,
+    /* U+00D8 */ "o", "u", "u", "u", "u", "y", "th", "ss",
+    /* U+00E0 */ "a", "a", "a", "a", "a", "a", "ae", "c",
+    /* U+00E8 */ "e", "e", "e", "e", "i", "i", "i", "i",
+    /* U+00F0 */ "d", "n", "o", "o", "o", "o", "o", NULL,
+    /* U+00F8 */ "o", "u", "u", "u", "u", "y", "th", "y",
+    /* U+0100 */ "a", "a", "a", "a", "a", "a", "c", "c",
+    /* U+0108 */ "c", "c", "c", "c", "c", "c", "d", "d",
+    /* U+0110 */ "d", "d", "e", "e", "e", "e", "e", "e",
+    /* U+0118 */ "e", "e", "e", "e", "g", "g", "g", "g",
+    /* U+0120 */ "g", "g", "g", "g", "h", "h", "h", "h",
+    /* U+0128 */ "i", "i", "i", "i", "i", "i", "i", "i",
+    /* U+0130 */ "i", "i", "ij", "ij", "j", "j", "k", "k",
+    /* U+0138 */ "k", "l", "l", "l", "l", "l", "l", "l",
+    /* U+0140 */ "l", "l", "l", "n", "n", "n", "n", "n",
+    /* U+0148 */ "n", "n", "n", "n", "o", "o", "o", "o",
+    /* U+0150 */ "o", "o", "oe", "oe", "r", "r", "r", "r",
+    /* U+0158 */ "r", "r", "s", "s", "s", "s", "s", "s",
+    /* U+0160 */ "s", "s", "t", "t", "t", "t", "t", "t",
+    /* U+0168 */ "u", "u", "u", "u", "u", "u", "u", "u",
+    /* U+0170 */ "u", "u", "u", "u", "w", "w", "y", "y",
+    /* U+0178 */ "y", "z", "z", "z", "z", "z", "z", "s",
+};
+
+/** utf8_decode() decode the sequence at 's' into 'cp'. returns its length,
+ *  1 for a byte that does not start a valid sequence (taken as is) and 0
+ *  for a sequence cut short by the end of the string.
+ */
+static size_t utf8_decode(const unsigned char *s, uint32_t *cp)
+{
+    size_t len;
+
+    if (s[0] < 0x80) {
+        *cp = s[0];
+        return 1;
+    }
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        len = 2;
+        *cp = s[0] & 0x1f;
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        len = 3;
+        *cp = s[0] & 0x0f;
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        len = 4;
+        *cp = s[0] & 0x07;
+    } else {
+        *cp = s[0];
+        return 1;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if (!s[i])
+            return 0;
+        if ((s[i] & 0xc0) != 0x80) {
+            *cp = s[0];
+            return 1;
+        }
+        *cp = *cp << 6 | (s[i] & 0x3f);
+    }
+    return len;
+}
+
+static size_t utf8_encode(uint32_t cp, char *out)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = 0xc0 | cp >> 6;
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = 0xe0 | cp >> 12;
+        out[1] = 0x80 | (cp >> 6 & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | cp >> 18;
+    out[1] = 0x80 | (cp >> 12 & 0x3f);
+    out[2] = 0x80 | (cp >> 6 & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+/** utf8_fold_cp() fold a code point outside the Latin table to lower case
+ *  without accents, returns 0 for a combining mark to drop.
+ */
+static uint32_t utf8_fold_cp(uint32_t cp)
+{
+    if (cp >= 0x300 && cp <= 0x36f) /* combining diacritical marks */
+        return 0;
+    if (cp == 0x218 || cp == 0x219) /* s with comma below */
+        return 's';
+    if (cp == 0x21a || cp == 0x21b) /* t with comma below */
+        return 't';
+
+    /* Greek, tonos stripped */
+    switch (cp) {
+    case 0x386:
+    case 0x3ac:
+        return 0x3b1;
+    case 0x388:
+    case 0x3ad:
+        return 0x3b5;
+    case 0x389:
+    case 0x3ae:
+        return 0x3b7;
+    case 0x38a:
+    case 0x3af:
+        return 0x3b9;
+    case 0x38c:
+    case 0x3cc:
+        return 0x3bf;
+    case 0x38e:
+    case 0x3cd:
+        return 0x3c5;
+    case 0x38f:
+    case 0x3ce:
+        return 0x3c9;
+    case 0x3c2: /* final sigma */
+        return 0x3c3;
+    }
+    if (cp >= 0x391 && cp <= 0x3a9)
+        return cp + 0x20;
+
+    /* Cyrillic */
+    if (cp == 0x401 || cp == 0x451) /* io */
+        return 0x435;
+    if (cp >= 0x400 && cp <= 0x40f)
+        return cp + 0x50;
+    if (cp >= 0x410 && cp <= 0x42f)
+        return cp + 0x20;
+    return cp;
+}
+
+int utf8_fold(const char *s, char *key, size_t size)
+{
+    const unsigned char *p = (const unsigned char *) s;
+    size_t n = 0;
+
+    while (*p) {
+        char buf[4];
+        const char *out = buf;
+        size_t len, outlen;
+        uint32_t cp;
+
+        if (!(len = utf8_decode(p, &cp))) /* cut short, drop it */
+            break;
+
+        if (len == 1 && cp < 0x80) {
+            buf[0] = cp >= 'A' && cp <= 'Z' ? cp + 'a' - 'A' : cp;
+            outlen = 1;
+        } else if (len == 1) { /* invalid byte, kept as is */
+            buf[0] = cp;
+            outlen = 1;
+        } else if (cp >= 0xc0 && cp < 0x180 && latin[cp - 0xc0]) {
+            out = latin[cp - 0xc0];
+            outlen = strlen(out);
+        } else if ((cp = utf8_fold_cp(cp)))
+            outlen = utf8_encode(cp, buf);
+        else
+            outlen = 0;
+
+        if (n + outlen + 1 > size)
+            return -1;
+        memcpy(key + n, out, outlen);
+        n += outlen;
+        p += len;
+    }
+    if (n + 1 > size)
+        return -1;
+    key[n] = 0;
+    return n;
+}
@@ -0,0 +1,16 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+/** utf8_fold() write the search key of the UTF-8 string 's' into 'key':
+ *  letters are folded to lower case and Latin diacritics are stripped
+ *  ("São Paulo" -> "sao paulo", "Köln" -> "koln", "Łódź" -> "lodz"),
+ *  combining marks are dropped and other code points are copied whole.
+ *  An incomplete sequence at the end of 's' is dropped, so the key never
+ *  ends inside a code point. returns the length of the key, -1 if it does
+ *  not fit in 'size' bytes including the nul-character.
+ */
+int utf8_fold(const char *s, char *key, size_t size);
+
+#endif